@@ -0,0 +1,1134 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "flat_hashmap.h"
+#include "hashmap.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The typed engine: hashmap_impl.h instantiated for 8-byte keys and values
+#define ADS_NAME typed_map
+#define ADS_KEY_T uint64_t
+#define ADS_VALUE_T uint64_t
+#include "hashmap_impl.h"
+
+/*
+ * Hashmap benchmark
+ *
+ * For every engine (bucket: hashmap, flat: flat_hashmap, typed: hashmap_impl.h
+ * for 8-byte keys and values, so only 8:8 rows), table size and key/value
+ * size, measures
+ *   insert       n inserts into an empty map (no reserve, so growth is included)
+ *   lookup_hit   lookups of present keys
+ *   lookup_miss  lookups of absent keys
+ *   delete       deletes of all n keys in random order
+ *   mixed        80% lookups, 10% puts, 10% deletes over the key set
+ *   lookup_staged
+ *                lookup_hit through the staged lookup API, STAGED_DEPTH lookups
+ *                in flight (bucket only; latency runs from begin to finish, so
+ *                it includes time spent advancing the other lookups)
+ * with uniform or Zipfian key choice (lookups and mixed only). Each row reports
+ * mean ns/op from an untimed-per-op pass, p50/p99/p99.9 latency from a second
+ * pass that times every operation, and bytes of map memory per entry.
+ *
+ * Usage: hashmap_bench [--engines=bucket,flat,typed] [--sizes=N,...] [--kv=K:V,...]
+ *                      [--ops=N] [--workloads=NAME,...] [--dist=uniform,zipf]
+ *                      [--theta=T] [--max-mem=BYTES] [--format=csv|json]
+ */
+
+// Defaults: table sizes from L1-resident to far beyond the last-level cache
+static const size_t DEFAULT_SIZES[] = {1u << 10, 1u << 14, 1u << 18, 1u << 22};
+static const size_t DEFAULT_KV[][2] = {{4, 4}, {8, 8}, {16, 16}, {8, 64}, {64, 64}, {256, 256}};
+#define DEFAULT_OPS 1000000
+#define DEFAULT_THETA 0.99
+#define DEFAULT_MAX_MEM ((size_t)2 << 30)
+
+// Upper bounds for list options
+#define MAX_LIST 32
+
+// Bytes of the largest supported key or value
+#define MAX_ITEM_SIZE 4096
+
+// Mixed workload operation split, in percent
+#define MIXED_PUT_PERCENT 10
+#define MIXED_DELETE_PERCENT 10
+
+enum engine
+{
+    ENGINE_BUCKET,
+    ENGINE_FLAT,
+    ENGINE_TYPED,
+    ENGINE_COUNT
+};
+
+static const char *const ENGINE_NAMES[ENGINE_COUNT] = {"bucket", "flat", "typed"};
+
+enum workload
+{
+    WORKLOAD_INSERT,
+    WORKLOAD_LOOKUP_HIT,
+    WORKLOAD_LOOKUP_MISS,
+    WORKLOAD_DELETE,
+    WORKLOAD_MIXED,
+    WORKLOAD_LOOKUP_STAGED,
+    WORKLOAD_COUNT
+};
+
+static const char *const WORKLOAD_NAMES[WORKLOAD_COUNT] = {"insert", "lookup_hit", "lookup_miss", "delete",
+                                                           "mixed", "lookup_staged"};
+
+// Lookups the lookup_staged workload keeps in flight
+#define STAGED_DEPTH 16
+
+enum distribution
+{
+    DIST_UNIFORM,
+    DIST_ZIPF,
+    DIST_COUNT
+};
+
+static const char *const DIST_NAMES[DIST_COUNT] = {"uniform", "zipf"};
+
+enum mixed_op
+{
+    OP_GET,
+    OP_PUT,
+    OP_DELETE
+};
+
+/**
+ * Parsed command line
+ */
+struct config
+{
+    bool engines[ENGINE_COUNT];
+    size_t sizes[MAX_LIST];
+    size_t size_count;
+    size_t kv[MAX_LIST][2];
+    size_t kv_count;
+    size_t ops;
+    bool workloads[WORKLOAD_COUNT];
+    bool dists[DIST_COUNT];
+    double theta;
+    size_t max_mem;
+    bool json;
+};
+
+/**
+ * One result row
+ */
+struct result
+{
+    enum engine engine;
+    enum workload workload;
+    enum distribution dist;
+    size_t entries;
+    size_t key_size;
+    size_t value_size;
+    size_t ops;
+    double ns_per_op;
+    double p50;
+    double p99;
+    double p999;
+    double bytes_per_entry;
+};
+
+/**
+ * Key material and operation sequences shared by the workloads of one
+ * (size, key size) configuration
+ */
+struct dataset
+{
+    size_t n;
+    size_t key_size;
+    char *keys;        // n present keys
+    char *miss_keys;   // n keys never inserted
+    uint32_t *order;   // Random permutation of [0, n) for deletes
+    uint32_t *picks;   // ops key indices drawn from the current distribution
+    uint8_t *mixed;    // ops enum mixed_op values
+    uint64_t *latency; // ops per-operation timings
+};
+
+/**
+ * Allocator that tracks the bytes a map holds
+ */
+struct counting_allocator
+{
+    size_t live;
+};
+
+// Fold every looked-up value into this so no lookup can be optimized away
+static uint64_t sink;
+
+/**
+ * Counting allocator: allocate and record size bytes.
+ *
+ * @param ctx The struct counting_allocator
+ * @param size Number of bytes
+ * @return Allocated memory, or NULL
+ */
+static void *count_alloc(void *ctx, size_t size)
+{
+    struct counting_allocator *counter = ctx;
+    void *ptr = malloc(size);
+    if (ptr)
+    {
+        counter->live += size;
+    }
+    return ptr;
+}
+
+/**
+ * Counting allocator: allocate and record size zero-filled bytes.
+ *
+ * @param ctx The struct counting_allocator
+ * @param size Number of bytes
+ * @return Zero-filled memory, or NULL
+ */
+static void *count_zalloc(void *ctx, size_t size)
+{
+    struct counting_allocator *counter = ctx;
+    void *ptr = calloc(1, size);
+    if (ptr)
+    {
+        counter->live += size;
+    }
+    return ptr;
+}
+
+/**
+ * Counting allocator: release memory and its recorded size.
+ *
+ * @param ctx The struct counting_allocator
+ * @param ptr Memory from count_alloc()
+ * @param size Size originally requested
+ */
+static void count_free(void *ctx, void *ptr, size_t size)
+{
+    struct counting_allocator *counter = ctx;
+    counter->live -= size;
+    free(ptr);
+}
+
+/**
+ * Current monotonic time.
+ *
+ * @return Nanoseconds since an arbitrary epoch
+ */
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * splitmix64 step, used both as the PRNG and to expand key bytes.
+ *
+ * @param state PRNG state, advanced
+ * @return Next 64 random bits
+ */
+static inline uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Bijective 32-bit mixer (murmur3 finalizer): distinct indices give distinct
+ * key prefixes, so keys are unique without a duplicate check.
+ *
+ * @param x Key index
+ * @return Mixed 32 bits
+ */
+static inline uint32_t mix32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+/**
+ * Uniform random double in [0, 1).
+ *
+ * @param state PRNG state, advanced
+ * @return Random double
+ */
+static inline double random_unit(uint64_t *state)
+{
+    return (double)(splitmix64(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Write the bytes of key number index: a unique 4-byte prefix followed by
+ * pseudo-random filler.
+ *
+ * @param dest Destination (key_size bytes)
+ * @param key_size Key size in bytes (at least 4)
+ * @param index Key index
+ */
+static void make_key(char *dest, size_t key_size, uint32_t index)
+{
+    uint32_t prefix = mix32(index);
+    memcpy(dest, &prefix, sizeof(prefix));
+    uint64_t state = index;
+    for (size_t offset = sizeof(prefix); offset < key_size; offset += sizeof(uint64_t))
+    {
+        uint64_t filler = splitmix64(&state);
+        size_t chunk = key_size - offset < sizeof(filler) ? key_size - offset : sizeof(filler);
+        memcpy(dest + offset, &filler, chunk);
+    }
+}
+
+/**
+ * Zipfian generator over [0, n) (Gray et al., "Quickly generating
+ * billion-record synthetic databases", as used by YCSB).
+ */
+struct zipf
+{
+    size_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double half_pow_theta;
+};
+
+/**
+ * Precompute the constants of a Zipfian distribution (O(n)).
+ *
+ * @param zipf Generator to initialize
+ * @param n Number of items
+ * @param theta Skew (0 < theta < 1; 0.99 is the YCSB default)
+ */
+static void zipf_init(struct zipf *zipf, size_t n, double theta)
+{
+    double zetan = 0;
+    for (size_t i = 1; i <= n; i++)
+    {
+        zetan += 1.0 / pow((double)i, theta);
+    }
+    double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->zetan = zetan;
+    zipf->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+    zipf->half_pow_theta = 1.0 + pow(0.5, theta);
+}
+
+/**
+ * Draw a Zipfian rank (0 is the most popular).
+ *
+ * @param zipf Initialized generator
+ * @param state PRNG state, advanced
+ * @return Rank in [0, n)
+ */
+static size_t zipf_next(const struct zipf *zipf, uint64_t *state)
+{
+    double u = random_unit(state);
+    double uz = u * zipf->zetan;
+    if (uz < 1.0)
+    {
+        return 0;
+    }
+    if (uz < zipf->half_pow_theta)
+    {
+        return zipf->n > 1 ? 1 : 0;
+    }
+    size_t rank = (size_t)((double)zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+/**
+ * Fill dataset->picks (and the mixed op kinds) for one distribution. Zipfian
+ * ranks are scattered over the key set by a multiplicative permutation so the
+ * hot keys do not share buckets.
+ *
+ * @param data Dataset whose keys are generated
+ * @param ops Number of picks
+ * @param dist Distribution to draw from
+ * @param zipf Generator for data->n items (DIST_ZIPF only)
+ */
+static void fill_picks(struct dataset *data, size_t ops, enum distribution dist, const struct zipf *zipf)
+{
+    uint64_t state = 0x5eed0000u + dist;
+    for (size_t i = 0; i < ops; i++)
+    {
+        size_t index = dist == DIST_ZIPF ? (size_t)((zipf_next(zipf, &state) * 2654435761ull) % data->n)
+                                         : (size_t)(splitmix64(&state) % data->n);
+        data->picks[i] = (uint32_t)index;
+        unsigned roll = (unsigned)(splitmix64(&state) % 100);
+        data->mixed[i] = roll < MIXED_PUT_PERCENT                          ? OP_PUT
+                         : roll < MIXED_PUT_PERCENT + MIXED_DELETE_PERCENT ? OP_DELETE
+                                                                           : OP_GET;
+    }
+}
+
+/**
+ * Release a dataset.
+ *
+ * @param data Dataset to free
+ */
+static void dataset_free(struct dataset *data)
+{
+    free(data->keys);
+    free(data->miss_keys);
+    free(data->order);
+    free(data->picks);
+    free(data->mixed);
+    free(data->latency);
+}
+
+/**
+ * Generate the keys, miss keys and delete order for one configuration.
+ *
+ * @param data Dataset to fill
+ * @param n Number of keys
+ * @param key_size Key size in bytes
+ * @param ops Length of the per-operation arrays
+ * @return true on success, false on allocation failure
+ */
+static bool dataset_init(struct dataset *data, size_t n, size_t key_size, size_t ops)
+{
+    size_t slots = ops > n ? ops : n;
+    data->n = n;
+    data->key_size = key_size;
+    data->keys = malloc(n * key_size);
+    data->miss_keys = malloc(n * key_size);
+    data->order = malloc(n * sizeof(uint32_t));
+    data->picks = malloc(ops * sizeof(uint32_t));
+    data->mixed = malloc(ops);
+    data->latency = malloc(slots * sizeof(uint64_t));
+    if (!data->keys || !data->miss_keys || !data->order || !data->picks || !data->mixed || !data->latency)
+    {
+        dataset_free(data);
+        return false;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        make_key(data->keys + i * key_size, key_size, (uint32_t)i);
+        make_key(data->miss_keys + i * key_size, key_size, (uint32_t)(n + i));
+        data->order[i] = (uint32_t)i;
+    }
+    uint64_t state = 0xde1e7e;
+    for (size_t i = n - 1; i > 0; i--)
+    {
+        size_t j = (size_t)(splitmix64(&state) % (i + 1));
+        uint32_t tmp = data->order[i];
+        data->order[i] = data->order[j];
+        data->order[j] = tmp;
+    }
+    return true;
+}
+
+/**
+ * Map under test, of any engine
+ */
+struct table
+{
+    enum engine engine;
+    hashmap *bucket;
+    flat_hashmap *flat;
+    typed_map *typed;
+};
+
+/**
+ * Create an empty map with the bundled hash.
+ *
+ * @param engine Engine to create
+ * @param key_size Key size in bytes
+ * @param value_size Value size in bytes
+ * @param counter Counting allocator state, or NULL for the default allocator
+ *                (typed maps always use malloc; see typed_map_bytes())
+ * @return New map (exits on failure)
+ */
+static struct table new_map(enum engine engine, size_t key_size, size_t value_size,
+                            struct counting_allocator *counter)
+{
+    hashmap_allocator allocator = {count_alloc, count_free, counter, count_zalloc};
+    hashmap_options options = {0};
+    options.allocator = counter ? &allocator : NULL;
+    struct table table = {engine, NULL, NULL, NULL};
+    if (engine == ENGINE_FLAT)
+    {
+        table.flat = flat_hashmap_create_ex(key_size, value_size, NULL, NULL, &options);
+    }
+    else if (engine == ENGINE_TYPED)
+    {
+        table.typed = typed_map_create(0);
+    }
+    else
+    {
+        table.bucket = hashmap_create_ex(key_size, value_size, NULL, NULL, &options);
+    }
+    if (!table.bucket && !table.flat && !table.typed)
+    {
+        fprintf(stderr, "%s map creation failed\n", ENGINE_NAMES[engine]);
+        exit(1);
+    }
+    return table;
+}
+
+/**
+ * Insert or update a key.
+ *
+ * @param table Map under test
+ * @param key Key
+ * @param value Value
+ * @return true on success
+ */
+static inline bool table_put(const struct table *table, const void *key, const void *value)
+{
+    if (table->typed)
+    {
+        uint64_t k, v;
+        memcpy(&k, key, sizeof(k));
+        memcpy(&v, value, sizeof(v));
+        return typed_map_put(table->typed, k, v);
+    }
+    return table->flat ? flat_hashmap_put(table->flat, key, value) : hashmap_put(table->bucket, key, value);
+}
+
+/**
+ * Look up a key.
+ *
+ * @param table Map under test
+ * @param key Key
+ * @param value_out Receives the value if found
+ * @return true if found
+ */
+static inline bool table_get(const struct table *table, const void *key, void *value_out)
+{
+    if (table->typed)
+    {
+        uint64_t k;
+        memcpy(&k, key, sizeof(k));
+        return typed_map_get(table->typed, k, (uint64_t *)value_out);
+    }
+    return table->flat ? flat_hashmap_get(table->flat, key, value_out) : hashmap_get(table->bucket, key, value_out);
+}
+
+/**
+ * Delete a key.
+ *
+ * @param table Map under test
+ * @param key Key
+ * @return true if it was present
+ */
+static inline bool table_delete(const struct table *table, const void *key)
+{
+    if (table->typed)
+    {
+        uint64_t k;
+        memcpy(&k, key, sizeof(k));
+        return typed_map_delete(table->typed, k);
+    }
+    return table->flat ? flat_hashmap_delete(table->flat, key) : hashmap_delete(table->bucket, key);
+}
+
+/**
+ * Destroy a map under test.
+ *
+ * @param table Map to destroy
+ */
+static void table_destroy(struct table *table)
+{
+    flat_hashmap_destroy(table->flat);
+    hashmap_destroy(table->bucket);
+    typed_map_destroy(table->typed);
+}
+
+/**
+ * Bytes held by a typed map: its bucket array and overflow slabs.
+ *
+ * @param map The typed map
+ * @return Bytes allocated
+ */
+static size_t typed_map_bytes(const typed_map *map)
+{
+    size_t bytes = sizeof(*map) + map->bucket_count * sizeof(typed_map_bucket);
+    for (const typed_map_slab *slab = map->slabs; slab; slab = slab->next)
+    {
+        bytes += sizeof(*slab) + slab->capacity * sizeof(typed_map_bucket);
+    }
+    return bytes;
+}
+
+/**
+ * Insert every key of the dataset.
+ *
+ * @param map Map to fill
+ * @param data Dataset
+ * @param value Value to store
+ * @param latency Per-insert timings (n entries), or NULL to skip timing
+ */
+static void fill_map(const struct table *map, const struct dataset *data, const void *value, uint64_t *latency)
+{
+    for (size_t i = 0; i < data->n; i++)
+    {
+        uint64_t start = latency ? now_ns() : 0;
+        if (!table_put(map, data->keys + i * data->key_size, value))
+        {
+            fprintf(stderr, "put failed\n");
+            exit(1);
+        }
+        if (latency)
+        {
+            latency[i] = now_ns() - start;
+        }
+    }
+}
+
+/**
+ * Run one pass of the lookup_staged workload: hit lookups through
+ * hashmap_lookup_begin/resume/finish, round-robin over a ring of STAGED_DEPTH
+ * lookups so that each one's prefetch has the others' work to hide behind.
+ * A settled lookup is finished and its slot refilled with the next key.
+ *
+ * @param map Filled bucket-engine map
+ * @param data Dataset with picks for the current distribution
+ * @param ops Number of lookups
+ * @param value Scratch value buffer (value_size bytes)
+ * @param latency Per-lookup begin-to-finish timings (ops entries), or NULL
+ */
+static void run_staged(const hashmap *map, const struct dataset *data, size_t ops, char *value, uint64_t *latency)
+{
+    hashmap_lookup lookups[STAGED_DEPTH];
+    size_t op[STAGED_DEPTH];
+    uint64_t started[STAGED_DEPTH];
+    bool live[STAGED_DEPTH] = {false};
+    size_t issued = 0;
+    size_t done = 0;
+    for (size_t s = 0; s < STAGED_DEPTH && issued < ops; s++, issued++)
+    {
+        started[s] = latency ? now_ns() : 0;
+        hashmap_lookup_begin(&lookups[s], map, data->keys + (size_t)data->picks[issued] * data->key_size);
+        op[s] = issued;
+        live[s] = true;
+    }
+    while (done < ops)
+    {
+        for (size_t s = 0; s < STAGED_DEPTH; s++)
+        {
+            if (!live[s] || !hashmap_lookup_resume(&lookups[s]))
+            {
+                continue;
+            }
+            sink += hashmap_lookup_finish(&lookups[s], value) ? (unsigned char)value[0] + 1u : 0u;
+            if (latency)
+            {
+                latency[op[s]] = now_ns() - started[s];
+            }
+            done++;
+            live[s] = issued < ops;
+            if (live[s])
+            {
+                started[s] = latency ? now_ns() : 0;
+                hashmap_lookup_begin(&lookups[s], map, data->keys + (size_t)data->picks[issued] * data->key_size);
+                op[s] = issued++;
+            }
+        }
+    }
+}
+
+/**
+ * Run one pass of a steady-state workload over an already filled map.
+ *
+ * @param workload WORKLOAD_LOOKUP_HIT, WORKLOAD_LOOKUP_MISS, WORKLOAD_MIXED or
+ *                 WORKLOAD_LOOKUP_STAGED (bucket engine only)
+ * @param map Filled map
+ * @param data Dataset with picks for the current distribution
+ * @param ops Number of operations
+ * @param value Scratch value buffer (value_size bytes)
+ * @param latency Per-operation timings (ops entries), or NULL to skip timing
+ */
+static void run_steady(enum workload workload, const struct table *map, const struct dataset *data, size_t ops,
+                       char *value, uint64_t *latency)
+{
+    if (workload == WORKLOAD_LOOKUP_STAGED)
+    {
+        run_staged(map->bucket, data, ops, value, latency);
+        return;
+    }
+    const char *keys = workload == WORKLOAD_LOOKUP_MISS ? data->miss_keys : data->keys;
+    for (size_t i = 0; i < ops; i++)
+    {
+        const char *key = keys + (size_t)data->picks[i] * data->key_size;
+        uint64_t start = latency ? now_ns() : 0;
+        if (workload != WORKLOAD_MIXED || data->mixed[i] == OP_GET)
+        {
+            sink += table_get(map, key, value) ? (unsigned char)value[0] + 1u : 0u;
+        }
+        else if (data->mixed[i] == OP_PUT)
+        {
+            sink += table_put(map, key, value);
+        }
+        else
+        {
+            sink += table_delete(map, key);
+        }
+        if (latency)
+        {
+            latency[i] = now_ns() - start;
+        }
+    }
+}
+
+/**
+ * Delete every key in random order.
+ *
+ * @param map Filled map
+ * @param data Dataset
+ * @param latency Per-delete timings (n entries), or NULL to skip timing
+ */
+static void run_delete(const struct table *map, const struct dataset *data, uint64_t *latency)
+{
+    for (size_t i = 0; i < data->n; i++)
+    {
+        const char *key = data->keys + (size_t)data->order[i] * data->key_size;
+        uint64_t start = latency ? now_ns() : 0;
+        sink += table_delete(map, key);
+        if (latency)
+        {
+            latency[i] = now_ns() - start;
+        }
+    }
+}
+
+/**
+ * qsort comparator for uint64_t.
+ */
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Estimate the cost of one now_ns() pair, subtracted from every timed operation.
+ *
+ * @return Median back-to-back timer delta in nanoseconds
+ */
+static uint64_t timer_overhead(void)
+{
+    enum
+    {
+        SAMPLES = 10001
+    };
+    static uint64_t deltas[SAMPLES];
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        uint64_t start = now_ns();
+        deltas[i] = now_ns() - start;
+    }
+    qsort(deltas, SAMPLES, sizeof(uint64_t), compare_u64);
+    return deltas[SAMPLES / 2];
+}
+
+/**
+ * Fill the percentile fields of a result from per-operation timings.
+ *
+ * @param result Result to update
+ * @param latency Timings (sorted in place)
+ * @param count Number of timings
+ * @param overhead Timer overhead to subtract
+ */
+static void set_percentiles(struct result *result, uint64_t *latency, size_t count, uint64_t overhead)
+{
+    qsort(latency, count, sizeof(uint64_t), compare_u64);
+    double *targets[] = {&result->p50, &result->p99, &result->p999};
+    const double fractions[] = {0.50, 0.99, 0.999};
+    for (size_t i = 0; i < 3; i++)
+    {
+        uint64_t sample = latency[(size_t)(fractions[i] * (double)(count - 1))];
+        *targets[i] = sample > overhead ? (double)(sample - overhead) : 0.0;
+    }
+}
+
+/**
+ * Print one result row.
+ *
+ * @param config Output format
+ * @param result Row to print
+ * @param first true for the first row (JSON separator)
+ */
+static void emit(const struct config *config, const struct result *result, bool first)
+{
+    if (config->json)
+    {
+        printf("%s\n  {\"engine\": \"%s\", \"workload\": \"%s\", \"distribution\": \"%s\", \"entries\": %zu, \"key_size\": %zu, "
+               "\"value_size\": %zu, \"ops\": %zu, \"ns_per_op\": %.2f, \"p50_ns\": %.0f, \"p99_ns\": %.0f, "
+               "\"p999_ns\": %.0f, \"bytes_per_entry\": %.2f}",
+               first ? "" : ",", ENGINE_NAMES[result->engine], WORKLOAD_NAMES[result->workload], DIST_NAMES[result->dist], result->entries,
+               result->key_size, result->value_size, result->ops, result->ns_per_op, result->p50, result->p99,
+               result->p999, result->bytes_per_entry);
+    }
+    else
+    {
+        printf("%s,%s,%s,%zu,%zu,%zu,%zu,%.2f,%.0f,%.0f,%.0f,%.2f\n", ENGINE_NAMES[result->engine],
+               WORKLOAD_NAMES[result->workload], DIST_NAMES[result->dist], result->entries, result->key_size, result->value_size, result->ops,
+               result->ns_per_op, result->p50, result->p99, result->p999, result->bytes_per_entry);
+    }
+    fflush(stdout);
+}
+
+/**
+ * Parse a comma-separated list of sizes.
+ *
+ * @param text List text
+ * @param out Receives the values
+ * @return Number of values parsed
+ */
+static size_t parse_sizes(const char *text, size_t *out)
+{
+    size_t count = 0;
+    while (*text && count < MAX_LIST)
+    {
+        char *end;
+        out[count++] = (size_t)strtoull(text, &end, 10);
+        text = *end == ',' ? end + 1 : end + strlen(end);
+    }
+    return count;
+}
+
+/**
+ * Parse a comma-separated list of names into a flag array.
+ *
+ * @param text List text
+ * @param names Recognized names
+ * @param name_count Number of names
+ * @param flags Receives true for every name in the list
+ * @return false if the list holds an unknown name
+ */
+static bool parse_names(const char *text, const char *const *names, size_t name_count, bool *flags)
+{
+    memset(flags, 0, name_count * sizeof(bool));
+    while (*text)
+    {
+        size_t len = strcspn(text, ",");
+        size_t i = 0;
+        while (i < name_count && (strlen(names[i]) != len || strncmp(text, names[i], len) != 0))
+        {
+            i++;
+        }
+        if (i == name_count)
+        {
+            return false;
+        }
+        flags[i] = true;
+        text += len + (text[len] == ',');
+    }
+    return true;
+}
+
+/**
+ * Parse the command line.
+ *
+ * @param config Receives the configuration
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return false on a malformed or unknown argument
+ */
+static bool parse_args(struct config *config, int argc, char **argv)
+{
+    memset(config, 0, sizeof(*config));
+    config->size_count = sizeof(DEFAULT_SIZES) / sizeof(DEFAULT_SIZES[0]);
+    memcpy(config->sizes, DEFAULT_SIZES, sizeof(DEFAULT_SIZES));
+    config->kv_count = sizeof(DEFAULT_KV) / sizeof(DEFAULT_KV[0]);
+    memcpy(config->kv, DEFAULT_KV, sizeof(DEFAULT_KV));
+    config->ops = DEFAULT_OPS;
+    config->theta = DEFAULT_THETA;
+    config->max_mem = DEFAULT_MAX_MEM;
+    for (size_t i = 0; i < WORKLOAD_COUNT; i++)
+    {
+        config->workloads[i] = true;
+    }
+    for (size_t i = 0; i < DIST_COUNT; i++)
+    {
+        config->dists[i] = true;
+    }
+    for (size_t i = 0; i < ENGINE_COUNT; i++)
+    {
+        config->engines[i] = true;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--sizes=", 8) == 0)
+        {
+            config->size_count = parse_sizes(arg + 8, config->sizes);
+        }
+        else if (strncmp(arg, "--kv=", 5) == 0)
+        {
+            config->kv_count = 0;
+            for (const char *p = arg + 5; *p && config->kv_count < MAX_LIST;)
+            {
+                char *end;
+                size_t *kv = config->kv[config->kv_count++];
+                kv[0] = (size_t)strtoull(p, &end, 10);
+                if (*end != ':')
+                {
+                    return false;
+                }
+                kv[1] = (size_t)strtoull(end + 1, &end, 10);
+                p = *end == ',' ? end + 1 : end + strlen(end);
+            }
+        }
+        else if (strncmp(arg, "--ops=", 6) == 0)
+        {
+            config->ops = (size_t)strtoull(arg + 6, NULL, 10);
+        }
+        else if (strncmp(arg, "--theta=", 8) == 0)
+        {
+            config->theta = strtod(arg + 8, NULL);
+        }
+        else if (strncmp(arg, "--max-mem=", 10) == 0)
+        {
+            config->max_mem = (size_t)strtoull(arg + 10, NULL, 10);
+        }
+        else if (strncmp(arg, "--workloads=", 12) == 0)
+        {
+            if (!parse_names(arg + 12, WORKLOAD_NAMES, WORKLOAD_COUNT, config->workloads))
+            {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--engines=", 10) == 0)
+        {
+            if (!parse_names(arg + 10, ENGINE_NAMES, ENGINE_COUNT, config->engines))
+            {
+                return false;
+            }
+        }
+        else if (strncmp(arg, "--dist=", 7) == 0)
+        {
+            if (!parse_names(arg + 7, DIST_NAMES, DIST_COUNT, config->dists))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--format=json") == 0)
+        {
+            config->json = true;
+        }
+        else if (strcmp(arg, "--format=csv") != 0)
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < config->size_count; i++)
+    {
+        if (config->sizes[i] == 0 || config->sizes[i] > UINT32_MAX / 2)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < config->kv_count; i++)
+    {
+        if (config->kv[i][0] < sizeof(uint32_t) || config->kv[i][0] > MAX_ITEM_SIZE || config->kv[i][1] == 0 ||
+            config->kv[i][1] > MAX_ITEM_SIZE)
+        {
+            return false;
+        }
+    }
+    return config->ops > 0 && config->theta > 0 && config->theta < 1;
+}
+
+/**
+ * Run every selected workload for one engine, table size and key/value size.
+ *
+ * @param config Configuration
+ * @param engine Engine to measure
+ * @param data Dataset for this size and key size
+ * @param value_size Value size in bytes
+ * @param zipf Zipfian generator for data->n items
+ * @param overhead Timer overhead
+ * @param rows Number of rows printed so far, updated
+ */
+static void run_config(const struct config *config, enum engine engine, struct dataset *data, size_t value_size,
+                       const struct zipf *zipf, uint64_t overhead, size_t *rows)
+{
+    static char value[MAX_ITEM_SIZE];
+    memset(value, 0xab, value_size);
+    size_t n = data->n;
+    struct result result = {0};
+    result.engine = engine;
+    result.entries = n;
+    result.key_size = data->key_size;
+    result.value_size = value_size;
+
+    // Memory footprint of a freshly filled map (also the state the steady
+    // workloads start from)
+    struct counting_allocator counter = {0};
+    struct table filled = new_map(engine, data->key_size, value_size, &counter);
+    fill_map(&filled, data, value, NULL);
+    size_t live = filled.typed ? typed_map_bytes(filled.typed) : counter.live;
+    result.bytes_per_entry = (double)live / (double)n;
+
+    if (config->workloads[WORKLOAD_INSERT])
+    {
+        struct table map = new_map(engine, data->key_size, value_size, NULL);
+        uint64_t start = now_ns();
+        fill_map(&map, data, value, NULL);
+        result.ns_per_op = (double)(now_ns() - start) / (double)n;
+        table_destroy(&map);
+
+        map = new_map(engine, data->key_size, value_size, NULL);
+        fill_map(&map, data, value, data->latency);
+        table_destroy(&map);
+        result.workload = WORKLOAD_INSERT;
+        result.dist = DIST_UNIFORM;
+        result.ops = n;
+        set_percentiles(&result, data->latency, n, overhead);
+        emit(config, &result, (*rows)++ == 0);
+    }
+
+    for (int dist = 0; dist < DIST_COUNT; dist++)
+    {
+        if (!config->dists[dist])
+        {
+            continue;
+        }
+        fill_picks(data, config->ops, (enum distribution)dist, zipf);
+        for (int workload = WORKLOAD_LOOKUP_HIT; workload < WORKLOAD_COUNT; workload++)
+        {
+            if (!config->workloads[workload] || workload == WORKLOAD_DELETE ||
+                (workload == WORKLOAD_LOOKUP_STAGED && engine != ENGINE_BUCKET))
+            {
+                continue;
+            }
+            // Mixed runs modify the map, so each pass starts from a fresh copy
+            struct table map = filled;
+            bool fresh = workload == WORKLOAD_MIXED;
+            if (fresh)
+            {
+                map = new_map(engine, data->key_size, value_size, NULL);
+                fill_map(&map, data, value, NULL);
+            }
+            uint64_t start = now_ns();
+            run_steady((enum workload)workload, &map, data, config->ops, value, NULL);
+            result.ns_per_op = (double)(now_ns() - start) / (double)config->ops;
+            if (fresh)
+            {
+                table_destroy(&map);
+                map = new_map(engine, data->key_size, value_size, NULL);
+                fill_map(&map, data, value, NULL);
+            }
+            run_steady((enum workload)workload, &map, data, config->ops, value, data->latency);
+            if (fresh)
+            {
+                table_destroy(&map);
+            }
+            result.workload = (enum workload)workload;
+            result.dist = (enum distribution)dist;
+            result.ops = config->ops;
+            set_percentiles(&result, data->latency, config->ops, overhead);
+            emit(config, &result, (*rows)++ == 0);
+        }
+    }
+
+    if (config->workloads[WORKLOAD_DELETE])
+    {
+        uint64_t start = now_ns();
+        run_delete(&filled, data, NULL);
+        result.ns_per_op = (double)(now_ns() - start) / (double)n;
+        fill_map(&filled, data, value, NULL);
+        run_delete(&filled, data, data->latency);
+        result.workload = WORKLOAD_DELETE;
+        result.dist = DIST_UNIFORM;
+        result.ops = n;
+        set_percentiles(&result, data->latency, n, overhead);
+        emit(config, &result, (*rows)++ == 0);
+    }
+    table_destroy(&filled);
+}
+
+/**
+ * Benchmark entry point: run the configured matrix, print one row per
+ * measurement (CSV with a header, or a JSON array).
+ */
+int main(int argc, char **argv)
+{
+    struct config config;
+    if (!parse_args(&config, argc, argv))
+    {
+        fprintf(stderr,
+                "usage: %s [--engines=bucket,flat,typed] [--sizes=N,...] [--kv=K:V,...] [--ops=N]\n"
+                "       [--workloads=NAME,...] [--dist=uniform,zipf] [--theta=T] [--max-mem=BYTES] [--format=csv|json]\n"
+                "key sizes 4-%d bytes, value sizes 1-%d bytes, 0 < theta < 1\n",
+                argv[0], MAX_ITEM_SIZE, MAX_ITEM_SIZE);
+        return 2;
+    }
+
+    uint64_t overhead = timer_overhead();
+    if (config.json)
+    {
+        printf("[");
+    }
+    else
+    {
+        printf("engine,workload,distribution,entries,key_size,value_size,ops,ns_per_op,p50_ns,p99_ns,p999_ns,"
+               "bytes_per_entry\n");
+    }
+
+    size_t rows = 0;
+    for (size_t s = 0; s < config.size_count; s++)
+    {
+        size_t n = config.sizes[s];
+        struct zipf zipf;
+        zipf_init(&zipf, n, config.theta);
+        for (size_t c = 0; c < config.kv_count; c++)
+        {
+            size_t key_size = config.kv[c][0];
+            size_t value_size = config.kv[c][1];
+            // Rough peak: two filled maps (~2.5x the raw entry bytes each at
+            // worst) plus the key arrays and per-operation buffers
+            size_t slots = config.ops > n ? config.ops : n;
+            double estimate = 5.0 * (double)n * (double)(key_size + value_size + 1) + 2.0 * (double)n * key_size +
+                              (double)slots * 13.0;
+            if (estimate > (double)config.max_mem)
+            {
+                fprintf(stderr, "skipping %zu entries of %zu+%zu bytes (over --max-mem)\n", n, key_size,
+                        value_size);
+                continue;
+            }
+            struct dataset data;
+            if (!dataset_init(&data, n, key_size, config.ops))
+            {
+                fprintf(stderr, "out of memory for %zu entries of %zu+%zu bytes\n", n, key_size, value_size);
+                continue;
+            }
+            for (int engine = 0; engine < ENGINE_COUNT; engine++)
+            {
+                bool typed_kv = key_size == sizeof(uint64_t) && value_size == sizeof(uint64_t);
+                if (config.engines[engine] && (engine != ENGINE_TYPED || typed_kv))
+                {
+                    run_config(&config, (enum engine)engine, &data, value_size, &zipf, overhead, &rows);
+                }
+            }
+            dataset_free(&data);
+        }
+    }
+
+    if (config.json)
+    {
+        printf("\n]\n");
+    }
+    fprintf(stderr, "timer overhead %" PRIu64 " ns subtracted from latencies (checksum %" PRIu64 ")\n",
+            overhead, sink);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#ifndef CONCURRENT_HASHMAP_H
+#define CONCURRENT_HASHMAP_H
+
+#include "hashmap.h"
+
+/**
+ * Thread-safe hashmap split into independently locked shards
+ *
+ * Each shard is a regular hashmap behind its own reader-writer lock; a key's
+ * shard is picked from bits of its hash that the shard's own bucket index and
+ * tophash do not use. Operations on keys in different shards never contend.
+ * The shard is picked with a seed fixed at creation, so a flooded shard
+ * reseeds (see HASHMAP_NO_RESEED) without moving keys to other shards.
+ * Keys, values and the hash/equals functions follow the hashmap rules.
+ */
+typedef struct concurrent_hashmap concurrent_hashmap;
+
+/**
+ * Flag for hashmap_options.flags, concurrent_hashmap_create_ex only:
+ * concurrent_hashmap_get takes no lock at all
+ *
+ * Readers run optimistically against a per-shard sequence count and retry if a
+ * writer overlapped them; bucket arrays freed by growth are released only
+ * after every reader that could see them has finished. Meant for read-mostly
+ * maps: reads scale with cores, while writes that complete a resize wait for
+ * in-flight readers. A custom equals function may be called on a key that is
+ * being overwritten (the result is discarded), and value_out may be written
+ * even when the key turns out to be absent. With evacuation_threads, a shard's
+ * parallel resize completes inside the write that starts it.
+ */
+#define CONCURRENT_HASHMAP_LOCK_FREE_READS (1u << 16)
+
+/**
+ * Create a new concurrent hashmap
+ *
+ * @param key_size Size of keys in bytes
+ * @param value_size Size of values in bytes
+ * @param hash Hash function for keys, or NULL for a bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
+ * @param shard_count Number of shards, rounded up to a power of two (at most 256);
+ *                    0 for the default of 64
+ * @return New map or NULL on failure
+ */
+concurrent_hashmap *concurrent_hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                                              size_t shard_count);
+
+/**
+ * Create a new concurrent hashmap with explicit options
+ *
+ * options->capacity is the expected total and is split evenly across shards.
+ * options->flags may include CONCURRENT_HASHMAP_LOCK_FREE_READS.
+ *
+ * @param key_size Size of keys in bytes
+ * @param value_size Size of values in bytes
+ * @param hash Hash function for keys, or NULL for a bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
+ * @param options Creation options applied to every shard, or NULL for defaults
+ * @param shard_count Number of shards (see concurrent_hashmap_create)
+ * @return New map or NULL on failure
+ */
+concurrent_hashmap *concurrent_hashmap_create_ex(size_t key_size, size_t value_size, hash_fn hash,
+                                                 equals_fn equals, const hashmap_options *options,
+                                                 size_t shard_count);
+
+/**
+ * Insert or update a key-value pair
+ *
+ * @param map The concurrent hashmap
+ * @param key Pointer to key data
+ * @param value Pointer to value data
+ * @return true on success, false on failure
+ */
+bool concurrent_hashmap_put(concurrent_hashmap *map, const void *key, const void *value);
+
+/**
+ * Retrieve a value by key
+ *
+ * @param map The concurrent hashmap
+ * @param key Pointer to key data
+ * @param value_out Pointer to store retrieved value (if found)
+ * @return true if key found, false otherwise
+ */
+bool concurrent_hashmap_get(const concurrent_hashmap *map, const void *key, void *value_out);
+
+/**
+ * Remove a key-value pair
+ *
+ * @param map The concurrent hashmap
+ * @param key Pointer to key data
+ * @return true if the key was found and removed, false otherwise
+ */
+bool concurrent_hashmap_delete(concurrent_hashmap *map, const void *key);
+
+/**
+ * Number of entries, summed over the shards one at a time (not an atomic
+ * snapshot while other threads are writing)
+ *
+ * @param map The concurrent hashmap
+ * @return Number of entries
+ */
+size_t concurrent_hashmap_size(const concurrent_hashmap *map);
+
+/**
+ * Destroy the map and free all memory; no other thread may be using it
+ *
+ * @param map Map to destroy
+ */
+void concurrent_hashmap_destroy(concurrent_hashmap *map);
+
+#endif
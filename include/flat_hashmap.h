@@ -0,0 +1,216 @@
+#ifndef FLAT_HASHMAP_H
+#define FLAT_HASHMAP_H
+
+#include "hashmap.h"
+
+/**
+ * Open-addressing hashmap with fixed-size keys and values (a Swiss table)
+ *
+ * Entries live in one flat slot array indexed by a parallel array of control
+ * bytes holding 7 bits of each key's hash. Lookups scan a group of 16 control
+ * bytes (8 without SSE2) at once and probe whole groups, so there are no
+ * overflow pointers to chase. Good for small keys and values where probe
+ * locality matters most; prefer hashmap for large values, since they move on
+ * every resize, and for incremental growth. The table resizes in one step when
+ * 7/8 of its slots are used.
+ */
+typedef struct flat_hashmap flat_hashmap;
+
+/**
+ * Create a new flat hashmap
+ *
+ * @param key_size Size of keys in bytes
+ * @param value_size Size of values in bytes
+ * @param hash Hash function for keys, or NULL for a bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
+ * @return New map or NULL on failure
+ */
+flat_hashmap *flat_hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals);
+
+/**
+ * Create a new flat hashmap with explicit options
+ *
+ * capacity, allocator and seeded_hash are used as for hashmap_create_ex; the
+ * flags, evacuation_threads, shrink_percent and numa_nodes fields do not apply
+ * and are ignored.
+ *
+ * @param key_size Size of keys in bytes
+ * @param value_size Size of values in bytes
+ * @param hash Hash function for keys, or NULL for a bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
+ * @param options Creation options, or NULL for defaults
+ * @return New map or NULL on failure
+ */
+flat_hashmap *flat_hashmap_create_ex(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                                     const hashmap_options *options);
+
+/**
+ * Make room for at least capacity entries without further growth
+ *
+ * @param map The flat hashmap
+ * @param capacity Number of entries to hold without growing
+ * @return true on success, false on failure
+ */
+bool flat_hashmap_reserve(flat_hashmap *map, size_t capacity);
+
+/**
+ * Insert or update a key-value pair
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to key data
+ * @param value Pointer to value data
+ * @return true on success, false on failure
+ */
+bool flat_hashmap_put(flat_hashmap *map, const void *key, const void *value);
+
+/**
+ * Insert or update a batch of key-value pairs, resizing the table at most once
+ *
+ * @param map The flat hashmap
+ * @param keys Array of n keys stored contiguously
+ * @param values Array of n values stored contiguously
+ * @param n Number of entries
+ * @param flags 0 or HASHMAP_BATCH_UNIQUE
+ * @return Number of entries stored (n on success)
+ */
+size_t flat_hashmap_put_batch(flat_hashmap *map, const void *keys, const void *values, size_t n, unsigned flags);
+
+/**
+ * Retrieve a value by key
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to key data
+ * @param value_out Pointer to store retrieved value (if found)
+ * @return true if key found, false otherwise
+ */
+bool flat_hashmap_get(const flat_hashmap *map, const void *key, void *value_out);
+
+/**
+ * Retrieve the values for a batch of keys, prefetching all their groups first
+ *
+ * @param map The flat hashmap
+ * @param keys Array of n keys stored contiguously
+ * @param n Number of keys
+ * @param values_out Array of n values; entries for missing keys are left untouched
+ * @param found_out Optional array of n flags set to whether each key was found
+ * @return Number of keys found
+ */
+size_t flat_hashmap_get_batch(const flat_hashmap *map, const void *keys, size_t n, void *values_out,
+                              bool *found_out);
+
+/**
+ * Get a pointer to the stored value for a key, without copying
+ * The value may be modified in place. The pointer is valid until the next
+ * mutation of the map (put, delete, reserve).
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to key data
+ * @return Pointer to the stored value, or NULL if not found
+ */
+void *flat_hashmap_get_ptr(const flat_hashmap *map, const void *key);
+
+/**
+ * Get a writable pointer to the value slot for a key, inserting it if absent
+ *
+ * A newly inserted value is zero-filled. The pointer is valid until the next
+ * mutation of the map.
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to key data
+ * @param inserted Optional; set to whether the key was newly inserted
+ * @return Pointer to the value slot, or NULL on failure
+ */
+void *flat_hashmap_get_or_insert_slot(flat_hashmap *map, const void *key, bool *inserted);
+
+/**
+ * Remove a key-value pair
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to key data
+ * @return true if the key was found and removed, false otherwise
+ */
+bool flat_hashmap_delete(flat_hashmap *map, const void *key);
+
+/**
+ * Number of entries
+ *
+ * @param map The flat hashmap
+ * @return Number of entries
+ */
+size_t flat_hashmap_size(const flat_hashmap *map);
+
+/**
+ * Probe lengths counted individually by flat_hashmap_stats; longer probes are
+ * counted in the last histogram entry
+ */
+#define FLAT_HASHMAP_STATS_MAX_PROBE 8
+
+/**
+ * Snapshot of a flat map's shape, filled in by flat_hashmap_stats
+ *
+ * count          Number of entries
+ * capacity       Slots in the table
+ * tombstones     Slots freed by deletes that probes must still step over
+ * growth_left    Inserts into never-used slots left before the next resize
+ * probe_lengths  probe_lengths[i]: entries found in the (i + 1)th group of
+ *                their probe sequence; the last entry also counts later ones
+ * max_probe      Groups probed to reach the farthest entry
+ * load_factor    Entries per slot (the table resizes above 7/8)
+ */
+typedef struct flat_hashmap_statistics
+{
+    size_t count;
+    size_t capacity;
+    size_t tombstones;
+    size_t growth_left;
+    size_t probe_lengths[FLAT_HASHMAP_STATS_MAX_PROBE];
+    size_t max_probe;
+    double load_factor;
+} flat_hashmap_statistics;
+
+/**
+ * Collect statistics about a flat map. Rehashes every entry, so it costs O(capacity).
+ *
+ * @param map The flat hashmap
+ * @param out Receives the statistics
+ * @return true on success, false on NULL parameters
+ */
+bool flat_hashmap_stats(const flat_hashmap *map, flat_hashmap_statistics *out);
+
+/**
+ * Iterator over the entries of a flat hashmap; the fields are internal
+ * Entries are visited in slot order. Any mutation of the map invalidates the
+ * iterator; values may be modified in place.
+ */
+typedef struct flat_hashmap_iter
+{
+    const flat_hashmap *map;
+    size_t index;
+} flat_hashmap_iter;
+
+/**
+ * Start iterating over a flat hashmap
+ *
+ * @param iter Iterator to initialize
+ * @param map The flat hashmap
+ */
+void flat_hashmap_iter_init(flat_hashmap_iter *iter, const flat_hashmap *map);
+
+/**
+ * Advance to the next entry
+ *
+ * @param iter Iterator from flat_hashmap_iter_init
+ * @param key_out Optional; set to the stored key
+ * @param value_out Optional; set to the stored value (writable)
+ * @return true if an entry was produced, false when the iteration is done
+ */
+bool flat_hashmap_iter_next(flat_hashmap_iter *iter, const void **key_out, void **value_out);
+
+/**
+ * Destroy the map and free all memory
+ *
+ * @param map Map to destroy
+ */
+void flat_hashmap_destroy(flat_hashmap *map);
+
+#endif
@@ -9,18 +9,224 @@ typedef struct hashmap hashmap;
 
 typedef uint64_t (*hash_fn)(const void *key, size_t key_size);
 
+typedef uint64_t (*seeded_hash_fn)(const void *key, size_t key_size, uint64_t seed);
+
 typedef bool (*equals_fn)(const void *a, const void *b, size_t key_size);
 
+/**
+ * Allocator used for all memory owned by a hashmap
+ * (the map structure, bucket arrays and overflow slabs)
+ *
+ * alloc  Allocate size bytes aligned for any type, or return NULL
+ * free   Release memory from alloc; size is the size originally requested
+ * ctx    Opaque pointer passed to all callbacks
+ * zalloc Optional: like alloc, but the memory is zero-filled (calloc, or fresh
+ *        pages from mmap). Bucket arrays and slabs only need zeroes, so with
+ *        zalloc a new array's pages are first touched when entries move in;
+ *        without it they are cleared with memset when allocated
+ */
+typedef struct hashmap_allocator
+{
+    void *(*alloc)(void *ctx, size_t size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+    void *(*zalloc)(void *ctx, size_t size);
+} hashmap_allocator;
+
+/**
+ * Layout flags for hashmap_options.flags
+ *
+ * HASHMAP_PAD_SLOTS    Pad each key and value slot to its natural alignment
+ *                      (up to 8 bytes), e.g. 12-byte keys take 16 bytes
+ * HASHMAP_CACHE_ALIGN  Round the bucket stride up to a multiple of 64 bytes so
+ *                      every bucket starts on a cache line (costs up to 63
+ *                      bytes of padding per bucket)
+ *
+ * Keys and values larger than 128 bytes are stored out of line by default: the
+ * bucket holds a pointer to a pooled copy, keeping buckets small enough to scan
+ * in cache at the cost of one extra load per access. Indirect maps cannot be
+ * saved with hashmap_save.
+ *
+ * HASHMAP_INLINE_LARGE     Store keys and values inline whatever their size
+ * HASHMAP_INDIRECT_KEYS    Store keys out of line whatever their size
+ * HASHMAP_INDIRECT_VALUES  Store values out of line whatever their size
+ *
+ * HASHMAP_FINGERPRINTS  Keep 32 more bits of every key's hash next to its
+ *                       8-bit tophash (4 bytes per slot), so keys are almost
+ *                       only compared on true matches and growth moves
+ *                       entries without calling hash_fn. Worth it for large
+ *                       keys, custom equals or expensive hashes
+ *
+ * HASHMAP_NEIGHBORHOOD  When a key's bucket and its overflow chain are full,
+ *                       place the new entry in the first of the next 3 buckets
+ *                       with a free slot before adding an overflow bucket.
+ *                       Each bucket counts the entries it spilled per
+ *                       neighbor (8 bytes per bucket), so a lookup scans its
+ *                       own chain plus at most 3 neighbors, and chains only
+ *                       grow once the whole neighborhood is full. Cuts
+ *                       overflow buckets several-fold near the load limit;
+ *                       parallel evacuation is not used with it
+ */
+#define HASHMAP_PAD_SLOTS (1u << 0)
+#define HASHMAP_CACHE_ALIGN (1u << 1)
+#define HASHMAP_INLINE_LARGE (1u << 2)
+#define HASHMAP_INDIRECT_KEYS (1u << 3)
+#define HASHMAP_INDIRECT_VALUES (1u << 4)
+#define HASHMAP_FINGERPRINTS (1u << 6)
+#define HASHMAP_NEIGHBORHOOD (1u << 7)
+
+/**
+ * Flag for hashmap_options.flags: keep the hash seed fixed for the map's lifetime
+ *
+ * By default, an insert that has to extend a chain already 8 buckets long (a
+ * hash flood, or a hash_fn that ignores most of the key) makes the map pick a
+ * new seed and move every entry to a same-size bucket array hashed with it,
+ * incrementally like growth. This happens at most once per table size, since
+ * keys whose hash_fn results are identical collide under any seed.
+ */
+#define HASHMAP_NO_RESEED (1u << 5)
+
+/**
+ * Page placement flags for hashmap_options.flags (Linux only, ignored elsewhere)
+ *
+ * With either flag, or numa_nodes set, bucket arrays of 2 MB and more are
+ * mapped straight from the kernel instead of coming from the allocator;
+ * overflow buckets and out-of-line keys and values still use the allocator.
+ *
+ * HASHMAP_HUGE_PAGES       Back bucket arrays with huge pages to cut TLB misses
+ *                          on random lookups: 1 GB pages for arrays of 1 GB
+ *                          and more, else 2 MB pages, from the reserved
+ *                          hugetlbfs pool while it has room, otherwise
+ *                          transparent huge pages (madvise)
+ * HASHMAP_NUMA_INTERLEAVE  Spread bucket arrays page by page across the NUMA
+ *                          nodes in numa_nodes, or all nodes the process may
+ *                          use if it is 0
+ */
+#define HASHMAP_HUGE_PAGES (1u << 8)
+#define HASHMAP_NUMA_INTERLEAVE (1u << 9)
+
+/**
+ * Options for hashmap_create_ex. Zero-initialize, then set the fields you need.
+ *
+ * capacity     Number of entries to hold without growing (0 for the default size)
+ * allocator    Allocator for all map memory, or NULL for malloc/calloc/free;
+ *              copied into the map, but ctx must outlive it
+ * seeded_hash  Hash that takes the map's random seed; overrides the hash argument
+ * flags        Bitwise OR of HASHMAP_* layout, reseed and page placement flags
+ * evacuation_threads
+ *              Worker threads that move entries when a large map (64K+
+ *              buckets) doubles, instead of incrementally (0 or 1 to
+ *              disable). Started at the first such resize and kept until the
+ *              map is destroyed, they take ranges of old buckets from the next
+ *              put or delete on, in the background: operations carry on, and
+ *              one that needs a range nobody has taken yet moves it itself
+ * shrink_percent
+ *              Shrink automatically once deletes leave fewer entries than this
+ *              percentage of what the bucket array holds (0 to never shrink)
+ * numa_nodes   Bitmask of NUMA nodes (bit n for node n) to bind bucket arrays
+ *              to, or to interleave them across with HASHMAP_NUMA_INTERLEAVE
+ *              (0: first-touch placement unless interleaving). Placement is
+ *              best effort: a kernel without NUMA support leaves it as usual
+ */
+typedef struct hashmap_options
+{
+    size_t capacity;
+    const hashmap_allocator *allocator;
+    seeded_hash_fn seeded_hash;
+    unsigned flags;
+    unsigned evacuation_threads;
+    unsigned shrink_percent;
+    unsigned long numa_nodes;
+} hashmap_options;
+
+/**
+ * Bundled seeded hashes, usable as hashmap_options.seeded_hash
+ *
+ * hashmap_hash_bytes  wyhash over key_size arbitrary bytes
+ * hashmap_hash_u32    Integer mixer for 4-byte keys (key_size ignored)
+ * hashmap_hash_u64    Integer mixer for 8-byte keys (key_size ignored)
+ *
+ * When a map is created with a NULL hash and no seeded_hash, the u32/u64 mixer
+ * is used for 4/8-byte keys and hashmap_hash_bytes otherwise. The result of an
+ * unseeded hash_fn is always mixed with the map's seed.
+ */
+uint64_t hashmap_hash_bytes(const void *key, size_t key_size, uint64_t seed);
+uint64_t hashmap_hash_u32(const void *key, size_t key_size, uint64_t seed);
+uint64_t hashmap_hash_u64(const void *key, size_t key_size, uint64_t seed);
+
+/**
+ * Random hash seed, as given to every new map: read from the operating
+ * system's random source (getrandom() or /dev/urandom), falling back to the
+ * clock only if neither can be read
+ *
+ * @param map Address of the map being seeded, mixed in so maps seeded at the
+ *            same moment still differ (may be NULL)
+ * @return Seed
+ */
+uint64_t hashmap_random_seed(const void *map);
+
 /**
  * Create a new hashmap
  *
  * @param key_size Size of keys in bytes
  * @param value_size Size of values in bytes
- * @param hash Hash function for keys
- * @param equals Equality function for keys
+ * @param hash Hash function for keys, or NULL for a bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
  * @param return New hashmap or NULL on failure
  */
-hashmap hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals);
+hashmap *hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals);
+
+/**
+ * Create a new hashmap presized for an expected number of entries
+ *
+ * @param key_size Size of keys in bytes
+ * @param value_size Size of values in bytes
+ * @param hash Hash function for keys, or NULL for a bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
+ * @param capacity Number of entries to hold without growing
+ * @return New hashmap or NULL on failure
+ */
+hashmap *hashmap_create_with_capacity(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                                      size_t capacity);
+
+/**
+ * Create a new hashmap with explicit options
+ *
+ * @param key_size Size of keys in bytes
+ * @param value_size Size of values in bytes
+ * @param hash Hash function for keys, or NULL for a bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
+ * @param options Creation options, or NULL for defaults
+ * @return New hashmap or NULL on failure
+ */
+hashmap *hashmap_create_ex(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                           const hashmap_options *options);
+
+/**
+ * Make room for at least capacity entries without further growth
+ *
+ * @param map The hashmap
+ * @param capacity Number of entries to hold without growing
+ * @return true on success, false on failure
+ */
+bool hashmap_reserve(hashmap *map, size_t capacity);
+
+/**
+ * Shrink the bucket array to fit the current entries and repack overflow chains
+ *
+ * @param map The hashmap
+ * @return true on success, false on failure
+ */
+bool hashmap_shrink_to_fit(hashmap *map);
+
+/**
+ * Repack overflow chains at the current size, freeing overflow buckets left
+ * empty by deletes
+ *
+ * @param map The hashmap
+ * @return true on success, false on failure
+ */
+bool hashmap_compact(hashmap *map);
 
 /**
  * Insert or update a key-value pair
@@ -32,6 +238,42 @@ hashmap hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_
  */
 bool hashmap_put(hashmap *map, const void *key, const void *value);
 
+/**
+ * Flag for hashmap_put_batch/hashmap_build: the keys are distinct and not yet in
+ * the map, so the search for an existing entry is skipped
+ */
+#define HASHMAP_BATCH_UNIQUE (1u << 0)
+
+/**
+ * Insert or update a batch of key-value pairs, resizing the table at most once
+ *
+ * @param map the hashmap
+ * @param keys Array of n keys stored contiguously
+ * @param values Array of n values stored contiguously
+ * @param n Number of entries
+ * @param flags 0 or HASHMAP_BATCH_UNIQUE
+ * @return Number of entries stored (n on success)
+ */
+size_t hashmap_put_batch(hashmap *map, const void *keys, const void *values, size_t n, unsigned flags);
+
+/**
+ * Create a hashmap sized for n entries and fill it from key and value arrays
+ *
+ * @param key_size Size of keys in bytes
+ * @param value_size Size of values in bytes
+ * @param hash Hash function for keys, or NULL for a bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
+ * @param options Creation options, or NULL for defaults
+ * @param keys Array of n keys stored contiguously
+ * @param values Array of n values stored contiguously
+ * @param n Number of entries
+ * @param flags 0 or HASHMAP_BATCH_UNIQUE
+ * @return New hashmap or NULL on failure
+ */
+hashmap *hashmap_build(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                       const hashmap_options *options, const void *keys, const void *values, size_t n,
+                       unsigned flags);
+
 /**
  * Retrieve a value by key
  *
@@ -41,7 +283,243 @@ bool hashmap_put(hashmap *map, const void *key, const void *value);
  * @return true if key found, false otherwise
  */
 
-bool hashmap_get(hashmap *map, const void *key, void *value_out);
+bool hashmap_get(const hashmap *map, const void *key, void *value_out);
+
+/**
+ * Retrieve the values for a batch of keys, prefetching all their buckets first
+ *
+ * @param map The hashmap
+ * @param keys Array of n keys stored contiguously
+ * @param n Number of keys
+ * @param values_out Array of n values; entries for missing keys are left untouched
+ * @param found_out Optional array of n flags set to whether each key was found
+ * @return Number of keys found
+ */
+size_t hashmap_get_batch(const hashmap *map, const void *keys, size_t n, void *values_out, bool *found_out);
+
+/**
+ * A lookup split into stages, so that a scheduler (an event loop, coroutines)
+ * can keep many independent lookups in flight and overlap their cache misses
+ * instead of stalling on each; the fields are internal
+ *
+ * hashmap_lookup_begin hashes the key and prefetches its bucket. Each
+ * hashmap_lookup_resume scans the bucket prefetched last and either settles
+ * the lookup or prefetches the next overflow bucket, so do other work (or
+ * advance other lookups) between the calls. hashmap_lookup_finish returns the
+ * result, running any stages still left. The key must stay valid and the map
+ * unmodified from begin to finish; lookups may run concurrently with each
+ * other as with hashmap_get.
+ */
+typedef struct hashmap_lookup
+{
+    const hashmap *map;
+    const void *key;
+    uint64_t hash;
+    uint64_t probe_hash;
+    void *bucket;
+    void *value;
+    uint64_t probed;
+} hashmap_lookup;
+
+/**
+ * Start a staged lookup: hash the key and prefetch its bucket
+ *
+ * @param lookup Lookup state to initialize
+ * @param map The hashmap (NULL yields a lookup that finds nothing)
+ * @param key Pointer to key data, valid until hashmap_lookup_finish
+ */
+void hashmap_lookup_begin(hashmap_lookup *lookup, const hashmap *map, const void *key);
+
+/**
+ * Run the next stage of a staged lookup
+ *
+ * @param lookup Lookup from hashmap_lookup_begin
+ * @return true once the lookup is settled, false if it prefetched another
+ *         bucket and needs another call
+ */
+bool hashmap_lookup_resume(hashmap_lookup *lookup);
+
+/**
+ * Complete a staged lookup
+ *
+ * @param lookup Lookup from hashmap_lookup_begin
+ * @param value_out Optional; receives a copy of the value if the key was found
+ * @return Pointer to the stored value (as hashmap_get_ptr), or NULL if not found
+ */
+void *hashmap_lookup_finish(hashmap_lookup *lookup, void *value_out);
+
+/**
+ * Remove a key-value pair
+ *
+ * @param map The hashmap
+ * @param key Pointer to key data
+ * @return true if the key was found and removed, false otherwise
+ */
+bool hashmap_delete(hashmap *map, const void *key);
+
+/**
+ * Number of entries in the map
+ *
+ * @param map The hashmap
+ * @return Number of entries
+ */
+size_t hashmap_size(const hashmap *map);
+
+/**
+ * Get a pointer to the stored value for a key, without copying
+ *
+ * The value may be modified in place. The pointer is valid until the next
+ * mutation of the map (put, delete, reserve, ...).
+ *
+ * @param map The hashmap
+ * @param key Pointer to key data
+ * @return Pointer to the stored value, or NULL if not found
+ */
+void *hashmap_get_ptr(const hashmap *map, const void *key);
+
+/**
+ * Get a writable pointer to the value slot for a key, inserting it if absent
+ *
+ * A newly inserted value is zero-filled. The pointer is valid until the next
+ * mutation of the map.
+ *
+ * @param map The hashmap
+ * @param key Pointer to key data
+ * @param inserted Optional; set to whether the key was newly inserted
+ * @return Pointer to the value slot, or NULL on failure
+ */
+void *hashmap_get_or_insert_slot(hashmap *map, const void *key, bool *inserted);
+
+/**
+ * Write a snapshot of the map (header, bucket array and overflow buckets) to a file
+ *
+ * Finishes any growth in progress first. The format is tied to the machine's
+ * byte order and to the hash function: reopen it with the same hash. Maps that
+ * store keys or values out of line cannot be saved.
+ *
+ * @param map The hashmap
+ * @param fd File descriptor open for writing
+ * @return true on success, false on failure
+ */
+bool hashmap_save(hashmap *map, int fd);
+
+/**
+ * Open a snapshot from hashmap_save by mapping it copy-on-write
+ *
+ * Nothing is copied: opening only checks each bucket's overflow link and slot
+ * markers, so a truncated or corrupt file is rejected rather than read out of
+ * bounds. The map can be modified; changes stay private and are never written
+ * back to the file.
+ *
+ * @param path Snapshot file
+ * @param hash Hash function the saved map used, or NULL for the bundled hash
+ * @param equals Equality function for keys, or NULL to compare keys bytewise
+ * @param options Options for the opened map (capacity and layout flags come from the file), or NULL
+ * @return New hashmap or NULL on failure
+ */
+hashmap *hashmap_open_mmap(const char *path, hash_fn hash, equals_fn equals, const hashmap_options *options);
+
+/**
+ * Iterator over the entries of a hashmap; the fields are internal
+ *
+ * Entries are visited in bucket array order (old buckets still waiting to be
+ * moved by incremental growth first), so a full scan streams through memory
+ * sequentially. The order is unspecified otherwise. Any mutation of the map
+ * (put, delete, reserve, ...) invalidates the iterator; values may be modified
+ * in place.
+ */
+typedef struct hashmap_iter
+{
+    const hashmap *map;
+    void *bucket;
+    size_t index;
+    uint64_t full;
+    bool old;
+} hashmap_iter;
+
+/**
+ * Start iterating over a hashmap
+ *
+ * @param iter Iterator to initialize
+ * @param map The hashmap
+ */
+void hashmap_iter_init(hashmap_iter *iter, const hashmap *map);
+
+/**
+ * Advance to the next entry
+ *
+ * @param iter Iterator from hashmap_iter_init
+ * @param key_out Optional; set to the stored key
+ * @param value_out Optional; set to the stored value (writable)
+ * @return true if an entry was produced, false when the iteration is done
+ */
+bool hashmap_iter_next(hashmap_iter *iter, const void **key_out, void **value_out);
+
+/**
+ * Chain lengths counted individually by hashmap_stats; longer chains are
+ * counted in the last histogram entry
+ */
+#define HASHMAP_STATS_MAX_CHAIN 8
+
+/**
+ * Snapshot of a map's shape, filled in by hashmap_stats
+ *
+ * count               Number of entries
+ * bucket_count        Buckets in the current array
+ * overflow_buckets    Overflow buckets linked into chains (of both arrays while growing)
+ * chain_lengths       chain_lengths[i]: chains of i + 1 buckets (head plus
+ *                     overflow); the last entry also counts longer chains
+ * max_chain           Buckets in the longest chain
+ * load_factor         Entries per bucket (growth starts above 6.5)
+ * growing             true while entries are being moved to a new array
+ * old_bucket_count    Buckets in the array being moved (0 unless growing)
+ * evacuated           Old buckets moved so far (0 unless growing)
+ *
+ * Lookup counters, only maintained when the library is built with
+ * -DHASHMAP_STATS (always 0 otherwise). Every get, get_ptr, get_batch and
+ * staged lookup since creation or the last hashmap_stats_reset is counted:
+ *
+ * lookups             Lookups performed
+ * probed_buckets      Buckets whose tophashes were scanned (divide by
+ *                     lookups for the average probe length)
+ * max_probed_buckets  Most buckets scanned by a single lookup
+ * key_compares        Keys compared after a tophash match
+ * false_positives     Compares that failed: tophash matched, key differed
+ */
+typedef struct hashmap_statistics
+{
+    size_t count;
+    size_t bucket_count;
+    size_t overflow_buckets;
+    size_t chain_lengths[HASHMAP_STATS_MAX_CHAIN];
+    size_t max_chain;
+    double load_factor;
+    bool growing;
+    size_t old_bucket_count;
+    size_t evacuated;
+    uint64_t lookups;
+    uint64_t probed_buckets;
+    uint64_t max_probed_buckets;
+    uint64_t key_compares;
+    uint64_t false_positives;
+} hashmap_statistics;
+
+/**
+ * Collect statistics about a map. Walks every chain, so it costs O(buckets).
+ *
+ * @param map The hashmap
+ * @param out Receives the statistics
+ * @return true on success, false on NULL parameters
+ */
+bool hashmap_stats(const hashmap *map, hashmap_statistics *out);
+
+/**
+ * Zero the lookup counters reported by hashmap_stats (no-op unless built with
+ * -DHASHMAP_STATS)
+ *
+ * @param map The hashmap
+ */
+void hashmap_stats_reset(hashmap *map);
 
 /**
  * Destroy the hasmap and free all memory
@@ -50,4 +528,82 @@ bool hashmap_get(hashmap *map, const void *key, void *value_out);
 
 void hashmap_destroy(hashmap *map);
 
+/**
+ * Define a typed API over hashmap for fixed key and value types
+ *
+ * The map uses the bundled hash and compares keys bytewise, so K must not
+ * contain padding bytes. The wrappers only add type safety: they forward to
+ * the generic functions, which pick the probe loops specialized for 4-, 8-
+ * and 16-byte keys at run time from the map's key size. For a map whose
+ * layout and probe loop are compiled for K and V, use hashmap_impl.h.
+ *
+ * HASHMAP_DEFINE(u64_u64, uint64_t, uint64_t) defines the type u64_u64_map and:
+ *   u64_u64_map *u64_u64_create(void);
+ *   u64_u64_map *u64_u64_create_with_capacity(size_t capacity);
+ *   bool u64_u64_put(u64_u64_map *map, uint64_t key, uint64_t value);
+ *   bool u64_u64_get(const u64_u64_map *map, uint64_t key, uint64_t *value_out);
+ *   uint64_t *u64_u64_get_ptr(const u64_u64_map *map, uint64_t key);
+ *   uint64_t *u64_u64_get_or_insert_slot(u64_u64_map *map, uint64_t key, bool *inserted);
+ *   bool u64_u64_delete(u64_u64_map *map, uint64_t key);
+ *   void u64_u64_iter_init(hashmap_iter *iter, const u64_u64_map *map);
+ *   bool u64_u64_iter_next(hashmap_iter *iter, const uint64_t **key, uint64_t **value);
+ *   void u64_u64_destroy(u64_u64_map *map);
+ */
+#define HASHMAP_DEFINE(name, K, V)                                                                                    \
+    typedef struct name##_map name##_map;                                                                             \
+    static inline name##_map *name##_create(void)                                                                     \
+    {                                                                                                                 \
+        return (name##_map *)hashmap_create(sizeof(K), sizeof(V), NULL, NULL);                                        \
+    }                                                                                                                 \
+    static inline name##_map *name##_create_with_capacity(size_t capacity)                                            \
+    {                                                                                                                 \
+        return (name##_map *)hashmap_create_with_capacity(sizeof(K), sizeof(V), NULL, NULL, capacity);                \
+    }                                                                                                                 \
+    static inline bool name##_put(name##_map *map, K key, V value)                                                    \
+    {                                                                                                                 \
+        return hashmap_put((hashmap *)map, &key, &value);                                                             \
+    }                                                                                                                 \
+    static inline bool name##_get(const name##_map *map, K key, V *value_out)                                         \
+    {                                                                                                                 \
+        return hashmap_get((const hashmap *)map, &key, value_out);                                                    \
+    }                                                                                                                 \
+    static inline V *name##_get_ptr(const name##_map *map, K key)                                                     \
+    {                                                                                                                 \
+        return (V *)hashmap_get_ptr((const hashmap *)map, &key);                                                      \
+    }                                                                                                                 \
+    static inline V *name##_get_or_insert_slot(name##_map *map, K key, bool *inserted)                                \
+    {                                                                                                                 \
+        return (V *)hashmap_get_or_insert_slot((hashmap *)map, &key, inserted);                                       \
+    }                                                                                                                 \
+    static inline bool name##_delete(name##_map *map, K key)                                                          \
+    {                                                                                                                 \
+        return hashmap_delete((hashmap *)map, &key);                                                                  \
+    }                                                                                                                 \
+    static inline void name##_iter_init(hashmap_iter *iter, const name##_map *map)                                    \
+    {                                                                                                                 \
+        hashmap_iter_init(iter, (const hashmap *)map);                                                                \
+    }                                                                                                                 \
+    static inline bool name##_iter_next(hashmap_iter *iter, const K **key, V **value)                                 \
+    {                                                                                                                 \
+        const void *k;                                                                                                \
+        void *v;                                                                                                      \
+        if (!hashmap_iter_next(iter, &k, &v))                                                                         \
+        {                                                                                                             \
+            return false;                                                                                             \
+        }                                                                                                             \
+        if (key)                                                                                                      \
+        {                                                                                                             \
+            *key = (const K *)k;                                                                                      \
+        }                                                                                                             \
+        if (value)                                                                                                    \
+        {                                                                                                             \
+            *value = (V *)v;                                                                                          \
+        }                                                                                                             \
+        return true;                                                                                                  \
+    }                                                                                                                 \
+    static inline void name##_destroy(name##_map *map)                                                                \
+    {                                                                                                                 \
+        hashmap_destroy((hashmap *)map);                                                                              \
+    }
+
 #endif
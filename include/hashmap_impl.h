@@ -0,0 +1,726 @@
+/**
+ * Header-only typed hashmap, instantiated by macros
+ *
+ * The same design as hashmap (buckets of tophash bytes, keys, values and an
+ * overflow link, chained through overflow buckets) with every type and
+ * constant fixed at compile time: the bucket is a struct, so slot offsets and
+ * strides are constants, keys are compared by a constant-size memcmp or a
+ * user expression, and the hash is inlined. With a small fixed bucket size the
+ * compiler unrolls (and may vectorize) the tophash scan of every probe.
+ *
+ * Define the parameters, then include this header; it may be included once
+ * per instantiation, and undefines the parameters at the end:
+ *
+ *   #define ADS_NAME u64_map
+ *   #define ADS_KEY_T uint64_t
+ *   #define ADS_VALUE_T uint64_t
+ *   #include "hashmap_impl.h"
+ *
+ * ADS_NAME             Prefix of the map type and its functions (required)
+ * ADS_KEY_T            Key type (required); without ADS_EQUAL keys are
+ *                      compared bytewise, so zero the padding of struct keys
+ * ADS_VALUE_T          Value type (required)
+ * ADS_HASH(key)        Unseeded hash of a const ADS_KEY_T *key as a uint64_t;
+ *                      folded with the map's random seed like a hash_fn. The
+ *                      default mixes 4- and 8-byte keys inline and calls
+ *                      hashmap_hash_bytes for other sizes
+ * ADS_EQUAL(a, b)      Nonzero if two const ADS_KEY_T * keys are equal
+ * ADS_BUCKET_SIZE      Slots per bucket, a power of 2 up to 64 (default 8)
+ * ADS_INITIAL_BUCKETS  Buckets of a new map, a power of 2 (default 8)
+ * ADS_LOAD_NUMERATOR, ADS_LOAD_DENOMINATOR
+ *                      The map doubles once it holds more than
+ *                      NUMERATOR / DENOMINATOR entries per bucket on average
+ *                      (default 13/16 of ADS_BUCKET_SIZE, 6.5 for 8 slots)
+ *
+ * The instantiation declares, as static inline functions:
+ *
+ *   ADS_NAME *NAME_create(size_t capacity)
+ *   void      NAME_destroy(ADS_NAME *map)
+ *   bool      NAME_reserve(ADS_NAME *map, size_t capacity)
+ *   bool      NAME_put(ADS_NAME *map, ADS_KEY_T key, ADS_VALUE_T value)
+ *   bool      NAME_get(const ADS_NAME *map, ADS_KEY_T key, ADS_VALUE_T *value_out)
+ *   ADS_VALUE_T *NAME_get_ptr(const ADS_NAME *map, ADS_KEY_T key)
+ *   bool      NAME_delete(ADS_NAME *map, ADS_KEY_T key)
+ *   size_t    NAME_size(const ADS_NAME *map)
+ *   void      NAME_iter_init(NAME_iter *iter, const ADS_NAME *map)
+ *   bool      NAME_iter_next(NAME_iter *iter, const ADS_KEY_T **key_out, ADS_VALUE_T **value_out)
+ *
+ * with the semantics of the hashmap functions of the same names. Unlike
+ * hashmap, growth rehashes the whole table in one step, and memory comes from
+ * malloc/calloc/free. Link the library: new maps are seeded by
+ * hashmap_random_seed.
+ */
+
+#include "hashmap.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef HASHMAP_IMPL_COMMON
+#define HASHMAP_IMPL_COMMON
+
+// Name of a member of the instantiation: ADS_IMPL_FN(put) is <ADS_NAME>_put
+#define ADS_IMPL_JOIN_(a, b) a##_##b
+#define ADS_IMPL_JOIN(a, b) ADS_IMPL_JOIN_(a, b)
+#define ADS_IMPL_FN(suffix) ADS_IMPL_JOIN(ADS_NAME, suffix)
+
+// Tophash states, as in hashmap (no EVACUATED: growth is not incremental)
+#define ADS_IMPL_EMPTY_REST 0 // Empty, and so is every later slot in this bucket and its overflow chain
+#define ADS_IMPL_EMPTY_ONE 1  // Empty
+#define ADS_IMPL_MIN_TOP_HASH 2
+
+// Overflow buckets are carved from slabs that double up to this many buckets
+#define ADS_IMPL_SLAB_MAX_BUCKETS 1024
+
+/**
+ * Fold two words through a 64x64 -> 128 bit multiply (the mixer of
+ * hashmap_hash_u64, inlined).
+ *
+ * @param a First word
+ * @param b Second word
+ * @return Low half XOR high half of the product of the salted words
+ */
+static inline uint64_t ads_impl_mix(uint64_t a, uint64_t b)
+{
+    a ^= 0xa0761d6478bd642full;
+    b ^= 0xe7037ed1a0b428dbull;
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + carry);
+#endif
+}
+
+/**
+ * Tophash byte of a hash: its top 8 bits, moved clear of the empty states.
+ *
+ * @param hash The full 64-bit hash value
+ * @return Tophash value (>= ADS_IMPL_MIN_TOP_HASH)
+ */
+static inline uint8_t ads_impl_top_hash(uint64_t hash)
+{
+    uint8_t top = (uint8_t)(hash >> 56);
+    return top < ADS_IMPL_MIN_TOP_HASH ? (uint8_t)(top + ADS_IMPL_MIN_TOP_HASH) : top;
+}
+#endif
+
+#if !defined(ADS_NAME) || !defined(ADS_KEY_T) || !defined(ADS_VALUE_T)
+#error "define ADS_NAME, ADS_KEY_T and ADS_VALUE_T before including hashmap_impl.h"
+#endif
+
+#ifndef ADS_BUCKET_SIZE
+#define ADS_BUCKET_SIZE 8
+#endif
+#ifndef ADS_INITIAL_BUCKETS
+#define ADS_INITIAL_BUCKETS 8
+#endif
+#if defined(ADS_LOAD_NUMERATOR) != defined(ADS_LOAD_DENOMINATOR)
+#error "define both ADS_LOAD_NUMERATOR and ADS_LOAD_DENOMINATOR, or neither"
+#endif
+#ifndef ADS_LOAD_NUMERATOR
+#define ADS_LOAD_NUMERATOR (ADS_BUCKET_SIZE * 13)
+#define ADS_LOAD_DENOMINATOR 16
+#endif
+
+_Static_assert(ADS_BUCKET_SIZE >= 1 && ADS_BUCKET_SIZE <= 64 && (ADS_BUCKET_SIZE & (ADS_BUCKET_SIZE - 1)) == 0,
+               "ADS_BUCKET_SIZE must be a power of 2 up to 64");
+_Static_assert(ADS_INITIAL_BUCKETS >= 1 && (ADS_INITIAL_BUCKETS & (ADS_INITIAL_BUCKETS - 1)) == 0,
+               "ADS_INITIAL_BUCKETS must be a power of 2");
+_Static_assert(ADS_LOAD_NUMERATOR > 0 && ADS_LOAD_NUMERATOR <= ADS_BUCKET_SIZE * ADS_LOAD_DENOMINATOR,
+               "load factor must be positive and at most one entry per slot");
+
+/**
+ * One bucket: tophash bytes, keys, values, then the overflow link
+ */
+typedef struct ADS_IMPL_FN(bucket)
+{
+    uint8_t tophash[ADS_BUCKET_SIZE];
+    ADS_KEY_T keys[ADS_BUCKET_SIZE];
+    ADS_VALUE_T values[ADS_BUCKET_SIZE];
+    struct ADS_IMPL_FN(bucket) *overflow;
+} ADS_IMPL_FN(bucket);
+
+/**
+ * Slab of overflow buckets, freed as a whole with its table
+ */
+typedef struct ADS_IMPL_FN(slab)
+{
+    struct ADS_IMPL_FN(slab) *next;
+    size_t used;
+    size_t capacity;
+    ADS_IMPL_FN(bucket) buckets[];
+} ADS_IMPL_FN(slab);
+
+/**
+ * The map; the fields are internal
+ */
+typedef struct ADS_NAME
+{
+    ADS_IMPL_FN(bucket) *buckets;
+    size_t bucket_count;
+    size_t count;
+    uint64_t seed;
+    ADS_IMPL_FN(slab) *slabs; // Overflow buckets of the current table, newest slab first
+} ADS_NAME;
+
+/**
+ * Iterator over the entries of a map; the fields are internal
+ * Any mutation of the map invalidates the iterator; values may be modified in place.
+ */
+typedef struct ADS_IMPL_FN(iter)
+{
+    const ADS_NAME *map;
+    ADS_IMPL_FN(bucket) *bucket;
+    size_t index;
+    int slot;
+} ADS_IMPL_FN(iter);
+
+/**
+ * Seeded hash of a key.
+ *
+ * @param map The map
+ * @param key Pointer to the key
+ * @return 64-bit hash
+ */
+static inline uint64_t ADS_IMPL_FN(hash)(const ADS_NAME *map, const ADS_KEY_T *key)
+{
+#if defined(ADS_HASH)
+    return ads_impl_mix((uint64_t)(ADS_HASH(key)), map->seed);
+#else
+    if (sizeof(ADS_KEY_T) == sizeof(uint64_t))
+    {
+        uint64_t k;
+        memcpy(&k, key, sizeof(k));
+        return ads_impl_mix(k, map->seed);
+    }
+    if (sizeof(ADS_KEY_T) == sizeof(uint32_t))
+    {
+        uint32_t k;
+        memcpy(&k, key, sizeof(k));
+        return ads_impl_mix((uint64_t)k << 32 | k, map->seed);
+    }
+    return hashmap_hash_bytes(key, sizeof(ADS_KEY_T), map->seed);
+#endif
+}
+
+/**
+ * Compare two keys.
+ *
+ * @param a First key
+ * @param b Second key
+ * @return true if the keys are equal
+ */
+static inline bool ADS_IMPL_FN(equal)(const ADS_KEY_T *a, const ADS_KEY_T *b)
+{
+#if defined(ADS_EQUAL)
+    return (ADS_EQUAL(a, b)) != 0;
+#else
+    return memcmp(a, b, sizeof(ADS_KEY_T)) == 0;
+#endif
+}
+
+/**
+ * Find the slots of a bucket holding a tophash value.
+ *
+ * @param bucket The bucket
+ * @param top Tophash value to look for
+ * @return Mask with bit i set if slot i matches
+ */
+static inline uint64_t ADS_IMPL_FN(match)(const ADS_IMPL_FN(bucket) *bucket, uint8_t top)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < ADS_BUCKET_SIZE; i++)
+    {
+        mask |= (uint64_t)(bucket->tophash[i] == top) << i;
+    }
+    return mask;
+}
+
+/**
+ * Find the empty slots (EMPTY_ONE or EMPTY_REST) of a bucket.
+ *
+ * @param bucket The bucket
+ * @return Mask with bit i set if slot i is empty
+ */
+static inline uint64_t ADS_IMPL_FN(match_empty)(const ADS_IMPL_FN(bucket) *bucket)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < ADS_BUCKET_SIZE; i++)
+    {
+        mask |= (uint64_t)(bucket->tophash[i] < ADS_IMPL_MIN_TOP_HASH) << i;
+    }
+    return mask;
+}
+
+/**
+ * Check whether probing can stop after a bucket.
+ *
+ * @param bucket The bucket
+ * @return true if nothing later in the bucket or its chain is occupied
+ */
+static inline bool ADS_IMPL_FN(has_empty_rest)(const ADS_IMPL_FN(bucket) *bucket)
+{
+    // EMPTY_REST slots are always a suffix, so checking the last slot is enough
+    return bucket->tophash[ADS_BUCKET_SIZE - 1] == ADS_IMPL_EMPTY_REST;
+}
+
+/**
+ * Take an empty overflow bucket from the map's slabs, adding a slab if needed.
+ *
+ * @param map The map
+ * @return Zero-filled bucket, or NULL on allocation failure
+ */
+static inline ADS_IMPL_FN(bucket) *ADS_IMPL_FN(alloc_overflow)(ADS_NAME *map)
+{
+    ADS_IMPL_FN(slab) *slab = map->slabs;
+    if (!slab || slab->used == slab->capacity)
+    {
+        size_t capacity = slab && slab->capacity < ADS_IMPL_SLAB_MAX_BUCKETS ? slab->capacity * 2
+                          : slab                                           ? slab->capacity
+                                                                           : 8;
+        slab = (ADS_IMPL_FN(slab) *)calloc(1, sizeof(*slab) + capacity * sizeof(ADS_IMPL_FN(bucket)));
+        if (!slab)
+        {
+            return NULL;
+        }
+        slab->capacity = capacity;
+        slab->next = map->slabs;
+        map->slabs = slab;
+    }
+    return &slab->buckets[slab->used++];
+}
+
+/**
+ * Free a chain of overflow slabs.
+ *
+ * @param slab Newest slab of the chain, or NULL
+ */
+static inline void ADS_IMPL_FN(free_slabs)(ADS_IMPL_FN(slab) *slab)
+{
+    while (slab)
+    {
+        ADS_IMPL_FN(slab) *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+}
+
+/**
+ * Store a key known to be absent in the first free slot of its chain,
+ * extending the chain with an overflow bucket if it is full.
+ *
+ * @param map The map
+ * @param hash Seeded hash of the key
+ * @param key Pointer to the key
+ * @return Pointer to the entry's value slot, or NULL on allocation failure
+ */
+static inline ADS_VALUE_T *ADS_IMPL_FN(insert_new)(ADS_NAME *map, uint64_t hash, const ADS_KEY_T *key)
+{
+    ADS_IMPL_FN(bucket) *bucket = &map->buckets[hash & (map->bucket_count - 1)];
+    uint64_t empty = ADS_IMPL_FN(match_empty)(bucket);
+    while (!empty)
+    {
+        if (!bucket->overflow)
+        {
+            bucket->overflow = ADS_IMPL_FN(alloc_overflow)(map);
+            if (!bucket->overflow)
+            {
+                return NULL;
+            }
+        }
+        bucket = bucket->overflow;
+        empty = ADS_IMPL_FN(match_empty)(bucket);
+    }
+    int slot = __builtin_ctzll(empty);
+    bucket->tophash[slot] = ads_impl_top_hash(hash);
+    bucket->keys[slot] = *key;
+    map->count++;
+    return &bucket->values[slot];
+}
+
+/**
+ * Replace the table with one of the given size, copying every entry. The old
+ * table is only read, so it stays intact if an allocation fails.
+ *
+ * @param map The map
+ * @param bucket_count Buckets of the new table (power of 2)
+ * @return true on success, false on allocation failure (the map is unchanged)
+ */
+static inline bool ADS_IMPL_FN(resize)(ADS_NAME *map, size_t bucket_count)
+{
+    ADS_NAME grown = {NULL, bucket_count, 0, map->seed, NULL};
+    // Zero-filled: every tophash is EMPTY_REST and every overflow link NULL
+    grown.buckets = (ADS_IMPL_FN(bucket) *)calloc(bucket_count, sizeof(ADS_IMPL_FN(bucket)));
+    if (!grown.buckets)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < map->bucket_count; i++)
+    {
+        for (ADS_IMPL_FN(bucket) *bucket = &map->buckets[i]; bucket; bucket = bucket->overflow)
+        {
+            for (int slot = 0; slot < ADS_BUCKET_SIZE; slot++)
+            {
+                if (bucket->tophash[slot] < ADS_IMPL_MIN_TOP_HASH)
+                {
+                    continue;
+                }
+                uint64_t hash = ADS_IMPL_FN(hash)(map, &bucket->keys[slot]);
+                ADS_VALUE_T *value = ADS_IMPL_FN(insert_new)(&grown, hash, &bucket->keys[slot]);
+                if (!value)
+                {
+                    free(grown.buckets);
+                    ADS_IMPL_FN(free_slabs)(grown.slabs);
+                    return false;
+                }
+                *value = bucket->values[slot];
+            }
+        }
+    }
+    free(map->buckets);
+    ADS_IMPL_FN(free_slabs)(map->slabs);
+    map->buckets = grown.buckets;
+    map->bucket_count = bucket_count;
+    map->slabs = grown.slabs;
+    return true;
+}
+
+/**
+ * Smallest table size that holds a number of entries without exceeding the
+ * load factor.
+ *
+ * @param capacity Number of entries
+ * @return Buckets needed (power of 2, at least ADS_INITIAL_BUCKETS), or 0 on overflow
+ */
+static inline size_t ADS_IMPL_FN(buckets_for)(size_t capacity)
+{
+    if (capacity > SIZE_MAX / ADS_LOAD_DENOMINATOR)
+    {
+        return 0;
+    }
+    size_t count = ADS_INITIAL_BUCKETS;
+    while (capacity * (size_t)ADS_LOAD_DENOMINATOR > count * (size_t)ADS_LOAD_NUMERATOR)
+    {
+        if (count > SIZE_MAX / 2 / sizeof(ADS_IMPL_FN(bucket)))
+        {
+            return 0;
+        }
+        count *= 2;
+    }
+    return count;
+}
+
+/**
+ * Create an empty map.
+ *
+ * @param capacity Number of entries to hold without growing (0 for the default size)
+ * @return New map or NULL on failure
+ */
+static inline ADS_NAME *ADS_IMPL_FN(create)(size_t capacity)
+{
+    size_t bucket_count = ADS_IMPL_FN(buckets_for)(capacity);
+    if (!bucket_count)
+    {
+        return NULL;
+    }
+    ADS_NAME *map = (ADS_NAME *)malloc(sizeof(ADS_NAME));
+    if (!map)
+    {
+        return NULL;
+    }
+    map->buckets = (ADS_IMPL_FN(bucket) *)calloc(bucket_count, sizeof(ADS_IMPL_FN(bucket)));
+    if (!map->buckets)
+    {
+        free(map);
+        return NULL;
+    }
+    map->bucket_count = bucket_count;
+    map->count = 0;
+    map->seed = hashmap_random_seed(map);
+    map->slabs = NULL;
+    return map;
+}
+
+/**
+ * Destroy the map and free all memory. No-op for NULL.
+ *
+ * @param map Map to destroy
+ */
+static inline void ADS_IMPL_FN(destroy)(ADS_NAME *map)
+{
+    if (map)
+    {
+        free(map->buckets);
+        ADS_IMPL_FN(free_slabs)(map->slabs);
+        free(map);
+    }
+}
+
+/**
+ * Make room for at least capacity entries without further growth.
+ *
+ * @param map The map
+ * @param capacity Number of entries to hold without growing
+ * @return true on success, false on failure
+ */
+static inline bool ADS_IMPL_FN(reserve)(ADS_NAME *map, size_t capacity)
+{
+    size_t bucket_count = ADS_IMPL_FN(buckets_for)(capacity);
+    if (!bucket_count)
+    {
+        return false;
+    }
+    return bucket_count <= map->bucket_count || ADS_IMPL_FN(resize)(map, bucket_count);
+}
+
+/**
+ * Get a pointer to the stored value for a key, without copying.
+ * The pointer is valid until the next put, delete or reserve.
+ *
+ * @param map The map
+ * @param key The key
+ * @return Pointer to the stored value, or NULL if not found
+ */
+static inline ADS_VALUE_T *ADS_IMPL_FN(get_ptr)(const ADS_NAME *map, ADS_KEY_T key)
+{
+    uint64_t hash = ADS_IMPL_FN(hash)(map, &key);
+    uint8_t top = ads_impl_top_hash(hash);
+    for (ADS_IMPL_FN(bucket) *bucket = &map->buckets[hash & (map->bucket_count - 1)]; bucket;
+         bucket = bucket->overflow)
+    {
+        for (uint64_t match = ADS_IMPL_FN(match)(bucket, top); match; match &= match - 1)
+        {
+            int slot = __builtin_ctzll(match);
+            if (ADS_IMPL_FN(equal)(&bucket->keys[slot], &key))
+            {
+                return &bucket->values[slot];
+            }
+        }
+        if (ADS_IMPL_FN(has_empty_rest)(bucket))
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Retrieve a value by key.
+ *
+ * @param map The map
+ * @param key The key
+ * @param value_out Pointer to store the retrieved value (if found), or NULL
+ * @return true if the key was found, false otherwise
+ */
+static inline bool ADS_IMPL_FN(get)(const ADS_NAME *map, ADS_KEY_T key, ADS_VALUE_T *value_out)
+{
+    ADS_VALUE_T *value = ADS_IMPL_FN(get_ptr)(map, key);
+    if (value && value_out)
+    {
+        *value_out = *value;
+    }
+    return value != NULL;
+}
+
+/**
+ * Insert or update a key-value pair.
+ * Doubles the table first when a new entry would exceed the load factor; if
+ * that fails for lack of memory the entry still goes into the current table.
+ *
+ * @param map The map
+ * @param key The key
+ * @param value The value
+ * @return true on success, false on allocation failure
+ */
+static inline bool ADS_IMPL_FN(put)(ADS_NAME *map, ADS_KEY_T key, ADS_VALUE_T value)
+{
+    ADS_VALUE_T *existing = ADS_IMPL_FN(get_ptr)(map, key);
+    if (existing)
+    {
+        *existing = value;
+        return true;
+    }
+    if ((map->count + 1) * (size_t)ADS_LOAD_DENOMINATOR > map->bucket_count * (size_t)ADS_LOAD_NUMERATOR)
+    {
+        ADS_IMPL_FN(resize)(map, map->bucket_count * 2);
+    }
+    ADS_VALUE_T *slot = ADS_IMPL_FN(insert_new)(map, ADS_IMPL_FN(hash)(map, &key), &key);
+    if (!slot)
+    {
+        return false;
+    }
+    *slot = value;
+    return true;
+}
+
+/**
+ * Remove a key-value pair, keeping the EMPTY_REST invariant: if nothing
+ * occupied follows the freed slot, it and the run of EMPTY_ONE slots before it
+ * become EMPTY_REST. Overflow buckets are kept until the next resize.
+ *
+ * @param map The map
+ * @param key The key
+ * @return true if the key was found and removed, false otherwise
+ */
+static inline bool ADS_IMPL_FN(delete)(ADS_NAME *map, ADS_KEY_T key)
+{
+    uint64_t hash = ADS_IMPL_FN(hash)(map, &key);
+    uint8_t top = ads_impl_top_hash(hash);
+    ADS_IMPL_FN(bucket) *head = &map->buckets[hash & (map->bucket_count - 1)];
+    ADS_IMPL_FN(bucket) *bucket = head;
+    int slot = -1;
+    while (bucket && slot == -1)
+    {
+        for (uint64_t match = ADS_IMPL_FN(match)(bucket, top); match; match &= match - 1)
+        {
+            int i = __builtin_ctzll(match);
+            if (ADS_IMPL_FN(equal)(&bucket->keys[i], &key))
+            {
+                slot = i;
+                break;
+            }
+        }
+        if (slot == -1)
+        {
+            if (ADS_IMPL_FN(has_empty_rest)(bucket))
+            {
+                return false;
+            }
+            bucket = bucket->overflow;
+        }
+    }
+    if (slot == -1)
+    {
+        return false;
+    }
+    map->count--;
+    bucket->tophash[slot] = ADS_IMPL_EMPTY_ONE;
+
+    // Is anything occupied after this slot?
+    if (slot == ADS_BUCKET_SIZE - 1)
+    {
+        if (bucket->overflow && bucket->overflow->tophash[0] != ADS_IMPL_EMPTY_REST)
+        {
+            return true;
+        }
+    }
+    else if (bucket->tophash[slot + 1] != ADS_IMPL_EMPTY_REST)
+    {
+        return true;
+    }
+
+    // Convert the trailing run of EMPTY_ONE slots to EMPTY_REST
+    for (;;)
+    {
+        bucket->tophash[slot] = ADS_IMPL_EMPTY_REST;
+        if (slot == 0)
+        {
+            if (bucket == head)
+            {
+                break;
+            }
+            // Find the previous bucket in the chain
+            ADS_IMPL_FN(bucket) *previous = head;
+            while (previous->overflow != bucket)
+            {
+                previous = previous->overflow;
+            }
+            bucket = previous;
+            slot = ADS_BUCKET_SIZE - 1;
+        }
+        else
+        {
+            slot--;
+        }
+        if (bucket->tophash[slot] != ADS_IMPL_EMPTY_ONE)
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * Number of entries.
+ *
+ * @param map The map
+ * @return Number of entries
+ */
+static inline size_t ADS_IMPL_FN(size)(const ADS_NAME *map)
+{
+    return map->count;
+}
+
+/**
+ * Start iterating over a map.
+ *
+ * @param iter Iterator to initialize
+ * @param map The map
+ */
+static inline void ADS_IMPL_FN(iter_init)(ADS_IMPL_FN(iter) *iter, const ADS_NAME *map)
+{
+    iter->map = map;
+    iter->bucket = NULL;
+    iter->index = 0;
+    iter->slot = ADS_BUCKET_SIZE;
+}
+
+/**
+ * Advance to the next entry.
+ *
+ * @param iter Iterator from iter_init
+ * @param key_out Optional; set to the stored key
+ * @param value_out Optional; set to the stored value (writable)
+ * @return true if an entry was produced, false when the iteration is done
+ */
+static inline bool ADS_IMPL_FN(iter_next)(ADS_IMPL_FN(iter) *iter, const ADS_KEY_T **key_out,
+                                          ADS_VALUE_T **value_out)
+{
+    for (;;)
+    {
+        if (iter->slot == ADS_BUCKET_SIZE)
+        {
+            iter->bucket = iter->bucket ? iter->bucket->overflow : NULL;
+            if (!iter->bucket)
+            {
+                if (iter->index == iter->map->bucket_count)
+                {
+                    return false;
+                }
+                iter->bucket = &iter->map->buckets[iter->index++];
+            }
+            iter->slot = 0;
+        }
+        int slot = iter->slot++;
+        if (iter->bucket->tophash[slot] >= ADS_IMPL_MIN_TOP_HASH)
+        {
+            if (key_out)
+            {
+                *key_out = &iter->bucket->keys[slot];
+            }
+            if (value_out)
+            {
+                *value_out = &iter->bucket->values[slot];
+            }
+            return true;
+        }
+    }
+}
+
+#undef ADS_NAME
+#undef ADS_KEY_T
+#undef ADS_VALUE_T
+#undef ADS_HASH
+#undef ADS_EQUAL
+#undef ADS_BUCKET_SIZE
+#undef ADS_INITIAL_BUCKETS
+#undef ADS_LOAD_NUMERATOR
+#undef ADS_LOAD_DENOMINATOR
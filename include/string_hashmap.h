@@ -0,0 +1,85 @@
+#ifndef STRING_HASHMAP_H
+#define STRING_HASHMAP_H
+
+#include "hashmap.h"
+
+/**
+ * Hashmap keyed by variable-length byte strings
+ *
+ * Keys are copied into the map: keys of up to 15 bytes are stored inline in
+ * the bucket, longer ones in an arena owned by the map. The full 64-bit hash is
+ * stored next to every key, so key bytes are only compared when the hashes
+ * match and resizing never rehashes. A hash flood (see HASHMAP_NO_RESEED)
+ * rebuilds the map at once with a new seed, rehashing every key's bytes.
+ * Values follow the hashmap rules.
+ */
+typedef struct string_hashmap string_hashmap;
+
+/**
+ * Create a new string hashmap
+ *
+ * @param value_size Size of values in bytes
+ * @return New map or NULL on failure
+ */
+string_hashmap *string_hashmap_create(size_t value_size);
+
+/**
+ * Create a new string hashmap with explicit options
+ *
+ * options->seeded_hash is ignored: keys are always hashed with
+ * hashmap_hash_bytes. The allocator is also used for the key arena.
+ *
+ * @param value_size Size of values in bytes
+ * @param options Creation options, or NULL for defaults
+ * @return New map or NULL on failure
+ */
+string_hashmap *string_hashmap_create_ex(size_t value_size, const hashmap_options *options);
+
+/**
+ * Insert or update a key-value pair
+ *
+ * @param map The string hashmap
+ * @param key Pointer to the key bytes (may be NULL if key_len is 0)
+ * @param key_len Key length in bytes (less than 4 GiB)
+ * @param value Pointer to value data
+ * @return true on success, false on failure
+ */
+bool string_hashmap_put(string_hashmap *map, const void *key, size_t key_len, const void *value);
+
+/**
+ * Retrieve a value by key
+ *
+ * @param map The string hashmap
+ * @param key Pointer to the key bytes (may be NULL if key_len is 0)
+ * @param key_len Key length in bytes
+ * @param value_out Pointer to store retrieved value (if found)
+ * @return true if key found, false otherwise
+ */
+bool string_hashmap_get(const string_hashmap *map, const void *key, size_t key_len, void *value_out);
+
+/**
+ * Remove a key-value pair
+ *
+ * @param map The string hashmap
+ * @param key Pointer to the key bytes (may be NULL if key_len is 0)
+ * @param key_len Key length in bytes
+ * @return true if the key was found and removed, false otherwise
+ */
+bool string_hashmap_delete(string_hashmap *map, const void *key, size_t key_len);
+
+/**
+ * Number of entries
+ *
+ * @param map The string hashmap
+ * @return Number of entries
+ */
+size_t string_hashmap_size(const string_hashmap *map);
+
+/**
+ * Destroy the map and free all memory, including the key arena
+ *
+ * @param map Map to destroy
+ */
+void string_hashmap_destroy(string_hashmap *map);
+
+#endif
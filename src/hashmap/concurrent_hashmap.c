@@ -0,0 +1,582 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "concurrent_hashmap.h"
+#include "hashmap_internal.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Shard count used when the caller passes 0
+#define DEFAULT_SHARD_COUNT 64
+
+// Shards are picked from hash bits 48-55: the bucket index uses the low bits
+// and the tophash the top byte, so this caps the shard count at 256
+#define SHARD_SHIFT 48
+#define MAX_SHARD_COUNT 256
+
+// Assumed cache line size for padding shards apart
+#define CACHE_LINE_SIZE 64
+
+// Number of reader counters for lock-free reads; threads are spread over them
+// round-robin, so up to this many reader threads never share a counter line
+#define READER_STRIPES 64
+
+/**
+ * One shard: a hashmap, the lock serializing its writers and a sequence count
+ * that is odd while a write is in progress, padded to a full cache line so that
+ * threads working on neighbouring shards do not false-share.
+ */
+struct shard
+{
+    _Alignas(CACHE_LINE_SIZE) pthread_rwlock_t lock;
+    atomic_uint seq;
+    hashmap *map;
+};
+
+/**
+ * Lock-free readers currently inside each of the two epoch parities, for the
+ * threads assigned to this stripe.
+ */
+struct reader_stripe
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t active[2];
+};
+
+struct concurrent_hashmap
+{
+    struct shard *shards;
+    size_t shard_mask;
+    uint64_t shard_seed; // Hashes keys to pick their shard; every shard starts out with it
+    hashmap_allocator allocator;
+    size_t alloc_size;
+    // Lock-free read mode only: epoch parity readers register under, the lock
+    // serializing grace periods, and the per-thread-stripe reader counters
+    bool lock_free_reads;
+    atomic_uint epoch;
+    pthread_mutex_t sync_lock;
+    struct reader_stripe *stripes;
+};
+
+// Source of reader stripe assignments for new threads
+static atomic_uint next_reader_stripe;
+
+// This thread's reader stripe plus one (0 until the first lock-free read)
+static _Thread_local unsigned reader_stripe_slot;
+
+/**
+ * Wait until no lock-free reader can still hold a pointer obtained before the
+ * call: flip the epoch, then wait for the readers registered under the old
+ * parity to leave. New readers register under the new parity and can only see
+ * the map as it is now.
+ *
+ * @param map The concurrent hashmap
+ */
+static void synchronize_readers(concurrent_hashmap *map)
+{
+    pthread_mutex_lock(&map->sync_lock);
+    unsigned parity = atomic_fetch_add(&map->epoch, 1) & 1;
+    for (size_t i = 0; i < READER_STRIPES; i++)
+    {
+        while (atomic_load(&map->stripes[i].active[parity]) != 0)
+        {
+            sched_yield();
+        }
+    }
+    pthread_mutex_unlock(&map->sync_lock);
+}
+
+/**
+ * Allocation callback handed to the shards: forwards to the map's allocator.
+ *
+ * @param ctx The concurrent hashmap
+ * @param size Number of bytes
+ * @return Allocated memory, or NULL
+ */
+static void *shard_alloc(void *ctx, size_t size)
+{
+    concurrent_hashmap *map = ctx;
+    return map->allocator.alloc(map->allocator.ctx, size);
+}
+
+/**
+ * Zero-filled allocation callback handed to the shards when the map's
+ * allocator has one: forwards to it.
+ *
+ * @param ctx The concurrent hashmap
+ * @param size Number of bytes
+ * @return Zero-filled memory, or NULL
+ */
+static void *shard_zalloc(void *ctx, size_t size)
+{
+    concurrent_hashmap *map = ctx;
+    return map->allocator.zalloc(map->allocator.ctx, size);
+}
+
+/**
+ * Release callback handed to the shards. With lock-free reads a bucket array
+ * freed by growth may still be under an optimistic reader, so the memory is
+ * only released once a grace period has passed (synchronize_readers()).
+ * Frees happen rarely (when growth completes), so the writer waits inline.
+ *
+ * @param ctx The concurrent hashmap
+ * @param ptr Memory from shard_alloc()
+ * @param size Size originally requested
+ */
+static void shard_free(void *ctx, void *ptr, size_t size)
+{
+    concurrent_hashmap *map = ctx;
+    if (map->lock_free_reads)
+    {
+        synchronize_readers(map);
+    }
+    map->allocator.free(map->allocator.ctx, ptr, size);
+}
+
+/**
+ * Unmap callback for shards with lock-free reads: bucket arrays mapped for
+ * HASHMAP_HUGE_PAGES or NUMA placement are unmapped without shard_free(), so
+ * they get the same grace period here.
+ *
+ * @param ctx The concurrent hashmap
+ */
+static void shard_unmap_wait(void *ctx)
+{
+    synchronize_readers(ctx);
+}
+
+/**
+ * Return this thread's reader stripe, assigning one on first use.
+ *
+ * @param map The concurrent hashmap
+ * @return The stripe whose counters this thread updates
+ */
+static inline struct reader_stripe *my_reader_stripe(const concurrent_hashmap *map)
+{
+    if (!reader_stripe_slot)
+    {
+        reader_stripe_slot = atomic_fetch_add_explicit(&next_reader_stripe, 1, memory_order_relaxed) + 1;
+    }
+    return &map->stripes[(reader_stripe_slot - 1) % READER_STRIPES];
+}
+
+/**
+ * Register a lock-free reader under the current epoch parity. The epoch is
+ * re-read after the increment so a reader that raced with a flip moves to the
+ * new parity instead of slipping past synchronize_readers().
+ *
+ * @param map The concurrent hashmap
+ * @param stripe This thread's reader stripe
+ * @return Parity to pass to read_leave()
+ */
+static inline unsigned read_enter(concurrent_hashmap *map, struct reader_stripe *stripe)
+{
+    for (;;)
+    {
+        unsigned epoch = atomic_load(&map->epoch);
+        atomic_fetch_add(&stripe->active[epoch & 1], 1);
+        if (atomic_load(&map->epoch) == epoch)
+        {
+            return epoch & 1;
+        }
+        atomic_fetch_sub(&stripe->active[epoch & 1], 1);
+    }
+}
+
+/**
+ * Unregister a lock-free reader.
+ *
+ * @param stripe This thread's reader stripe
+ * @param parity Value returned by read_enter()
+ */
+static inline void read_leave(struct reader_stripe *stripe, unsigned parity)
+{
+    atomic_fetch_sub_explicit(&stripe->active[parity], 1, memory_order_release);
+}
+
+/**
+ * Take a shard's write lock and make its sequence count odd so that lock-free
+ * readers overlapping the write discard what they read.
+ *
+ * @param shard The shard to modify
+ */
+static inline void write_begin(struct shard *shard)
+{
+    pthread_rwlock_wrlock(&shard->lock);
+    unsigned seq = atomic_load_explicit(&shard->seq, memory_order_relaxed);
+    atomic_store_explicit(&shard->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * Publish a shard's writes (sequence count even again) and drop the write lock.
+ *
+ * @param shard The modified shard
+ */
+static inline void write_end(struct shard *shard)
+{
+    unsigned seq = atomic_load_explicit(&shard->seq, memory_order_relaxed);
+    atomic_store_explicit(&shard->seq, seq + 1, memory_order_release);
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+/**
+ * Round a requested shard count up to a power of two within [1, MAX_SHARD_COUNT].
+ *
+ * @param shard_count Requested count, 0 for the default
+ * @return Shard count to use
+ */
+static size_t round_shard_count(size_t shard_count)
+{
+    if (shard_count == 0)
+    {
+        return DEFAULT_SHARD_COUNT;
+    }
+    if (shard_count >= MAX_SHARD_COUNT)
+    {
+        return MAX_SHARD_COUNT;
+    }
+    size_t count = 1;
+    while (count < shard_count)
+    {
+        count <<= 1;
+    }
+    return count;
+}
+
+/**
+ * Pick the shard responsible for a hash.
+ *
+ * @param map The concurrent hashmap
+ * @param hash Key hash under map->shard_seed
+ * @return The shard
+ */
+static inline struct shard *shard_for(const concurrent_hashmap *map, uint64_t hash)
+{
+    return &map->shards[(hash >> SHARD_SHIFT) & map->shard_mask];
+}
+
+/**
+ * Hash of a key inside its shard: the hash that picked the shard while the
+ * shard still uses the shard seed, else the key hashed again with the seed
+ * the shard moved to when it reseeded. The shard must be locked.
+ *
+ * @param map The concurrent hashmap
+ * @param shard The key's shard
+ * @param key Pointer to the key
+ * @param hash Key hash under map->shard_seed
+ * @return Hash for the shard's hashmap_*_hashed calls
+ */
+static inline uint64_t shard_hash(const concurrent_hashmap *map, const struct shard *shard, const void *key,
+                                  uint64_t hash)
+{
+    return hashmap_seed(shard->map) == map->shard_seed ? hash : hashmap_key_hash(shard->map, key);
+}
+
+/**
+ * Create a new concurrent hashmap with default options.
+ *
+ * @param key_size Size of keys in bytes (must be > 0)
+ * @param value_size Size of values in bytes (must be > 0)
+ * @param hash Hash function pointer, or NULL for a bundled hash picked by key_size
+ * @param equals Equality comparison function pointer, or NULL to compare keys bytewise
+ * @param shard_count Number of shards, 0 for the default
+ * @return Pointer to the new map, or NULL on failure
+ */
+concurrent_hashmap *concurrent_hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                                              size_t shard_count)
+{
+    return concurrent_hashmap_create_ex(key_size, value_size, hash, equals, NULL, shard_count);
+}
+
+/**
+ * Create a new concurrent hashmap.
+ * The map header, the shard array and (for lock-free reads) the reader stripes
+ * share one allocation, with shards and stripes aligned to a cache line. The
+ * shards allocate through shard_alloc()/shard_free() so that frees can wait for
+ * a grace period. The first shard's initial seed becomes the shard seed, which
+ * picks a key's shard for the map's lifetime, and every other shard is given
+ * it too, so a key is hashed only once per operation. A flooded shard still
+ * reseeds on its own; its keys are then hashed a second time (shard_hash()).
+ *
+ * @param key_size Size of keys in bytes (must be > 0)
+ * @param value_size Size of values in bytes (must be > 0)
+ * @param hash Hash function pointer, or NULL for a bundled hash picked by key_size
+ * @param equals Equality comparison function pointer, or NULL to compare keys bytewise
+ * @param options Options applied to every shard, or NULL; capacity is the total
+ * @param shard_count Number of shards, 0 for the default
+ * @return Pointer to the new map, or NULL on failure
+ */
+concurrent_hashmap *concurrent_hashmap_create_ex(size_t key_size, size_t value_size, hash_fn hash,
+                                                 equals_fn equals, const hashmap_options *options,
+                                                 size_t shard_count)
+{
+    hashmap_options shard_options = {0};
+    if (options)
+    {
+        shard_options = *options;
+    }
+    hashmap_allocator allocator = hashmap_default_allocator;
+    if (shard_options.allocator)
+    {
+        allocator = *shard_options.allocator;
+    }
+    bool lock_free_reads = (shard_options.flags & CONCURRENT_HASHMAP_LOCK_FREE_READS) != 0;
+    shard_options.flags &= ~CONCURRENT_HASHMAP_LOCK_FREE_READS;
+
+    shard_count = round_shard_count(shard_count);
+    shard_options.capacity = (shard_options.capacity + shard_count - 1) / shard_count;
+
+    size_t stripes_size = lock_free_reads ? READER_STRIPES * sizeof(struct reader_stripe) : 0;
+    size_t alloc_size =
+        sizeof(concurrent_hashmap) + CACHE_LINE_SIZE + shard_count * sizeof(struct shard) + stripes_size;
+    char *mem = allocator.alloc(allocator.ctx, alloc_size);
+    if (!mem)
+    {
+        return NULL;
+    }
+    concurrent_hashmap *map = (concurrent_hashmap *)mem;
+    uintptr_t shards = (uintptr_t)(mem + sizeof(concurrent_hashmap));
+    shards = (shards + CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+    map->shards = (struct shard *)shards;
+    map->shard_mask = shard_count - 1;
+    map->allocator = allocator;
+    map->alloc_size = alloc_size;
+    map->lock_free_reads = lock_free_reads;
+    atomic_init(&map->epoch, 0);
+    map->stripes = NULL;
+    if (lock_free_reads)
+    {
+        if (pthread_mutex_init(&map->sync_lock, NULL) != 0)
+        {
+            allocator.free(allocator.ctx, mem, alloc_size);
+            return NULL;
+        }
+        map->stripes = (struct reader_stripe *)(map->shards + shard_count);
+        for (size_t i = 0; i < READER_STRIPES; i++)
+        {
+            atomic_init(&map->stripes[i].active[0], 0);
+            atomic_init(&map->stripes[i].active[1], 0);
+        }
+    }
+
+    // Copied into every shard; ctx routes frees through the grace period
+    hashmap_allocator shard_allocator = {shard_alloc, shard_free, map, allocator.zalloc ? shard_zalloc : NULL};
+    shard_options.allocator = &shard_allocator;
+
+    for (size_t i = 0; i < shard_count; i++)
+    {
+        struct shard *shard = &map->shards[i];
+        atomic_init(&shard->seq, 0);
+        shard->map = hashmap_create_ex(key_size, value_size, hash, equals, &shard_options);
+        if (shard->map && pthread_rwlock_init(&shard->lock, NULL) != 0)
+        {
+            hashmap_destroy(shard->map);
+            shard->map = NULL;
+        }
+        if (!shard->map)
+        {
+            // Unwind the shards created so far
+            for (size_t j = 0; j < i; j++)
+            {
+                pthread_rwlock_destroy(&map->shards[j].lock);
+                hashmap_destroy(map->shards[j].map);
+            }
+            if (lock_free_reads)
+            {
+                pthread_mutex_destroy(&map->sync_lock);
+            }
+            allocator.free(allocator.ctx, mem, alloc_size);
+            return NULL;
+        }
+        if (lock_free_reads)
+        {
+            hashmap_set_unmap_wait(shard->map, shard_unmap_wait, map);
+            // Workers moving entries behind the seqlock would go unnoticed
+            hashmap_set_foreground_evacuation(shard->map);
+        }
+        if (i == 0)
+        {
+            map->shard_seed = hashmap_seed(shard->map);
+        }
+        else
+        {
+            hashmap_set_seed(shard->map, map->shard_seed);
+        }
+    }
+    return map;
+}
+
+/**
+ * Insert or update a key-value pair under the shard's write lock.
+ *
+ * @param map Pointer to the concurrent hashmap
+ * @param key Pointer to the key
+ * @param value Pointer to the value
+ * @return true on success, false on NULL parameters or allocation failure
+ */
+bool concurrent_hashmap_put(concurrent_hashmap *map, const void *key, const void *value)
+{
+    if (!map || !key || !value)
+    {
+        return false;
+    }
+
+    uint64_t hash = hashmap_key_hash_seeded(map->shards[0].map, key, map->shard_seed);
+    struct shard *shard = shard_for(map, hash);
+    write_begin(shard);
+    bool stored = hashmap_put_hashed(shard->map, key, value, shard_hash(map, shard, key, hash));
+    write_end(shard);
+    return stored;
+}
+
+/**
+ * Look a key up without taking any lock (seqlock read).
+ * Snapshots the shard's bucket arrays, checks that no write overlapped the
+ * snapshot, performs the lookup and checks again, retrying on any overlap.
+ * Registration with the reader epoch keeps the snapshot's arrays allocated
+ * for the duration of an attempt.
+ *
+ * @param map Pointer to the concurrent hashmap
+ * @param shard Shard responsible for the key
+ * @param key Pointer to the key to search for
+ * @param hash Key hash under map->shard_seed
+ * @param value_out Pointer to memory where the value will be copied if found
+ * @return true if key was found and value copied, false otherwise
+ */
+static bool optimistic_get(concurrent_hashmap *map, struct shard *shard, const void *key, uint64_t hash,
+                           void *value_out)
+{
+    struct reader_stripe *stripe = my_reader_stripe(map);
+    for (;;)
+    {
+        unsigned parity = read_enter(map, stripe);
+        unsigned seq = atomic_load_explicit(&shard->seq, memory_order_acquire);
+        bool found = false;
+        bool valid = false;
+        if (!(seq & 1))
+        {
+            hashmap_view view;
+            hashmap_load_view(shard->map, &view);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&shard->seq, memory_order_relaxed) == seq)
+            {
+                found = hashmap_view_get(shard->map, &view, key, hash, map->shard_seed, value_out);
+                atomic_thread_fence(memory_order_acquire);
+                valid = atomic_load_explicit(&shard->seq, memory_order_relaxed) == seq;
+            }
+        }
+        read_leave(stripe, parity);
+        if (valid)
+        {
+            return found;
+        }
+        if (seq & 1)
+        {
+            // A writer holds the shard; let it finish
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * Retrieve the value for a key.
+ * With CONCURRENT_HASHMAP_LOCK_FREE_READS this takes no lock (optimistic_get());
+ * otherwise it runs under the shard's read lock, so readers of one shard still
+ * run in parallel with each other.
+ *
+ * @param map Pointer to the concurrent hashmap
+ * @param key Pointer to the key to search for
+ * @param value_out Pointer to memory where the value will be copied if found
+ * @return true if key was found and value copied, false otherwise
+ */
+bool concurrent_hashmap_get(const concurrent_hashmap *map, const void *key, void *value_out)
+{
+    if (!map || !key || !value_out)
+    {
+        return false;
+    }
+
+    uint64_t hash = hashmap_key_hash_seeded(map->shards[0].map, key, map->shard_seed);
+    struct shard *shard = shard_for(map, hash);
+    if (map->lock_free_reads)
+    {
+        // Only the epoch counters are written; the map itself stays untouched
+        return optimistic_get((concurrent_hashmap *)map, shard, key, hash, value_out);
+    }
+    pthread_rwlock_rdlock(&shard->lock);
+    bool found = hashmap_get_hashed(shard->map, key, shard_hash(map, shard, key, hash), value_out);
+    pthread_rwlock_unlock(&shard->lock);
+    return found;
+}
+
+/**
+ * Remove a key under the shard's write lock.
+ *
+ * @param map Pointer to the concurrent hashmap
+ * @param key Pointer to the key to remove
+ * @return true if key was found and removed, false otherwise
+ */
+bool concurrent_hashmap_delete(concurrent_hashmap *map, const void *key)
+{
+    if (!map || !key)
+    {
+        return false;
+    }
+
+    uint64_t hash = hashmap_key_hash_seeded(map->shards[0].map, key, map->shard_seed);
+    struct shard *shard = shard_for(map, hash);
+    write_begin(shard);
+    bool removed = hashmap_delete_hashed(shard->map, key, shard_hash(map, shard, key, hash));
+    write_end(shard);
+    return removed;
+}
+
+/**
+ * Sum the shard sizes, read-locking one shard at a time.
+ *
+ * @param map Pointer to the concurrent hashmap
+ * @return Number of entries (0 for NULL)
+ */
+size_t concurrent_hashmap_size(const concurrent_hashmap *map)
+{
+    if (!map)
+    {
+        return 0;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i <= map->shard_mask; i++)
+    {
+        struct shard *shard = &map->shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        total += hashmap_size(shard->map);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return total;
+}
+
+/**
+ * Destroy every shard and free the map.
+ *
+ * @param map Pointer to the concurrent hashmap
+ */
+void concurrent_hashmap_destroy(concurrent_hashmap *map)
+{
+    if (!map)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i <= map->shard_mask; i++)
+    {
+        pthread_rwlock_destroy(&map->shards[i].lock);
+        hashmap_destroy(map->shards[i].map);
+    }
+    if (map->lock_free_reads)
+    {
+        pthread_mutex_destroy(&map->sync_lock);
+    }
+    hashmap_allocator allocator = map->allocator;
+    allocator.free(allocator.ctx, map, map->alloc_size);
+}
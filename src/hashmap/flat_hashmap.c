@@ -0,0 +1,1065 @@
+#include "flat_hashmap.h"
+#include "hashmap_internal.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Control bytes scanned per probe step; groups start at multiples of this
+#if defined(__SSE2__)
+#define GROUP_WIDTH 16
+#else
+#define GROUP_WIDTH 8
+#endif
+
+// Smallest table (slots); also keeps the slot array 16-byte aligned after the control bytes
+#define MIN_CAPACITY 16
+
+// Control byte states of unoccupied slots. Occupied slots hold the low 7 bits
+// of their key's hash, so the high bit alone tells free from occupied.
+#define CTRL_EMPTY 0x80   // Never used since the last resize; probes stop at its group
+#define CTRL_DELETED 0xFE // Tombstone: free, but probes must continue past it
+
+// Force inlining of the probe loops so each key-size specialization is folded
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+// Software prefetch hint (read, keep in all cache levels)
+#if defined(__GNUC__)
+#define PREFETCH(addr) __builtin_prefetch((addr), 0, 3)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+// Keys hashed and prefetched together by the batch calls before any is resolved
+#define BATCH_WINDOW 16
+
+/*
+ * Group masks.
+ * A group_mask has one bit per slot of a group, set when the slot matches. With
+ * SSE2 slot i is bit i; the SWAR and NEON paths keep the per-byte high bits
+ * instead, so slot i is bit 8*i+7. Use mask_first()/mask_next() rather than
+ * the raw bits.
+ */
+typedef uint64_t group_mask;
+
+#if defined(__SSE2__)
+#define GROUP_MASK_SHIFT 0
+#define GROUP_MASK_ALL 0xFFFFull
+#else
+#define GROUP_MASK_SHIFT 3
+#define GROUP_MASK_ALL 0x8080808080808080ull
+#endif
+
+struct flat_hashmap
+{
+    size_t key_size;
+    size_t value_size;
+    size_t value_offset; // Offset of the value within a slot
+    size_t slot_size;    // Stride between slots
+    hash_fn hash;
+    seeded_hash_fn seeded_hash;
+    equals_fn equals;
+    uint64_t seed;
+
+    uint8_t *ctrl;      // capacity control bytes, followed by the slot array
+    char *slots;
+    size_t capacity;    // Number of slots (power of 2, at least MIN_CAPACITY)
+    size_t count;
+    size_t growth_left; // Inserts into CTRL_EMPTY slots allowed before the next resize
+    hashmap_allocator allocator;
+};
+
+#if !defined(__SSE2__) && !defined(__ARM_NEON)
+/**
+ * Load 8 control bytes as a little-endian word (slot i in byte i).
+ *
+ * @param ctrl Pointer to the first control byte of the group
+ * @return The control bytes packed into a 64-bit word
+ */
+static inline uint64_t load_group_word(const uint8_t *ctrl)
+{
+    uint64_t word;
+    memcpy(&word, ctrl, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+#endif
+
+/**
+ * Find all slots of a group whose control byte equals a given byte.
+ *
+ * @param ctrl Pointer to the first control byte of the group
+ * @param byte Control byte to look for
+ * @return Mask of matching slots
+ */
+static inline group_mask match_byte(const uint8_t *ctrl, uint8_t byte)
+{
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    __m128i eq = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte));
+    return (group_mask)_mm_movemask_epi8(eq);
+#elif defined(__ARM_NEON)
+    uint8x8_t eq = vceq_u8(vld1_u8(ctrl), vdup_n_u8(byte));
+    return vget_lane_u64(vreinterpret_u64_u8(eq), 0) & GROUP_MASK_ALL;
+#else
+    // Exact zero-byte test (no false positives from borrows across bytes)
+    uint64_t x = load_group_word(ctrl) ^ (0x0101010101010101ull * byte);
+    return ~(((x & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | x) & GROUP_MASK_ALL;
+#endif
+}
+
+/**
+ * Find all free slots (CTRL_EMPTY or CTRL_DELETED) of a group.
+ *
+ * @param ctrl Pointer to the first control byte of the group
+ * @return Mask of free slots
+ */
+static inline group_mask match_free(const uint8_t *ctrl)
+{
+    // Both free states, and only they, have the high bit set
+#if defined(__SSE2__)
+    return (group_mask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#elif defined(__ARM_NEON)
+    uint8x8_t high = vcge_u8(vld1_u8(ctrl), vdup_n_u8(0x80));
+    return vget_lane_u64(vreinterpret_u64_u8(high), 0) & GROUP_MASK_ALL;
+#else
+    return load_group_word(ctrl) & GROUP_MASK_ALL;
+#endif
+}
+
+/**
+ * Find all occupied slots of a group.
+ *
+ * @param ctrl Pointer to the first control byte of the group
+ * @return Mask of occupied slots
+ */
+static inline group_mask match_full(const uint8_t *ctrl)
+{
+    return match_free(ctrl) ^ GROUP_MASK_ALL;
+}
+
+/**
+ * Index of the lowest slot set in a non-empty mask.
+ *
+ * @param mask Non-zero group mask
+ * @return Slot index within the group
+ */
+static inline size_t mask_first(group_mask mask)
+{
+    return (size_t)__builtin_ctzll(mask) >> GROUP_MASK_SHIFT;
+}
+
+/**
+ * Clear the lowest slot set in a non-empty mask.
+ *
+ * @param mask Non-zero group mask
+ * @return The mask without its lowest slot
+ */
+static inline group_mask mask_next(group_mask mask)
+{
+    return mask & (mask - 1);
+}
+
+/**
+ * Pick the bundled hash for a key size.
+ *
+ * @param key_size Size of keys in bytes
+ * @return hashmap_hash_u32/u64 for 4/8-byte keys, otherwise hashmap_hash_bytes
+ */
+static seeded_hash_fn default_hash(size_t key_size)
+{
+    switch (key_size)
+    {
+    case sizeof(uint32_t):
+        return hashmap_hash_u32;
+    case sizeof(uint64_t):
+        return hashmap_hash_u64;
+    default:
+        return hashmap_hash_bytes;
+    }
+}
+
+/**
+ * Hash a key with the map's seed (the bundled integer hashes are called
+ * directly so they can be inlined).
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to the key
+ * @return 64-bit seeded hash
+ */
+static inline uint64_t flat_hash(const flat_hashmap *map, const void *key)
+{
+    if (map->seeded_hash == hashmap_hash_u64)
+    {
+        return hashmap_hash_u64(key, sizeof(uint64_t), map->seed);
+    }
+    if (map->seeded_hash == hashmap_hash_u32)
+    {
+        return hashmap_hash_u32(key, sizeof(uint32_t), map->seed);
+    }
+    if (map->seeded_hash)
+    {
+        return map->seeded_hash(key, map->key_size, map->seed);
+    }
+    uint64_t hash = map->hash(key, map->key_size);
+    return hashmap_hash_u64(&hash, sizeof(hash), map->seed);
+}
+
+/**
+ * Control byte of an occupied slot: the low 7 bits of the hash.
+ *
+ * @param hash Seeded hash of the key
+ * @return Control byte (high bit clear)
+ */
+static inline uint8_t hash_ctrl(uint64_t hash)
+{
+    return (uint8_t)(hash & 0x7F);
+}
+
+/**
+ * First group of a key's probe sequence, from the hash bits above the control byte.
+ *
+ * @param hash Seeded hash of the key
+ * @param capacity Number of slots
+ * @return Index of the first slot of the group
+ */
+static inline size_t probe_start(uint64_t hash, size_t capacity)
+{
+    return (size_t)(hash >> 7) * GROUP_WIDTH & (capacity - 1);
+}
+
+/**
+ * Next group of a probe sequence. Jumping 1, 2, 3, ... groups visits every
+ * group of a power-of-2 table once before repeating.
+ *
+ * @param group Index of the first slot of the current group
+ * @param step Number of groups probed so far (>= 1)
+ * @param capacity Number of slots
+ * @return Index of the first slot of the next group
+ */
+static inline size_t probe_next(size_t group, size_t step, size_t capacity)
+{
+    return (group + step * GROUP_WIDTH) & (capacity - 1);
+}
+
+/**
+ * Get pointer to the key of a slot
+ *
+ * @param map The flat hashmap
+ * @param slots Slot array
+ * @param index Slot index
+ * @return Pointer to the key
+ */
+static inline char *slot_key(const flat_hashmap *map, char *slots, size_t index)
+{
+    return slots + index * map->slot_size;
+}
+
+/**
+ * Get pointer to the value of a slot
+ *
+ * @param map The flat hashmap
+ * @param slots Slot array
+ * @param index Slot index
+ * @return Pointer to the value
+ */
+static inline char *slot_value(const flat_hashmap *map, char *slots, size_t index)
+{
+    return slots + index * map->slot_size + map->value_offset;
+}
+
+/**
+ * Compare a stored key with a lookup key. With a constant key_size and no
+ * equals function the comparison compiles to one or two integer compares.
+ *
+ * @param map The flat hashmap
+ * @param stored Pointer to the stored key
+ * @param key Pointer to the key being looked for
+ * @param key_size Size of keys in bytes
+ * @return true if the keys are equal
+ */
+static ALWAYS_INLINE bool keys_equal(const flat_hashmap *map, const void *stored, const void *key, size_t key_size)
+{
+    if (map->equals)
+    {
+        return map->equals(stored, key, key_size);
+    }
+    switch (key_size)
+    {
+    case sizeof(uint32_t):
+    {
+        uint32_t a, b;
+        memcpy(&a, stored, sizeof(a));
+        memcpy(&b, key, sizeof(b));
+        return a == b;
+    }
+    case sizeof(uint64_t):
+    {
+        uint64_t a, b;
+        memcpy(&a, stored, sizeof(a));
+        memcpy(&b, key, sizeof(b));
+        return a == b;
+    }
+    default:
+        return memcmp(stored, key, key_size) == 0;
+    }
+}
+
+/*
+ * Call fn_sized(..., key_size) with a constant key size for the common 4, 8 and
+ * 16-byte keys compared bytewise, and with 0 (use map->key_size) otherwise.
+ * Must be the last statement of a function returning fn_sized's type.
+ */
+#define DISPATCH_KEY_SIZE(map, fn_sized, ...)                                                                         \
+    do                                                                                                                \
+    {                                                                                                                 \
+        if (!(map)->equals)                                                                                           \
+        {                                                                                                             \
+            switch ((map)->key_size)                                                                                  \
+            {                                                                                                         \
+            case sizeof(uint32_t):                                                                                    \
+                return fn_sized(__VA_ARGS__, sizeof(uint32_t));                                                       \
+            case sizeof(uint64_t):                                                                                    \
+                return fn_sized(__VA_ARGS__, sizeof(uint64_t));                                                       \
+            case 2 * sizeof(uint64_t):                                                                                \
+                return fn_sized(__VA_ARGS__, 2 * sizeof(uint64_t));                                                   \
+            }                                                                                                         \
+        }                                                                                                             \
+        return fn_sized(__VA_ARGS__, 0);                                                                              \
+    } while (0)
+
+/**
+ * Find the slot holding a key.
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to the key
+ * @param hash Seeded hash of the key
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return Slot index, or SIZE_MAX if the key is absent
+ */
+static ALWAYS_INLINE size_t find_slot_sized(const flat_hashmap *map, const void *key, uint64_t hash,
+                                            size_t key_size)
+{
+    key_size = key_size ? key_size : map->key_size;
+    uint8_t ctrl = hash_ctrl(hash);
+    size_t group = probe_start(hash, map->capacity);
+    for (size_t step = 1;; step++)
+    {
+        const uint8_t *group_ctrl = map->ctrl + group;
+        for (group_mask match = match_byte(group_ctrl, ctrl); match; match = mask_next(match))
+        {
+            size_t index = group + mask_first(match);
+            if (keys_equal(map, slot_key(map, map->slots, index), key, key_size))
+            {
+                return index;
+            }
+        }
+        // A key is never placed past a group that had an empty slot
+        if (match_byte(group_ctrl, CTRL_EMPTY))
+        {
+            return SIZE_MAX;
+        }
+        group = probe_next(group, step, map->capacity);
+    }
+}
+
+/**
+ * Find the slot holding a key (see find_slot_sized()).
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to the key
+ * @param hash Seeded hash of the key
+ * @return Slot index, or SIZE_MAX if the key is absent
+ */
+static size_t find_slot(const flat_hashmap *map, const void *key, uint64_t hash)
+{
+    DISPATCH_KEY_SIZE(map, find_slot_sized, map, key, hash);
+}
+
+/**
+ * Find the first free slot (empty or deleted) on a key's probe sequence.
+ * The table always has empty slots, so this terminates.
+ *
+ * @param ctrl Control bytes of the table
+ * @param capacity Number of slots
+ * @param hash Seeded hash of the key
+ * @return Slot index
+ */
+static size_t find_free_slot(const uint8_t *ctrl, size_t capacity, uint64_t hash)
+{
+    size_t group = probe_start(hash, capacity);
+    for (size_t step = 1;; step++)
+    {
+        group_mask free_slots = match_free(ctrl + group);
+        if (free_slots)
+        {
+            return group + mask_first(free_slots);
+        }
+        group = probe_next(group, step, capacity);
+    }
+}
+
+/**
+ * Most entries a table may hold: 7/8 of its slots.
+ *
+ * @param capacity Number of slots
+ * @return Maximum number of entries
+ */
+static inline size_t max_load(size_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+/**
+ * Smallest table that holds a number of entries.
+ *
+ * @param entries Number of entries
+ * @return Number of slots, or 0 on overflow
+ */
+static size_t capacity_for(size_t entries)
+{
+    size_t capacity = MIN_CAPACITY;
+    while (max_load(capacity) < entries)
+    {
+        if (capacity > SIZE_MAX / 2)
+        {
+            return 0;
+        }
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/**
+ * Bytes of the single allocation holding a table's control bytes and slots.
+ *
+ * @param map The flat hashmap (for the slot size)
+ * @param capacity Number of slots
+ * @return Size in bytes, or 0 on overflow
+ */
+static size_t table_bytes(const flat_hashmap *map, size_t capacity)
+{
+    if (map->slot_size >= SIZE_MAX / capacity)
+    {
+        return 0;
+    }
+    return capacity * (1 + map->slot_size);
+}
+
+/**
+ * Replace the table with a tombstone-free copy of the given size, moving
+ * every entry. Also used at the same size to purge tombstones.
+ *
+ * @param map The flat hashmap
+ * @param capacity New number of slots (power of 2, max_load(capacity) >= count)
+ * @return true on success, false on allocation failure (the table is unchanged)
+ */
+static bool resize(flat_hashmap *map, size_t capacity)
+{
+    size_t bytes = table_bytes(map, capacity);
+    uint8_t *ctrl = bytes ? (uint8_t *)map->allocator.alloc(map->allocator.ctx, bytes) : NULL;
+    if (!ctrl)
+    {
+        return false;
+    }
+    char *slots = (char *)(ctrl + capacity);
+    memset(ctrl, CTRL_EMPTY, capacity);
+
+    for (size_t group = 0; map->ctrl && group < map->capacity; group += GROUP_WIDTH)
+    {
+        for (group_mask full = match_full(map->ctrl + group); full; full = mask_next(full))
+        {
+            size_t index = group + mask_first(full);
+            char *key = slot_key(map, map->slots, index);
+            uint64_t hash = flat_hash(map, key);
+            size_t dest = find_free_slot(ctrl, capacity, hash);
+            ctrl[dest] = hash_ctrl(hash);
+            memcpy(slot_key(map, slots, dest), key, map->slot_size);
+        }
+    }
+
+    if (map->ctrl)
+    {
+        map->allocator.free(map->allocator.ctx, map->ctrl, table_bytes(map, map->capacity));
+    }
+    map->ctrl = ctrl;
+    map->slots = slots;
+    map->capacity = capacity;
+    map->growth_left = max_load(capacity) - map->count;
+    return true;
+}
+
+/**
+ * Natural alignment of a key or value: the largest power of 2 up to 8 dividing its size.
+ *
+ * @param size Size in bytes
+ * @return Alignment in bytes
+ */
+static inline size_t natural_align(size_t size)
+{
+    size_t align = 1;
+    while (align < 8 && size % (align * 2) == 0)
+    {
+        align *= 2;
+    }
+    return align;
+}
+
+/**
+ * Create a new flat hashmap.
+ *
+ * @param key_size Size of keys in bytes (must be > 0)
+ * @param value_size Size of values in bytes (must be > 0)
+ * @param hash Hash function pointer, or NULL for a bundled hash picked by key_size
+ * @param equals Equality comparison function pointer, or NULL to compare keys bytewise
+ * @return Pointer to the new map, or NULL on failure
+ */
+flat_hashmap *flat_hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals)
+{
+    return flat_hashmap_create_ex(key_size, value_size, hash, equals, NULL);
+}
+
+/**
+ * Create a flat hashmap with explicit options.
+ * Slots are laid out key first, each key and value at its natural alignment,
+ * so values returned by flat_hashmap_get_ptr() can be accessed in place.
+ *
+ * @param key_size Size of keys in bytes (must be > 0)
+ * @param value_size Size of values in bytes (must be > 0)
+ * @param hash Hash function pointer, or NULL for a bundled hash picked by key_size
+ * @param equals Equality comparison function pointer, or NULL to compare keys bytewise
+ * @param options Creation options, or NULL for defaults
+ * @return Pointer to the new map, or NULL on failure
+ */
+flat_hashmap *flat_hashmap_create_ex(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                                     const hashmap_options *options)
+{
+    static const hashmap_options default_options = {0};
+    if (!options)
+    {
+        options = &default_options;
+    }
+    const hashmap_allocator *allocator = options->allocator ? options->allocator : &hashmap_default_allocator;
+    if (key_size == 0 || value_size == 0 || !allocator->alloc || !allocator->free ||
+        key_size > SIZE_MAX / 4 || value_size > SIZE_MAX / 4)
+    {
+        return NULL;
+    }
+    size_t capacity = capacity_for(options->capacity);
+    if (capacity == 0)
+    {
+        return NULL;
+    }
+    flat_hashmap *map = (flat_hashmap *)allocator->alloc(allocator->ctx, sizeof(flat_hashmap));
+    if (!map)
+    {
+        return NULL;
+    }
+
+    map->key_size = key_size;
+    map->value_size = value_size;
+    size_t value_align = natural_align(value_size);
+    size_t slot_align = natural_align(key_size) > value_align ? natural_align(key_size) : value_align;
+    map->value_offset = (key_size + value_align - 1) / value_align * value_align;
+    map->slot_size = (map->value_offset + value_size + slot_align - 1) / slot_align * slot_align;
+    map->hash = options->seeded_hash ? NULL : hash;
+    map->seeded_hash = options->seeded_hash;
+    if (!map->hash && !map->seeded_hash)
+    {
+        map->seeded_hash = default_hash(key_size);
+    }
+    map->equals = equals;
+    map->seed = hashmap_random_seed(map);
+    map->ctrl = NULL;
+    map->slots = NULL;
+    map->capacity = 0;
+    map->count = 0;
+    map->growth_left = 0;
+    map->allocator = *allocator;
+
+    if (!resize(map, capacity))
+    {
+        allocator->free(allocator->ctx, map, sizeof(flat_hashmap));
+        return NULL;
+    }
+    return map;
+}
+
+/**
+ * Make room for at least capacity entries without further growth.
+ *
+ * @param map Pointer to the flat hashmap
+ * @param capacity Number of entries to hold without growing
+ * @return true on success, false on NULL map or allocation failure
+ */
+bool flat_hashmap_reserve(flat_hashmap *map, size_t capacity)
+{
+    if (!map)
+    {
+        return false;
+    }
+    if (capacity <= map->count + map->growth_left)
+    {
+        return true;
+    }
+    size_t new_capacity = capacity_for(capacity);
+    return new_capacity != 0 && resize(map, new_capacity);
+}
+
+/**
+ * Find the slot of a key, or insert the key without a value.
+ * A new key takes the first free slot on its probe sequence, reusing
+ * tombstones. When only tombstones stand between the table and its load limit,
+ * they are purged at the same size if that frees enough room (fewer than half
+ * the allowed entries are live), otherwise the table doubles.
+ *
+ * @param map The flat hashmap
+ * @param key Pointer to the key
+ * @param hash Seeded hash of the key
+ * @param unique The key is known to be absent, so the search is skipped
+ * @param inserted Set to whether the key was newly inserted
+ * @return Slot index (its value is the caller's to fill in when inserted), or SIZE_MAX on allocation failure
+ */
+static size_t claim_slot(flat_hashmap *map, const void *key, uint64_t hash, bool unique, bool *inserted)
+{
+    *inserted = false;
+    size_t index = unique ? SIZE_MAX : find_slot(map, key, hash);
+    if (index != SIZE_MAX)
+    {
+        return index;
+    }
+
+    index = find_free_slot(map->ctrl, map->capacity, hash);
+    if (map->growth_left == 0 && map->ctrl[index] == CTRL_EMPTY)
+    {
+        size_t capacity = map->capacity;
+        if (map->count >= max_load(capacity) / 2)
+        {
+            if (capacity > SIZE_MAX / 2)
+            {
+                return false;
+            }
+            capacity *= 2;
+        }
+        if (!resize(map, capacity))
+        {
+            return SIZE_MAX;
+        }
+        index = find_free_slot(map->ctrl, map->capacity, hash);
+    }
+
+    if (map->ctrl[index] == CTRL_EMPTY)
+    {
+        map->growth_left--;
+    }
+    map->ctrl[index] = hash_ctrl(hash);
+    memcpy(slot_key(map, map->slots, index), key, map->key_size);
+    map->count++;
+    *inserted = true;
+    return index;
+}
+
+/**
+ * Insert or update a key-value pair (see claim_slot()).
+ *
+ * @param map Pointer to the flat hashmap
+ * @param key Pointer to the key
+ * @param value Pointer to the value
+ * @return true on success, false on NULL parameters or allocation failure
+ */
+bool flat_hashmap_put(flat_hashmap *map, const void *key, const void *value)
+{
+    if (!map || !key || !value)
+    {
+        return false;
+    }
+    bool inserted;
+    size_t index = claim_slot(map, key, flat_hash(map, key), false, &inserted);
+    if (index == SIZE_MAX)
+    {
+        return false;
+    }
+    memcpy(slot_value(map, map->slots, index), value, map->value_size);
+    return true;
+}
+
+/**
+ * Prefetch the first group of a key's probe sequence: its control bytes and
+ * the slot of the group's first entry.
+ *
+ * @param map The flat hashmap
+ * @param hash Seeded hash of the key
+ */
+static inline void prefetch_probe(const flat_hashmap *map, uint64_t hash)
+{
+    size_t group = probe_start(hash, map->capacity);
+    PREFETCH(map->ctrl + group);
+    PREFETCH(slot_key(map, map->slots, group));
+}
+
+/**
+ * Insert or update a batch of key-value pairs.
+ * Reserves room for n more entries up front, so the table is resized at most
+ * once, then inserts in windows of BATCH_WINDOW entries with each window's
+ * groups prefetched. With HASHMAP_BATCH_UNIQUE the duplicate-key search is
+ * skipped; the caller guarantees the keys are distinct and not already in the
+ * map.
+ *
+ * @param map Pointer to the flat hashmap
+ * @param keys Array of n keys stored contiguously (key_size bytes each)
+ * @param values Array of n values stored contiguously (value_size bytes each)
+ * @param n Number of entries
+ * @param flags 0 or HASHMAP_BATCH_UNIQUE
+ * @return Number of entries stored before an allocation failure (n on success, 0 on NULL parameters)
+ */
+size_t flat_hashmap_put_batch(flat_hashmap *map, const void *keys, const void *values, size_t n, unsigned flags)
+{
+    if (!map || !keys || !values)
+    {
+        return 0;
+    }
+    // A failed reservation only means the table grows step by step instead
+    if (n <= SIZE_MAX - map->count)
+    {
+        flat_hashmap_reserve(map, map->count + n);
+    }
+    bool unique = (flags & HASHMAP_BATCH_UNIQUE) != 0;
+    uint64_t hashes[BATCH_WINDOW];
+
+    for (size_t base = 0; base < n; base += BATCH_WINDOW)
+    {
+        size_t window = n - base < BATCH_WINDOW ? n - base : BATCH_WINDOW;
+        const char *window_keys = (const char *)keys + base * map->key_size;
+        const char *window_values = (const char *)values + base * map->value_size;
+
+        for (size_t i = 0; i < window; i++)
+        {
+            hashes[i] = flat_hash(map, window_keys + i * map->key_size);
+            prefetch_probe(map, hashes[i]);
+        }
+
+        for (size_t i = 0; i < window; i++)
+        {
+            bool inserted;
+            size_t index = claim_slot(map, window_keys + i * map->key_size, hashes[i], unique, &inserted);
+            if (index == SIZE_MAX)
+            {
+                return base + i;
+            }
+            memcpy(slot_value(map, map->slots, index), window_values + i * map->value_size, map->value_size);
+        }
+    }
+    return n;
+}
+
+/**
+ * Retrieve a value by key.
+ *
+ * @param map Pointer to the flat hashmap
+ * @param key Pointer to the key
+ * @param value_out Receives a copy of the value if found
+ * @return true if the key was found, false if not or on NULL parameters
+ */
+bool flat_hashmap_get(const flat_hashmap *map, const void *key, void *value_out)
+{
+    if (!map || !key || !value_out)
+    {
+        return false;
+    }
+    size_t index = find_slot(map, key, flat_hash(map, key));
+    if (index == SIZE_MAX)
+    {
+        return false;
+    }
+    memcpy(value_out, slot_value(map, map->slots, index), map->value_size);
+    return true;
+}
+
+/**
+ * Look up a batch of keys in two passes over a window of BATCH_WINDOW keys:
+ * hash every key and prefetch its first group, then resolve the lookups, so
+ * the cache misses of the window overlap.
+ *
+ * @param map The flat hashmap
+ * @param keys Array of n keys, key_size bytes each
+ * @param n Number of keys
+ * @param values_out Array of n values, filled for every key found
+ * @param found_out Optional array of n flags, set to whether each key was found
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return Number of keys found
+ */
+static ALWAYS_INLINE size_t get_batch_sized(const flat_hashmap *map, const char *keys, size_t n, char *values_out,
+                                            bool *found_out, size_t key_size)
+{
+    uint64_t hashes[BATCH_WINDOW];
+    size_t found = 0;
+
+    for (size_t base = 0; base < n; base += BATCH_WINDOW)
+    {
+        size_t window = n - base < BATCH_WINDOW ? n - base : BATCH_WINDOW;
+        const char *window_keys = keys + base * map->key_size;
+
+        for (size_t i = 0; i < window; i++)
+        {
+            hashes[i] = flat_hash(map, window_keys + i * map->key_size);
+            prefetch_probe(map, hashes[i]);
+        }
+
+        for (size_t i = 0; i < window; i++)
+        {
+            size_t index = find_slot_sized(map, window_keys + i * map->key_size, hashes[i], key_size);
+            if (index != SIZE_MAX)
+            {
+                memcpy(values_out + (base + i) * map->value_size, slot_value(map, map->slots, index),
+                       map->value_size);
+                found++;
+            }
+            if (found_out)
+            {
+                found_out[base + i] = index != SIZE_MAX;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * Retrieve the values for a batch of keys, overlapping their memory latency.
+ * Equivalent to calling flat_hashmap_get() for each key, but hashes every key
+ * of a window and prefetches its probe group before resolving any of them.
+ *
+ * @param map Pointer to the flat hashmap
+ * @param keys Array of n keys stored contiguously (key_size bytes each)
+ * @param n Number of keys
+ * @param values_out Array of n values (value_size bytes each); entries for missing keys are left untouched
+ * @param found_out Optional array of n flags, set to whether each key was found (may be NULL)
+ * @return Number of keys found (0 on NULL parameters)
+ */
+size_t flat_hashmap_get_batch(const flat_hashmap *map, const void *keys, size_t n, void *values_out,
+                              bool *found_out)
+{
+    if (!map || !keys || !values_out)
+    {
+        return 0;
+    }
+    DISPATCH_KEY_SIZE(map, get_batch_sized, map, (const char *)keys, n, (char *)values_out, found_out);
+}
+
+/**
+ * Get a pointer to the stored value for a key.
+ *
+ * @param map Pointer to the flat hashmap
+ * @param key Pointer to the key
+ * @return Pointer to the value inside the table, or NULL if not found
+ */
+void *flat_hashmap_get_ptr(const flat_hashmap *map, const void *key)
+{
+    if (!map || !key)
+    {
+        return NULL;
+    }
+    size_t index = find_slot(map, key, flat_hash(map, key));
+    return index == SIZE_MAX ? NULL : slot_value(map, map->slots, index);
+}
+
+/**
+ * Get a writable pointer to the value slot for a key, inserting the key with
+ * a zero-filled value if absent.
+ *
+ * @param map Pointer to the flat hashmap
+ * @param key Pointer to the key
+ * @param inserted Optional; set to whether the key was newly inserted
+ * @return Pointer to the value inside the table, or NULL on NULL parameters or allocation failure
+ */
+void *flat_hashmap_get_or_insert_slot(flat_hashmap *map, const void *key, bool *inserted)
+{
+    bool was_inserted = false;
+    if (inserted)
+    {
+        *inserted = false;
+    }
+    if (!map || !key)
+    {
+        return NULL;
+    }
+    size_t index = claim_slot(map, key, flat_hash(map, key), false, &was_inserted);
+    if (index == SIZE_MAX)
+    {
+        return NULL;
+    }
+    char *value = slot_value(map, map->slots, index);
+    if (was_inserted)
+    {
+        memset(value, 0, map->value_size);
+    }
+    if (inserted)
+    {
+        *inserted = was_inserted;
+    }
+    return value;
+}
+
+/**
+ * Remove a key-value pair.
+ * The slot becomes empty again if its group still has an empty slot (no probe
+ * can have passed the group then), otherwise a tombstone.
+ *
+ * @param map Pointer to the flat hashmap
+ * @param key Pointer to the key
+ * @return true if the key was found and removed, false otherwise
+ */
+bool flat_hashmap_delete(flat_hashmap *map, const void *key)
+{
+    if (!map || !key)
+    {
+        return false;
+    }
+    size_t index = find_slot(map, key, flat_hash(map, key));
+    if (index == SIZE_MAX)
+    {
+        return false;
+    }
+    size_t group = index & ~(size_t)(GROUP_WIDTH - 1);
+    if (match_byte(map->ctrl + group, CTRL_EMPTY))
+    {
+        map->ctrl[index] = CTRL_EMPTY;
+        map->growth_left++;
+    }
+    else
+    {
+        map->ctrl[index] = CTRL_DELETED;
+    }
+    map->count--;
+    return true;
+}
+
+/**
+ * Number of entries.
+ *
+ * @param map Pointer to the flat hashmap
+ * @return Number of entries (0 for NULL)
+ */
+size_t flat_hashmap_size(const flat_hashmap *map)
+{
+    return map ? map->count : 0;
+}
+
+/**
+ * Collect statistics about a flat map. Every entry is hashed again to count
+ * the groups between the start of its probe sequence and its own.
+ *
+ * @param map Pointer to the flat hashmap
+ * @param out Receives the statistics
+ * @return true on success, false on NULL parameters
+ */
+bool flat_hashmap_stats(const flat_hashmap *map, flat_hashmap_statistics *out)
+{
+    if (!map || !out)
+    {
+        return false;
+    }
+    memset(out, 0, sizeof(*out));
+    out->count = map->count;
+    out->capacity = map->capacity;
+    out->growth_left = map->growth_left;
+    out->load_factor = (double)map->count / (double)map->capacity;
+    for (size_t group = 0; group < map->capacity; group += GROUP_WIDTH)
+    {
+        out->tombstones += (size_t)__builtin_popcountll(match_byte(map->ctrl + group, CTRL_DELETED));
+        for (group_mask full = match_full(map->ctrl + group); full; full = mask_next(full))
+        {
+            uint64_t hash = flat_hash(map, slot_key(map, map->slots, group + mask_first(full)));
+            size_t probe = probe_start(hash, map->capacity);
+            size_t length = 1;
+            while (probe != group)
+            {
+                probe = probe_next(probe, length, map->capacity);
+                length++;
+            }
+            out->probe_lengths[(length < FLAT_HASHMAP_STATS_MAX_PROBE ? length : FLAT_HASHMAP_STATS_MAX_PROBE) - 1]++;
+            if (length > out->max_probe)
+            {
+                out->max_probe = length;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Start iterating over a flat hashmap.
+ *
+ * @param iter Iterator to initialize
+ * @param map The flat hashmap
+ */
+void flat_hashmap_iter_init(flat_hashmap_iter *iter, const flat_hashmap *map)
+{
+    if (!iter)
+    {
+        return;
+    }
+    iter->map = map;
+    iter->index = 0;
+}
+
+/**
+ * Advance to the next occupied slot.
+ *
+ * @param iter Iterator from flat_hashmap_iter_init
+ * @param key_out Optional; set to the stored key
+ * @param value_out Optional; set to the stored value
+ * @return true if an entry was produced, false when the iteration is done
+ */
+bool flat_hashmap_iter_next(flat_hashmap_iter *iter, const void **key_out, void **value_out)
+{
+    if (!iter || !iter->map)
+    {
+        return false;
+    }
+    const flat_hashmap *map = iter->map;
+    while (iter->index < map->capacity)
+    {
+        size_t index = iter->index++;
+        if (map->ctrl[index] & 0x80)
+        {
+            continue;
+        }
+        if (key_out)
+        {
+            *key_out = slot_key(map, map->slots, index);
+        }
+        if (value_out)
+        {
+            *value_out = slot_value(map, map->slots, index);
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Destroy the map and free all memory.
+ *
+ * @param map Map to destroy (NULL is ignored)
+ */
+void flat_hashmap_destroy(flat_hashmap *map)
+{
+    if (!map)
+    {
+        return;
+    }
+    hashmap_allocator allocator = map->allocator;
+    allocator.free(allocator.ctx, map->ctrl, table_bytes(map, map->capacity));
+    allocator.free(allocator.ctx, map, sizeof(flat_hashmap));
+}
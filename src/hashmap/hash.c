@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "hashmap.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/random.h>)
+#include <sys/random.h>
+#define HAVE_GETRANDOM 1
+#endif
+#endif
+
+// wyhash default secret (odd constants with 32 set bits each)
+static const uint64_t WY_SECRET[4] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6dbull,
+                                      0x589965cc75374cc3ull};
+
+/**
+ * Full 64x64 -> 128 bit multiply, returning the low half in *a and the high half in *b.
+ *
+ * @param a First factor, replaced by the low 64 bits of the product
+ * @param b Second factor, replaced by the high 64 bits of the product
+ */
+static inline void wymum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+/**
+ * Multiply two words and fold the 128-bit product back to 64 bits.
+ *
+ * @param a First factor
+ * @param b Second factor
+ * @return Low half XOR high half of a * b
+ */
+static inline uint64_t wymix(uint64_t a, uint64_t b)
+{
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+/**
+ * Read 8 bytes as a little-endian word (unaligned).
+ */
+static inline uint64_t wyr8(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+/**
+ * Read 4 bytes as a little-endian word (unaligned).
+ */
+static inline uint64_t wyr4(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+/**
+ * Read 1 to 3 bytes (first, middle and last) into one word.
+ */
+static inline uint64_t wyr3(const uint8_t *p, size_t len)
+{
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+}
+
+/**
+ * Seeded hash of an arbitrary byte string (wyhash final v4).
+ *
+ * @param key Pointer to the bytes to hash
+ * @param key_size Number of bytes
+ * @param seed Hash seed
+ * @return 64-bit hash
+ */
+uint64_t hashmap_hash_bytes(const void *key, size_t key_size, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    size_t len = key_size;
+    uint64_t a, b;
+    seed ^= wymix(seed ^ WY_SECRET[0], WY_SECRET[1]);
+
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0)
+        {
+            a = wyr3(p, len);
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = len;
+        if (i > 48)
+        {
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = wymix(wyr8(p) ^ WY_SECRET[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ WY_SECRET[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ WY_SECRET[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = wymix(wyr8(p) ^ WY_SECRET[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+
+    a ^= WY_SECRET[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ WY_SECRET[0] ^ len, b ^ WY_SECRET[1]);
+}
+
+/**
+ * Seeded hash of a 4-byte key (one 64x64 multiply).
+ *
+ * @param key Pointer to the 4-byte key
+ * @param key_size Ignored (always 4)
+ * @param seed Hash seed
+ * @return 64-bit hash
+ */
+uint64_t hashmap_hash_u32(const void *key, size_t key_size, uint64_t seed)
+{
+    (void)key_size;
+    uint32_t k;
+    memcpy(&k, key, sizeof(k));
+    return wymix(((uint64_t)k << 32 | k) ^ WY_SECRET[0], seed ^ WY_SECRET[1]);
+}
+
+/**
+ * Seeded hash of an 8-byte key (one 64x64 multiply).
+ * Also used to fold the seed into the result of an unseeded hash_fn.
+ *
+ * @param key Pointer to the 8-byte key
+ * @param key_size Ignored (always 8)
+ * @param seed Hash seed
+ * @return 64-bit hash
+ */
+uint64_t hashmap_hash_u64(const void *key, size_t key_size, uint64_t seed)
+{
+    (void)key_size;
+    uint64_t k;
+    memcpy(&k, key, sizeof(k));
+    return wymix(k ^ WY_SECRET[0], seed ^ WY_SECRET[1]);
+}
+
+/**
+ * Read a word from the operating system's random source: getrandom() where
+ * available, else /dev/urandom.
+ *
+ * @param out Receives the random bits
+ * @return true on success, false if no random source could be read
+ */
+static bool os_random(uint64_t *out)
+{
+#if defined(HAVE_GETRANDOM)
+    // Non-blocking: before the kernel pool is ready, fall through instead of stalling map creation
+    if (getrandom(out, sizeof(*out), GRND_NONBLOCK) == (ssize_t)sizeof(*out))
+    {
+        return true;
+    }
+#endif
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    ssize_t got = read(fd, out, sizeof(*out));
+    close(fd);
+    return got == (ssize_t)sizeof(*out);
+}
+
+/**
+ * Generate a hash seed for a new map (or a reseed) from the operating system's
+ * random source, so an attacker cannot predict it. The clock is only used when
+ * no random source can be read.
+ *
+ * @param map Address of the map, mixed in so maps seeded together still differ
+ * @return A seed that differs between maps and between runs
+ */
+uint64_t hashmap_random_seed(const void *map)
+{
+    uint64_t entropy;
+    if (!os_random(&entropy))
+    {
+        entropy = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32);
+    }
+    return hashmap_hash_u64(&entropy, sizeof(entropy), (uint64_t)(uintptr_t)map);
+}
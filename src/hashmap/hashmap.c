@@ -1,6 +1,30 @@
+#define _POSIX_C_SOURCE 200809L
+// MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE and syscall() for page placement
+#define _DEFAULT_SOURCE
+
 #include "hashmap.h"
+#include "hashmap_internal.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 // Initial number of buckets (matches Go's implementation)
 #define INITIAL_BUCKET_COUNT 8
@@ -12,56 +36,415 @@
 #define LOAD_FACTOR_NUMERATOR 13
 #define LOAD_FACTOR_DENOMINATOR 2
 
-// Empty tophash value
-#define EMPTY 0
+// Tophash states of unoccupied slots (match Go's emptyRest/emptyOne).
+// EMPTY_REST is 0 so zero-filled buckets start out entirely "rest"; probes stop
+// at a bucket holding an EMPTY_REST slot instead of walking the rest of the chain.
+#define EMPTY_REST 0 // Empty, and so is every later slot in this bucket and its overflow chain
+#define EMPTY_ONE 1  // Empty, but later slots may still be occupied
+
+// Stored in tophash[0] of an old bucket once its entries have moved to the new array
+#define EVACUATED 2
+
+// Smallest tophash of an occupied slot (smaller values are reserved markers)
+#define MIN_TOP_HASH 3
+
+// Bucket arrays are aligned to this; HASHMAP_CACHE_ALIGN also rounds the bucket stride to it
+#define CACHE_LINE_SIZE 64
+
+// Force inlining of the probe loops so each key-size specialization is folded
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+// Software prefetch hint (read, keep in all cache levels)
+#if defined(__GNUC__)
+#define PREFETCH(addr) __builtin_prefetch((addr), 0, 3)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+// Keys hashed and prefetched together by hashmap_get_batch() before any is resolved
+#define BATCH_WINDOW 16
+
+// Upper bound on evacuation-cursor steps per mutation (matches Go's 1024)
+#define EVACUATE_SCAN_LIMIT 1024
+
+// Old bucket arrays at least this large are evacuated by worker threads in one
+// go when the map was created with evacuation_threads > 1
+#define PARALLEL_EVACUATION_MIN_BUCKETS (1u << 16)
+
+// Old buckets claimed by a worker at a time during parallel evacuation
+#define PARALLEL_EVACUATION_CHUNK 1024
+
+// States of a chunk of old buckets during parallel evacuation
+#define CHUNK_PENDING 0
+#define CHUNK_BUSY 1
+#define CHUNK_DONE 2
+
+// Snapshot file format (hashmap_save/hashmap_open_mmap)
+#define SNAPSHOT_MAGIC "ADSHMAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// Buckets staged in memory per write() while saving a snapshot
+#define SNAPSHOT_WRITE_BUCKETS 256
+
+// hashmap_options flags that change the bucket format (recorded in snapshots)
+#define LAYOUT_FLAGS                                                                                                  \
+    (HASHMAP_PAD_SLOTS | HASHMAP_CACHE_ALIGN | HASHMAP_INLINE_LARGE | HASHMAP_INDIRECT_KEYS | HASHMAP_INDIRECT_VALUES | \
+     HASHMAP_FINGERPRINTS | HASHMAP_NEIGHBORHOOD)
+
+// Keys and values larger than this are stored out of line unless HASHMAP_INLINE_LARGE is set
+#define MAX_INLINE_SIZE 128
+
+// Growth routes entries by their stored fingerprint (the low 32 hash bits)
+// only while those bits are enough to pick a bucket
+#define FINGERPRINT_ROUTE_LIMIT ((uint64_t)1 << 32)
+
+// Buckets after its own that a HASHMAP_NEIGHBORHOOD entry may spill into
+// (only their head buckets, each counted in the home bucket's spill counts)
+#define NEIGHBOR_BUCKETS 3
+
+// Bucket arrays at least this large are mapped from the kernel when a page
+// placement flag asks for it (one 2 MB huge page); smaller ones gain nothing
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+// Arrays this large are first tried on 1 GB pages
+#define GIANT_PAGE_SIZE ((size_t)1 << 30)
+
+// Fallbacks for older headers: the page size goes in the MAP_HUGETLB flag
+// bits as its log2, and the mbind()/get_mempolicy() constants
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#define MAP_HUGE_PAGE_BITS(log2_size) ((log2_size) << MAP_HUGE_SHIFT)
+#define NUMA_MPOL_BIND 2
+#define NUMA_MPOL_INTERLEAVE 3
+#define NUMA_MPOL_F_MEMS_ALLOWED (1 << 2)
+
+// An insert that has to extend a chain already this many buckets long (64+
+// entries where the load factor averages 6.5) assumes a hash flood and reseeds
+#define FLOOD_CHAIN_BUCKETS 8
+
+// Objects per slab: the first slab is small, later ones double up to the cap
+#define SLAB_MIN_OBJECTS 16
+#define SLAB_MAX_OBJECTS 4096
+
+/**
+ * Header at the start of every slab; objects follow it.
+ */
+struct slab
+{
+    struct slab *next;
+    size_t size; // Total bytes including this header
+};
+
+/**
+ * Fixed-size object pool owned by a map.
+ * Objects are carved out of large slabs with a bump pointer; freed objects go on
+ * an intrusive free list (linked through their first word) and are reused before
+ * the bump pointer advances. Memory only returns to the system when the pool is
+ * destroyed, one free() per slab.
+ */
+struct slab_pool
+{
+    const hashmap_allocator *allocator;
+    size_t object_size; // Multiple of sizeof(char *) and at least that large
+    size_t align;       // Alignment of the first object in each slab
+    struct slab *slabs;
+    char *free_list;
+    char *cursor; // Next unused object in the newest slab
+    char *end;    // End of the newest slab
+    size_t next_slab_objects;
+};
+
+/**
+ * A parallel evacuation in progress. The old array is split into chunks of
+ * PARALLEL_EVACUATION_CHUNK buckets; whoever moves a chunk from CHUNK_PENDING
+ * to CHUNK_BUSY (a worker, or a caller about to touch one of its buckets)
+ * evacuates it alone and publishes it as CHUNK_DONE.
+ */
+struct evacuation_job
+{
+    hashmap *map;
+    size_t chunk_count;
+    atomic_uchar *chunks;    // CHUNK_* state of every chunk
+    atomic_size_t settled;   // Chunks in CHUNK_DONE
+    atomic_size_t evacuated; // Old buckets moved so far
+};
+
+/**
+ * One worker of an evacuation pool.
+ */
+struct evacuation_worker
+{
+    struct evacuation_pool *pool;
+    size_t index; // Picks the range of chunks the worker starts in
+    pthread_t thread;
+};
+
+/**
+ * Worker threads a map starts at its first parallel evacuation and keeps until
+ * it is destroyed. Between jobs they sleep on changed. lock also serves as the
+ * map's pool_lock while a job runs.
+ */
+struct evacuation_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // Broadcast when a job opens, the last worker leaves it, or on shutdown
+    struct evacuation_job job;
+    bool active;         // job is open to workers
+    unsigned generation; // Bumped for every posted job
+    size_t busy;         // Workers inside the job
+    bool shutdown;
+    size_t worker_count;
+    struct evacuation_worker workers[];
+};
 
 struct hashmap
 {
     size_t key_size;
     size_t value_size;
-    hash_fn hash;
-    equals_fn equals;
+    hash_fn hash;               // Unseeded user hash (NULL when seeded_hash is set)
+    seeded_hash_fn seeded_hash; // Seeded hash (NULL when hash is set)
+    equals_fn equals;           // NULL: keys are compared bytewise inline
+
+    // bucket layout, computed once by init_layout()
+    size_t key_stride;      // Bytes per key slot (key_size, or padded for alignment)
+    size_t value_stride;    // Bytes per value slot
+    size_t key_slot_size;   // Bytes copied per key slot (key_size, or a pointer when indirect)
+    size_t value_slot_size; // Bytes copied per value slot
+    bool indirect_keys;     // Key slots hold pointers to objects in key_pool
+    bool indirect_values;   // Value slots hold pointers to objects in value_pool
+    size_t fingerprints_offset; // Offset of the fingerprint array within a bucket (0: none)
+    size_t values_offset;   // Offset of the values array within a bucket
+    size_t overflow_offset; // Offset of the overflow pointer within a bucket
+    size_t spill_offset;    // Offset of the spill counts within a bucket (0: no HASHMAP_NEIGHBORHOOD)
+    size_t bucket_size;     // Stride between buckets
+    unsigned layout_flags;  // LAYOUT_FLAGS bits the layout was computed from
 
     char *buckets;
     size_t bucket_count;
     size_t count;
-    size_t hash_seed;
+    uint64_t hash_seed;
+    uint64_t old_seed;          // Seed old_buckets is laid out by (differs from hash_seed only while reseeding)
+    bool reseed_enabled;        // Reseed on hash floods (off with HASHMAP_NO_RESEED)
+    bool flood_pending;         // Flood seen while reseed_enabled is off (see hashmap_take_flood())
+    size_t reseed_bucket_count; // bucket_count at the last reseed: at most one per table size
+
+    // source of every allocation, including the map itself, except bucket
+    // arrays mapped for page placement (see buckets_mapped())
+    hashmap_allocator allocator;
+    bool huge_pages;          // HASHMAP_HUGE_PAGES
+    int numa_mode;            // NUMA_MPOL_BIND, NUMA_MPOL_INTERLEAVE or 0 for no policy
+    unsigned long numa_nodes; // Node mask for numa_mode (0 with interleave: all allowed nodes)
+    void (*unmap_wait)(void *ctx); // Called before a mapped bucket array is unmapped, or NULL
+    void *unmap_wait_ctx;
 
     // incremental rehashing
     char *old_buckets;
     size_t old_bucket_count;
     size_t evacuated;
+    unsigned evacuation_threads;  // Workers for parallel evacuation (<= 1: incremental only)
+    bool parallel_pending;        // Current growth is due for parallel evacuation
+    bool evacuation_foreground;   // Parallel evacuation completes in the mutation that starts it
+    struct evacuation_pool *evacuation_pool; // Started by the first parallel evacuation, else NULL
+    struct evacuation_job *job;   // Parallel evacuation in progress, else NULL
+    pthread_mutex_t *pool_lock;   // Guards overflow_pool while workers evacuate, else NULL
+
+    // overflow buckets for all chains (current and old bucket arrays)
+    struct slab_pool overflow_pool;
+    // during a rebuild (compaction), the previous pool holding the old array's
+    // chains; destroyed as a whole once the old array is evacuated
+    struct slab_pool retired_pool;
+    bool pool_retired;
+    // out-of-line keys and values (only initialized in indirect mode)
+    struct slab_pool key_pool;
+    struct slab_pool value_pool;
+    unsigned shrink_percent; // Auto-shrink threshold in percent of capacity (0: never)
+
+    // snapshot mapped by hashmap_open_mmap(), or NULL; bucket arrays inside it
+    // are never freed individually
+    char *mapping;
+    size_t mapping_size;
+
+#if defined(HASHMAP_STATS)
+    // lookup counters reported by hashmap_stats(); atomic because lookups may
+    // run concurrently (concurrent_hashmap readers)
+    struct
+    {
+        _Atomic uint64_t lookups;
+        _Atomic uint64_t probed_buckets;
+        _Atomic uint64_t max_probed_buckets;
+        _Atomic uint64_t key_compares;
+        _Atomic uint64_t false_positives;
+    } stats;
+#endif
 };
 
+// Hot-path counters: relaxed atomic adds in HASHMAP_STATS builds, nothing otherwise
+#if defined(HASHMAP_STATS)
+#define STAT_ADD(map, counter, n)                                                                                     \
+    atomic_fetch_add_explicit(&((hashmap *)(map))->stats.counter, (n), memory_order_relaxed)
+#else
+#define STAT_ADD(map, counter, n) ((void)(n))
+#endif
+
+/**
+ * Default allocator: malloc
+ */
+static void *default_alloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+/**
+ * Default allocator: free
+ */
+static void default_free(void *ctx, void *ptr, size_t size)
+{
+    (void)ctx;
+    (void)size;
+    free(ptr);
+}
+
 /**
- * Calculate the total size of a single bucket in bytes
- * Layout: [tophash:8][keys:8*key_size][values:8*value_size][overflow:8]
+ * Default allocator: calloc, which takes large blocks straight from the OS
+ * as zero pages that are only backed once written
+ */
+static void *default_zalloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return calloc(1, size);
+}
+
+// Shared with the other maps through hashmap_internal.h
+const hashmap_allocator hashmap_default_allocator = {default_alloc, default_free, NULL, default_zalloc};
+
+/**
+ * Allocate memory through an allocator.
  *
- * @param key_size Size of keys in bytes
- * @param value_size Size of values in bytes
- * @return Total size of one bucket in bytes
+ * @param allocator The allocator
+ * @param size Number of bytes
+ * @return Pointer to the memory, or NULL on failure
+ */
+static inline void *mem_alloc(const hashmap_allocator *allocator, size_t size)
+{
+    return allocator->alloc(allocator->ctx, size);
+}
+
+/**
+ * Allocate zero-filled memory through an allocator: its zalloc callback if it
+ * has one (calloc for the default allocator), else alloc and memset.
+ *
+ * @param allocator The allocator
+ * @param size Number of bytes
+ * @return Pointer to the zeroed memory, or NULL on failure
+ */
+static void *mem_zalloc(const hashmap_allocator *allocator, size_t size)
+{
+    if (allocator->zalloc)
+    {
+        return allocator->zalloc(allocator->ctx, size);
+    }
+    void *ptr = mem_alloc(allocator, size);
+    if (ptr)
+    {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+/**
+ * Release memory obtained from an allocator. No-op for NULL.
+ *
+ * @param allocator The allocator the memory came from
+ * @param ptr Pointer to the memory
+ * @param size Size passed when the memory was allocated
+ */
+static inline void mem_free(const hashmap_allocator *allocator, void *ptr, size_t size)
+{
+    if (ptr)
+    {
+        allocator->free(allocator->ctx, ptr, size);
+    }
+}
+
+/**
+ * Round a slot size up to its natural alignment (the largest power of 2 <= 8 that
+ * covers it), so every key or value in a bucket can be loaded aligned.
+ *
+ * @param size Size of a key or value in bytes
+ * @return Padded slot stride in bytes
+ */
+static inline size_t padded_stride(size_t size)
+{
+    size_t align = 1;
+    while (align < size && align < 8)
+    {
+        align *= 2;
+    }
+    return (size + align - 1) / align * align;
+}
+
+/**
+ * Compute the bucket layout once and cache it in the map.
+ * Layout: [tophash:8][keys:8*key_stride][values:8*value_stride][overflow:8][padding]
+ * All offsets are multiples of 8, so the overflow pointer is always aligned.
+ * Keys or values over MAX_INLINE_SIZE bytes are stored out of line, leaving a
+ * pointer in the slot, unless HASHMAP_INLINE_LARGE is set.
+ *
+ * @param map The hashmap (key_size and value_size must be set)
+ * @param flags Bitwise OR of LAYOUT_FLAGS bits
  */
-static inline size_t calc_bucket_size(size_t key_size, size_t value_size)
+static void init_layout(hashmap *map, unsigned flags)
 {
-    return BUCKET_SIZE * sizeof(uint8_t) + // tophash array: 8 × 1 byte
-           BUCKET_SIZE * key_size +        // keys: 8 × key_size
-           BUCKET_SIZE * value_size +      // values: 8 × value_size
-           sizeof(char *);                 // overflow pointer
+    map->layout_flags = flags & LAYOUT_FLAGS;
+    bool inline_large = (flags & HASHMAP_INLINE_LARGE) != 0;
+    map->indirect_keys = (flags & HASHMAP_INDIRECT_KEYS) || (!inline_large && map->key_size > MAX_INLINE_SIZE);
+    map->indirect_values =
+        (flags & HASHMAP_INDIRECT_VALUES) || (!inline_large && map->value_size > MAX_INLINE_SIZE);
+    map->key_slot_size = map->indirect_keys ? sizeof(char *) : map->key_size;
+    map->value_slot_size = map->indirect_values ? sizeof(char *) : map->value_size;
+    bool pad = (flags & HASHMAP_PAD_SLOTS) != 0;
+    map->key_stride = pad ? padded_stride(map->key_slot_size) : map->key_slot_size;
+    map->value_stride = pad ? padded_stride(map->value_slot_size) : map->value_slot_size;
+    map->values_offset = BUCKET_SIZE * sizeof(uint8_t) + BUCKET_SIZE * map->key_stride;
+    map->fingerprints_offset = 0;
+    if (flags & HASHMAP_FINGERPRINTS)
+    {
+        // Keys end on an 8-byte boundary, so the fingerprints are aligned
+        map->fingerprints_offset = map->values_offset;
+        map->values_offset += BUCKET_SIZE * sizeof(uint32_t);
+    }
+    map->overflow_offset = map->values_offset + BUCKET_SIZE * map->value_stride;
+    map->bucket_size = map->overflow_offset + sizeof(char *);
+    map->spill_offset = 0;
+    if (flags & HASHMAP_NEIGHBORHOOD)
+    {
+        // One count per neighbor, padded to keep the bucket stride a multiple of 8
+        map->spill_offset = map->bucket_size;
+        map->bucket_size += sizeof(uint64_t);
+    }
+    if (flags & HASHMAP_CACHE_ALIGN)
+    {
+        map->bucket_size = (map->bucket_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    }
 }
 
 /**
  * Get pointer to the i-th bucket in the bucket array
  *
+ * @param map The hashmap (for the cached bucket stride)
  * @param buckets Pointer to the bucket array
- * @param key_size Size of keys in bytes
- * @param value_size Size of values in bytes
  * @param index Index of the bucket to retrieve
  * @return Pointer to the specified bucket
  */
-static inline char *get_bucket(char *buckets, size_t key_size, size_t value_size, size_t index)
+static inline char *get_bucket(const hashmap *map, char *buckets, size_t index)
 {
-    size_t bsize = calc_bucket_size(key_size, value_size);
-    return buckets + (index * bsize);
+    return buckets + (index * map->bucket_size);
 }
 
 /**
@@ -76,437 +459,4020 @@ static inline uint8_t *get_tophash(char *bucket)
 }
 
 /**
- * Get pointer to keys array within a bucket
+ * Get pointer to the i-th key within a bucket
  *
  * @param bucket Pointer to the bucket
- * @return Pointer to the start of the keys array
+ * @param key_stride Bytes per key slot (map->key_stride, or a constant in specialized probes)
+ * @param index Index of the key (0-7)
+ * @return Pointer to the specified key
  */
-static inline char *get_keys(char *bucket)
+static inline char *get_key(char *bucket, size_t key_stride, size_t index)
 {
-    return bucket + 8;
+    assert(index < BUCKET_SIZE);
+    return bucket + BUCKET_SIZE * sizeof(uint8_t) + (index * key_stride);
 }
 
 /**
- * Get pointer to the i-th key within a bucket
+ * Get pointer to the i-th value within a bucket
  *
+ * @param map The hashmap (for the cached values offset and stride)
  * @param bucket Pointer to the bucket
- * @param key_size Size of keys in bytes
- * @param index Index of the key (0-7)
- * @return Pointer to the specified key
+ * @param index Index of the value (0-7)
+ * @return Pointer to the specified value
  */
-static inline char *get_key(char *bucket, size_t key_size, size_t index)
+static inline char *get_value(const hashmap *map, char *bucket, size_t index)
 {
     assert(index < BUCKET_SIZE);
-    return get_keys(bucket) + (index * key_size);
+    return bucket + map->values_offset + (index * map->value_stride);
 }
 
 /**
- * Get pointer to values array within a bucket
+ * Get pointer to the bytes of the i-th key within a bucket: the slot itself, or
+ * the out-of-line object it points to in indirect mode (NULL if not yet stored).
  *
  * @param bucket Pointer to the bucket
- * @param key_size Size of keys in bytes
- * @return Pointer to the start of the values array
+ * @param key_stride Bytes per key slot
+ * @param index Index of the key (0-7)
+ * @param indirect true if key slots hold pointers (map->indirect_keys)
+ * @return Pointer to the key bytes
  */
-static inline char *get_values(char *bucket, size_t key_size)
+static inline char *key_data(char *bucket, size_t key_stride, size_t index, bool indirect)
 {
-    return bucket + 8 + (BUCKET_SIZE * key_size);
+    char *slot = get_key(bucket, key_stride, index);
+    if (indirect)
+    {
+        char *object;
+        memcpy(&object, slot, sizeof(object));
+        return object;
+    }
+    return slot;
 }
 
 /**
- * Get pointer to the i-th value within a bucket
+ * Get pointer to the bytes of the i-th value within a bucket: the slot itself,
+ * or the out-of-line object it points to in indirect mode.
  *
+ * @param map The hashmap
  * @param bucket Pointer to the bucket
- * @param key_size Size of keys in bytes
- * @param value_size Size of values in bytes
  * @param index Index of the value (0-7)
- * @return Pointer to the specified value
+ * @return Pointer to the value bytes
  */
-static inline char *get_value(char *bucket, size_t key_size, size_t value_size, size_t index)
+static inline char *value_data(const hashmap *map, char *bucket, size_t index)
 {
-    assert(index < BUCKET_SIZE);
-    return get_values(bucket, key_size) + (index * value_size);
+    char *slot = get_value(map, bucket, index);
+    if (map->indirect_values)
+    {
+        char *object;
+        memcpy(&object, slot, sizeof(object));
+        return object;
+    }
+    return slot;
 }
 
 /**
- * Get pointer to the overflow pointer within a bucket
+ * Get the overflow bucket (returns NULL if no overflow).
+ * The link is stored as a byte offset from the bucket itself (0: none), so a
+ * bucket array written out together with its overflow buckets stays valid at
+ * whatever address it is mapped.
  *
+ * @param map The hashmap (for the cached overflow offset)
  * @param bucket Pointer to the bucket
- * @param key_size Size of keys in bytes
- * @param value_size Size of values in bytes
- * @return Pointer to the overflow pointer field
+ * @return Pointer to overflow bucket, or NULL if none exists
  */
-static inline char **get_overflow_ptr(char *bucket, size_t key_size, size_t value_size)
+static inline char *get_overflow(const hashmap *map, char *bucket)
 {
-    return (char **)(bucket + 8 + (BUCKET_SIZE * key_size) + BUCKET_SIZE * value_size);
+    intptr_t offset;
+    memcpy(&offset, bucket + map->overflow_offset, sizeof(offset));
+    return offset ? (char *)((uintptr_t)bucket + (uintptr_t)offset) : NULL;
 }
 
 /**
- * Get the overflow bucket (returns NULL if no overflow)
+ * Store a raw overflow link (byte offset from the bucket, 0 for none).
  *
+ * @param map The hashmap (for the cached overflow offset)
  * @param bucket Pointer to the bucket
- * @param key_size Size of keys in bytes
- * @param value_size Size of values in bytes
- * @return Pointer to overflow bucket, or NULL if none exists
+ * @param offset Offset of the overflow bucket relative to bucket
  */
-static inline char *get_overflow(char *bucket, size_t key_size, size_t value_size)
+static inline void set_overflow_offset(const hashmap *map, char *bucket, intptr_t offset)
 {
-    char **overflow_ptr = get_overflow_ptr(bucket, key_size, value_size);
-    return *overflow_ptr;
+    memcpy(bucket + map->overflow_offset, &offset, sizeof(offset));
 }
 
 /**
  * Set the overflow bucket pointer
  *
+ * @param map The hashmap (for the cached overflow offset)
  * @param bucket Pointer to the bucket
- * @param overflow Pointer to the overflow bucket to link
- * @param key_size Size of keys in bytes
- * @param value_size Size of values in bytes
+ * @param overflow Pointer to the overflow bucket to link, or NULL
+ */
+static inline void set_overflow(const hashmap *map, char *bucket, char *overflow)
+{
+    set_overflow_offset(map, bucket, overflow ? (intptr_t)((uintptr_t)overflow - (uintptr_t)bucket) : 0);
+}
+
+/**
+ * Get the spill counts of a head bucket (HASHMAP_NEIGHBORHOOD only): entry d - 1
+ * is the number of its entries stored in the head bucket d places after it.
+ *
+ * @param map The hashmap (for the cached spill offset)
+ * @param bucket Pointer to the head bucket
+ * @return Pointer to NEIGHBOR_BUCKETS counts
+ */
+static inline uint8_t *spill_counts(const hashmap *map, char *bucket)
+{
+    assert(map->spill_offset);
+    return (uint8_t *)(bucket + map->spill_offset);
+}
+
+/**
+ * Index of the bucket a number of places after another, wrapping around the array.
+ *
+ * @param index Bucket index
+ * @param distance Places to move forward (less than bucket_count)
+ * @param bucket_count Number of buckets (power of 2)
+ * @return Index of the neighbor
  */
-static inline void set_overflow(char *bucket, char *overflow, size_t key_size, size_t value_size)
+static inline size_t neighbor_index(size_t index, size_t distance, size_t bucket_count)
 {
-    char **overflow_ptr = get_overflow_ptr(bucket, key_size, value_size);
-    *overflow_ptr = overflow;
+    return (index + distance) & (bucket_count - 1);
 }
 
 /**
  * Extract the top 8 bits of a hash value for use in the tophash array.
- * Returns a value >= 1 (since 0 is reserved for EMPTY).
+ * Returns a value >= MIN_TOP_HASH (smaller values are reserved markers).
  *
  * @param hash The full 64-bit hash value
- * @return Top 8 bits, adjusted to be at least 1
+ * @return Top 8 bits, adjusted to be at least MIN_TOP_HASH
  */
 static inline uint8_t top_hash(uint64_t hash)
 {
     uint8_t top = (uint8_t)(hash >> 56);
-    if (top < 1)
+    if (top < MIN_TOP_HASH)
     {
-        top = 1;
+        top += MIN_TOP_HASH;
     }
     return top;
 }
 
 /**
- * Calculate which bucket a hash value maps to.
- * Uses bitwise AND with (bucket_count - 1) since bucket_count is a power of 2.
+ * Check the fingerprint of a slot whose tophash matched, before comparing keys.
  *
- * @param hash The full 64-bit hash value
- * @param bucket_count Number of buckets (must be power of 2)
- * @return Bucket index in range [0, bucket_count)
+ * @param map The hashmap
+ * @param bucket Pointer to the bucket
+ * @param index Index of the slot (0-7)
+ * @param hash Hash of the key being looked for (in the seed of the bucket's array)
+ * @return true if the slot may hold the key (always, without HASHMAP_FINGERPRINTS)
  */
-static inline size_t bucket_index(uint64_t hash, size_t bucket_count)
+static inline bool fingerprint_matches(const hashmap *map, char *bucket, size_t index, uint64_t hash)
 {
-    // Use lower bits to select bucket (bucket_count is power of 2)
-    return hash & (bucket_count - 1);
+    if (!map->fingerprints_offset)
+    {
+        return true;
+    }
+    uint32_t stored;
+    memcpy(&stored, bucket + map->fingerprints_offset + index * sizeof(uint32_t), sizeof(stored));
+    return stored == (uint32_t)hash;
 }
 
 /**
- * Allocate and initialize a single bucket.
- * All tophash entries are set to EMPTY and overflow pointer is NULL (via calloc).
+ * Record the fingerprint of a slot (no-op without HASHMAP_FINGERPRINTS).
  *
- * @param key_size Size of keys in bytes
- * @param value_size Size of values in bytes
- * @return Pointer to newly allocated bucket, or NULL on allocation failure
+ * @param map The hashmap
+ * @param bucket Pointer to the bucket
+ * @param index Index of the slot (0-7)
+ * @param hash Hash of the key stored in the slot
  */
-static char *alloc_bucket(size_t key_size, size_t value_size)
+static inline void set_fingerprint(const hashmap *map, char *bucket, size_t index, uint64_t hash)
 {
-    size_t bsize = calc_bucket_size(key_size, value_size);
-    char *bucket = (char *)calloc(1, bsize);
-    if (!bucket)
-    {
-        return NULL;
-    }
-    uint8_t *tophash = get_tophash(bucket);
-    for (int i = 0; i < BUCKET_SIZE; i++)
+    if (map->fingerprints_offset)
     {
-        tophash[i] = EMPTY;
+        uint32_t fingerprint = (uint32_t)hash;
+        memcpy(bucket + map->fingerprints_offset + index * sizeof(uint32_t), &fingerprint, sizeof(fingerprint));
     }
-    return bucket;
 }
 
+/*
+ * Tophash slot masks.
+ * A slot_mask has one bit per bucket slot, set when the slot matches. With SSE2
+ * slot i is bit i; the SWAR and NEON paths keep the per-byte high bits instead,
+ * so slot i is bit 8*i+7. Use mask_first()/mask_next() rather than the raw bits.
+ */
+typedef uint64_t slot_mask;
+
+#if defined(__SSE2__)
+#define SLOT_MASK_SHIFT 0
+#define SLOT_MASK_ALL 0xFFull
+#else
+#define SLOT_MASK_SHIFT 3
+#define SLOT_MASK_ALL 0x8080808080808080ull
+#endif
+
 /**
- * Allocate and initialize an array of buckets.
- * All tophash entries in all buckets are set to EMPTY.
+ * Load the 8 tophash bytes of a bucket as a little-endian word (slot i in byte i).
  *
- * @param map The hashmap (used for key_size and value_size)
- * @param count Number of buckets to allocate
- * @return Pointer to newly allocated bucket array, or NULL on allocation failure
+ * @param tophash Pointer to the tophash array
+ * @return The tophash array packed into a 64-bit word
  */
-static char *alloc_buckets(const hashmap *map, size_t count)
+static inline uint64_t load_tophash_word(const uint8_t *tophash)
 {
-    size_t bsize = calc_bucket_size(map->key_size, map->value_size);
-    char *buckets = (char *)calloc(count, bsize);
-    if (!buckets)
-    {
-        return NULL;
-    }
-    for (size_t i = 0; i < count; i++)
-    {
-        char *bucket = get_bucket(buckets, map->key_size, map->value_size, i);
-        uint8_t *tophash = get_tophash(bucket);
-        for (int j = 0; j < BUCKET_SIZE; j++)
-        {
-            tophash[j] = EMPTY;
-        }
-    }
-    return buckets;
+    uint64_t word;
+    memcpy(&word, tophash, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
 }
 
 /**
- * Create a hashmap and allocate necessary memory.
- * Initializes with INITIAL_BUCKET_COUNT buckets.
+ * Find all slots in a bucket whose tophash equals a given byte.
  *
- * @param key_size Size of keys in bytes (must be > 0)
- * @param value_size Size of values in bytes (must be > 0)
- * @param hash Hash function pointer (must not be NULL)
- * @param equals Equality comparison function pointer (must not be NULL)
- * @return Pointer to newly created hashmap, or NULL on failure
+ * @param tophash Pointer to the tophash array (8 bytes)
+ * @param byte Tophash value to look for
+ * @return Mask of matching slots
  */
-hashmap *hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals)
+static inline slot_mask match_tophash(const uint8_t *tophash, uint8_t byte)
 {
-    if (key_size == 0 || value_size == 0 || !hash || !equals)
-    {
-        return NULL;
-    }
-    // Initial allocation on the heap
-    hashmap *map = (hashmap *)malloc(sizeof(hashmap));
-    if (!map)
-    {
-        return NULL;
-    }
+#if defined(__SSE2__)
+    __m128i group = _mm_loadl_epi64((const __m128i *)tophash);
+    __m128i eq = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte));
+    return (slot_mask)(_mm_movemask_epi8(eq) & 0xFF);
+#elif defined(__ARM_NEON)
+    uint8x8_t eq = vceq_u8(vld1_u8(tophash), vdup_n_u8(byte));
+    return vget_lane_u64(vreinterpret_u64_u8(eq), 0) & SLOT_MASK_ALL;
+#else
+    // Exact zero-byte test (no false positives from borrows across bytes)
+    uint64_t x = load_tophash_word(tophash) ^ (0x0101010101010101ull * byte);
+    return ~(((x & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | x) & SLOT_MASK_ALL;
+#endif
+}
 
-    map->key_size = key_size;
-    map->value_size = value_size;
-    map->hash = hash;
-    map->equals = equals;
-    map->bucket_count = INITIAL_BUCKET_COUNT;
-    map->count = 0;
-    map->hash_seed = (uint32_t)time(NULL);
+/**
+ * Find all empty slots (EMPTY_ONE or EMPTY_REST) in a bucket.
+ *
+ * @param tophash Pointer to the tophash array (8 bytes)
+ * @return Mask of empty slots
+ */
+static inline slot_mask match_empty(const uint8_t *tophash)
+{
+    // EMPTY_REST and EMPTY_ONE differ only in bit 0: clear it and look for zero bytes
+#if defined(__SSE2__)
+    __m128i group = _mm_and_si128(_mm_loadl_epi64((const __m128i *)tophash), _mm_set1_epi8((char)0xFE));
+    __m128i eq = _mm_cmpeq_epi8(group, _mm_setzero_si128());
+    return (slot_mask)(_mm_movemask_epi8(eq) & 0xFF);
+#elif defined(__ARM_NEON)
+    uint8x8_t eq = vceq_u8(vand_u8(vld1_u8(tophash), vdup_n_u8(0xFE)), vdup_n_u8(0));
+    return vget_lane_u64(vreinterpret_u64_u8(eq), 0) & SLOT_MASK_ALL;
+#else
+    uint64_t x = load_tophash_word(tophash) & 0xFEFEFEFEFEFEFEFEull;
+    return ~(((x & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | x) & SLOT_MASK_ALL;
+#endif
+}
 
-    map->buckets = alloc_buckets(map, INITIAL_BUCKET_COUNT);
-    if (!map->buckets)
-    {
-        free(map);
-        return NULL;
-    }
-    map->old_buckets = NULL;
-    map->old_bucket_count = 0;
-    map->evacuated = 0;
+/**
+ * Check whether a bucket ends its chain's occupied region, i.e. holds an EMPTY_REST slot.
+ * No later slot in the bucket or its overflow chain is occupied in that case.
+ *
+ * @param tophash Pointer to the tophash array (8 bytes)
+ * @return true if probing can stop after this bucket
+ */
+static inline bool has_empty_rest(const uint8_t *tophash)
+{
+    // EMPTY_REST slots are always a suffix, so checking the last slot is enough
+    return tophash[BUCKET_SIZE - 1] == EMPTY_REST;
+}
 
-    return map;
+/**
+ * Find all occupied slots in a bucket.
+ *
+ * @param tophash Pointer to the tophash array (8 bytes)
+ * @return Mask of occupied slots
+ */
+static inline slot_mask match_full(const uint8_t *tophash)
+{
+    return match_empty(tophash) ^ SLOT_MASK_ALL;
 }
 
 /**
- * Free all overflow buckets in a chain starting from the given bucket.
- * Does not free the bucket itself, only its overflow chain.
+ * Index of the lowest slot set in a non-empty mask.
  *
- * @param bucket Pointer to the bucket whose overflow chain should be freed
- * @param key_size Size of keys in bytes
- * @param value_size Size of values in bytes
+ * @param mask Non-zero slot mask
+ * @return Slot index (0-7)
  */
-static void free_overflow_chain(char *bucket, size_t key_size, size_t value_size)
+static inline int mask_first(slot_mask mask)
 {
-    char *overflow = get_overflow(bucket, key_size, value_size);
-    while (overflow)
-    {
-        char *next = get_overflow(overflow, key_size, value_size);
-        free(overflow);
-        overflow = next;
-    }
+    return __builtin_ctzll(mask) >> SLOT_MASK_SHIFT;
 }
 
 /**
- * Destroy a hashmap and free all associated memory.
- * Frees all buckets, overflow chains, and the hashmap structure itself.
- * Safe to call with NULL pointer (no-op).
+ * Clear the lowest slot set in a non-empty mask.
  *
- * @param map Pointer to the hashmap to destroy
+ * @param mask Non-zero slot mask
+ * @return The mask without its lowest slot
  */
-void hashmap_destroy(hashmap *map)
+static inline slot_mask mask_next(slot_mask mask)
 {
-    if (!map)
+    return mask & (mask - 1);
+}
+
+/**
+ * Hash a key with a given seed.
+ * The bundled integer hashes are called directly so they can be inlined; the
+ * result of an unseeded hash_fn is mixed with the seed, which also spreads
+ * weak user hashes over all 64 bits.
+ *
+ * @param map The hashmap
+ * @param key Pointer to the key
+ * @param seed Seed to hash with
+ * @return 64-bit seeded hash
+ */
+static inline uint64_t map_hash_seeded(const hashmap *map, const void *key, uint64_t seed)
+{
+    if (map->seeded_hash == hashmap_hash_u64)
     {
-        return;
+        return hashmap_hash_u64(key, sizeof(uint64_t), seed);
     }
-    if (map->buckets)
+    if (map->seeded_hash == hashmap_hash_u32)
     {
-        for (size_t i = 0; i < map->bucket_count; i++)
-        {
-            char *bucket = get_bucket(map->buckets, map->key_size, map->value_size, i);
-            free_overflow_chain(bucket, map->key_size, map->value_size);
-        }
-        free(map->buckets);
+        return hashmap_hash_u32(key, sizeof(uint32_t), seed);
     }
-    if (map->old_buckets)
+    if (map->seeded_hash)
     {
-        for (size_t i = 0; i < map->old_bucket_count; i++)
-        {
-            char *bucket = get_bucket(map->old_buckets, map->key_size, map->value_size, i);
-            free_overflow_chain(bucket, map->key_size, map->value_size);
-        }
-        free(map->old_buckets);
+        return map->seeded_hash(key, map->key_size, seed);
     }
-    free(map);
+    uint64_t hash = map->hash(key, map->key_size);
+    return hashmap_hash_u64(&hash, sizeof(hash), seed);
 }
 
 /**
- * Insert or update a key-value pair in the hashmap.
- * If key exists, its value is updated. Otherwise, a new entry is created.
- * May allocate overflow buckets if the target bucket is full.
- * Checks load factor after insertion (growth not yet implemented).
+ * Hash a key with the map's seed.
  *
- * @param map Pointer to the hashmap
- * @param key Pointer to the key to insert
- * @param value Pointer to the value to associate with the key
- * @return true on success, false on failure (NULL parameters or allocation failure)
+ * @param map The hashmap
+ * @param key Pointer to the key
+ * @return 64-bit seeded hash
  */
-bool hashmap_put(hashmap *map, const void *key, const void *value)
+static inline uint64_t map_hash(const hashmap *map, const void *key)
+{
+    return map_hash_seeded(map, key, map->hash_seed);
+}
+
+/**
+ * Hash of a key in the layout of old_buckets: the key's hash, except while a
+ * reseed is being evacuated, when the old array still follows the previous seed.
+ *
+ * @param map The hashmap (must be growing)
+ * @param key Pointer to the key
+ * @param hash map_hash(map, key)
+ * @return Hash locating the key in old_buckets
+ */
+static inline uint64_t old_array_hash(const hashmap *map, const void *key, uint64_t hash)
+{
+    return map->old_seed == map->hash_seed ? hash : map_hash_seeded(map, key, map->old_seed);
+}
+
+/**
+ * Compare a stored key with a probe key.
+ * Without a user equals function the keys are compared bytewise: 4, 8 and 16-byte
+ * keys as integer words, other sizes with memcmp. Callers pass a constant key_size
+ * from a size-specialized probe loop so the switch folds away.
+ *
+ * @param map The hashmap
+ * @param stored Pointer to the key stored in a bucket
+ * @param key Pointer to the probe key
+ * @param key_size Size of keys in bytes (equal to map->key_size)
+ * @return true if the keys are equal
+ */
+static ALWAYS_INLINE bool keys_equal(const hashmap *map, const void *stored, const void *key, size_t key_size)
+{
+    if (map->equals)
+    {
+        return map->equals(stored, key, key_size);
+    }
+    switch (key_size)
+    {
+    case sizeof(uint32_t):
+    {
+        uint32_t a, b;
+        memcpy(&a, stored, sizeof(a));
+        memcpy(&b, key, sizeof(b));
+        return a == b;
+    }
+    case sizeof(uint64_t):
+    {
+        uint64_t a, b;
+        memcpy(&a, stored, sizeof(a));
+        memcpy(&b, key, sizeof(b));
+        return a == b;
+    }
+    case 2 * sizeof(uint64_t):
+    {
+        uint64_t a[2], b[2];
+        memcpy(a, stored, sizeof(a));
+        memcpy(b, key, sizeof(b));
+        return ((a[0] ^ b[0]) | (a[1] ^ b[1])) == 0;
+    }
+    default:
+        return memcmp(stored, key, key_size) == 0;
+    }
+}
+
+/**
+ * Find the slot of a single bucket holding a key (overflow buckets are not followed).
+ *
+ * @param map Pointer to the hashmap
+ * @param bucket Pointer to the bucket
+ * @param hash Hash of the key (in the seed of the bucket's array)
+ * @param key Pointer to the key to search for
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @param counted true to add the key compares to the lookup statistics
+ * @return Slot index, or -1 if the bucket does not hold the key
+ */
+static ALWAYS_INLINE int bucket_match_sized(const hashmap *map, char *bucket, uint64_t hash, const void *key,
+                                            size_t key_size, bool counted)
+{
+    bool indirect = !key_size && map->indirect_keys;
+    size_t key_stride = key_size ? key_size : map->key_stride;
+    key_size = key_size ? key_size : map->key_size;
+    for (slot_mask match = match_tophash(get_tophash(bucket), top_hash(hash)); match; match = mask_next(match))
+    {
+        int i = mask_first(match);
+        if (!fingerprint_matches(map, bucket, i, hash))
+        {
+            continue;
+        }
+        char *stored_key = key_data(bucket, key_stride, i, indirect);
+        // A reader racing an insert may see the tophash before the key pointer
+        if (indirect && !stored_key)
+        {
+            continue;
+        }
+        if (counted)
+        {
+            STAT_ADD(map, key_compares, 1);
+        }
+        if (keys_equal(map, stored_key, key, key_size))
+        {
+            return i;
+        }
+        if (counted)
+        {
+            STAT_ADD(map, false_positives, 1);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Dispatch a size-specialized probe: calls fn_sized with a constant key size for
+ * bytewise-compared 4, 8 and 16-byte keys, and with 0 (use map->key_size) otherwise.
+ * Padding never changes the stride of 4, 8 or 16-byte keys, so specialized probes
+ * can use the constant as the key stride too.
+ */
+#define DISPATCH_KEY_SIZE(map, fn_sized, ...)                                                                         \
+    do                                                                                                                \
+    {                                                                                                                 \
+        if (!(map)->equals && !(map)->indirect_keys)                                                                  \
+        {                                                                                                             \
+            switch ((map)->key_size)                                                                                  \
+            {                                                                                                         \
+            case sizeof(uint32_t):                                                                                    \
+                return fn_sized(__VA_ARGS__, sizeof(uint32_t));                                                       \
+            case sizeof(uint64_t):                                                                                    \
+                return fn_sized(__VA_ARGS__, sizeof(uint64_t));                                                       \
+            case 2 * sizeof(uint64_t):                                                                                \
+                return fn_sized(__VA_ARGS__, 2 * sizeof(uint64_t));                                                   \
+            }                                                                                                         \
+        }                                                                                                             \
+        return fn_sized(__VA_ARGS__, 0);                                                                              \
+    } while (0)
+
+/**
+ * Pick the bundled hash for a key size.
+ *
+ * @param key_size Size of keys in bytes
+ * @return hashmap_hash_u32/u64 for 4/8-byte keys, otherwise hashmap_hash_bytes
+ */
+static seeded_hash_fn default_hash(size_t key_size)
+{
+    switch (key_size)
+    {
+    case sizeof(uint32_t):
+        return hashmap_hash_u32;
+    case sizeof(uint64_t):
+        return hashmap_hash_u64;
+    default:
+        return hashmap_hash_bytes;
+    }
+}
+
+/**
+ * Calculate which bucket a hash value maps to.
+ * Uses bitwise AND with (bucket_count - 1) since bucket_count is a power of 2.
+ *
+ * @param hash The full 64-bit hash value
+ * @param bucket_count Number of buckets (must be power of 2)
+ * @return Bucket index in range [0, bucket_count)
+ */
+static inline size_t bucket_index(uint64_t hash, size_t bucket_count)
+{
+    // Use lower bits to select bucket (bucket_count is power of 2)
+    return hash & (bucket_count - 1);
+}
+
+/**
+ * Check whether holding a number of entries in a bucket array would exceed the load factor.
+ *
+ * @param count Number of entries
+ * @param bucket_count Number of buckets
+ * @return true if count entries are more than bucket_count buckets may hold
+ */
+static inline bool over_load_factor(size_t count, size_t bucket_count)
+{
+    // 6.5 entries per bucket on average, as in Go (not 6.5 per slot)
+    return count * LOAD_FACTOR_DENOMINATOR > bucket_count * LOAD_FACTOR_NUMERATOR;
+}
+
+/**
+ * Calculate the smallest power-of-2 bucket count that holds a number of
+ * entries without exceeding the load factor (never below INITIAL_BUCKET_COUNT).
+ *
+ * @param capacity Expected number of entries
+ * @return Bucket count, or 0 if capacity is too large to represent
+ */
+static size_t buckets_for_capacity(size_t capacity)
+{
+    if (capacity > SIZE_MAX / LOAD_FACTOR_DENOMINATOR)
+    {
+        return 0;
+    }
+    size_t count = INITIAL_BUCKET_COUNT;
+    while (over_load_factor(capacity, count))
+    {
+        if (count > SIZE_MAX / (2 * LOAD_FACTOR_NUMERATOR))
+        {
+            return 0;
+        }
+        count *= 2;
+    }
+    return count;
+}
+
+/**
+ * Initialize an empty object pool. No memory is allocated until the first pool_alloc().
+ *
+ * @param pool Pointer to the pool
+ * @param allocator Allocator for the slabs (must outlive the pool)
+ * @param object_size Size of each object in bytes
+ * @param align Alignment of objects (power of 2); objects are aligned to it if
+ *              object_size is a multiple of it
+ */
+static void pool_init(struct slab_pool *pool, const hashmap_allocator *allocator, size_t object_size, size_t align)
+{
+    pool->allocator = allocator;
+    pool->align = align;
+    // Objects must hold the free-list link and keep it aligned
+    size_t word = sizeof(char *);
+    pool->object_size = object_size < word ? word : (object_size + word - 1) / word * word;
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->cursor = NULL;
+    pool->end = NULL;
+    pool->next_slab_objects = SLAB_MIN_OBJECTS;
+}
+
+/**
+ * Allocate one zero-filled object from a pool.
+ * Reuses a freed object if one is available, otherwise carves one from the
+ * newest slab, allocating a new slab when it is exhausted.
+ *
+ * @param pool Pointer to the pool
+ * @return Pointer to the object, or NULL on allocation failure
+ */
+static char *pool_alloc(struct slab_pool *pool)
+{
+    if (pool->free_list)
+    {
+        char *object = pool->free_list;
+        memcpy(&pool->free_list, object, sizeof(char *));
+        memset(object, 0, pool->object_size);
+        return object;
+    }
+
+    if (pool->cursor == pool->end)
+    {
+        size_t objects = pool->next_slab_objects;
+        size_t size = sizeof(struct slab) + pool->align - 1 + objects * pool->object_size;
+        // Slabs are zero-filled, so carved objects need no memset
+        struct slab *slab = (struct slab *)mem_zalloc(pool->allocator, size);
+        if (!slab)
+        {
+            return NULL;
+        }
+        slab->next = pool->slabs;
+        slab->size = size;
+        pool->slabs = slab;
+        uintptr_t first = ((uintptr_t)(slab + 1) + pool->align - 1) & ~(uintptr_t)(pool->align - 1);
+        pool->cursor = (char *)first;
+        pool->end = pool->cursor + objects * pool->object_size;
+        if (objects < SLAB_MAX_OBJECTS)
+        {
+            pool->next_slab_objects = objects * 2;
+        }
+    }
+
+    char *object = pool->cursor;
+    pool->cursor += pool->object_size;
+    return object;
+}
+
+/**
+ * Return an object to its pool's free list.
+ *
+ * @param pool Pointer to the pool the object was allocated from
+ * @param object Pointer to the object
+ */
+static void pool_free(struct slab_pool *pool, char *object)
+{
+    memcpy(object, &pool->free_list, sizeof(char *));
+    pool->free_list = object;
+}
+
+/**
+ * Release every slab of a pool, invalidating all of its objects.
+ *
+ * @param pool Pointer to the pool
+ */
+static void pool_destroy(struct slab_pool *pool)
+{
+    struct slab *slab = pool->slabs;
+    while (slab)
+    {
+        struct slab *next = slab->next;
+        mem_free(pool->allocator, slab, slab->size);
+        slab = next;
+    }
+    pool_init(pool, pool->allocator, pool->object_size, pool->align);
+}
+
+/**
+ * Allocate and initialize a single overflow bucket from the map's slab pool.
+ * All tophash entries are EMPTY_REST and the overflow pointer is NULL (zero-filled).
+ *
+ * @param map The hashmap owning the overflow pool
+ * @return Pointer to newly allocated bucket, or NULL on allocation failure
+ */
+static char *alloc_bucket(hashmap *map)
+{
+    if (map->pool_lock)
+    {
+        pthread_mutex_lock(map->pool_lock);
+        char *bucket = pool_alloc(&map->overflow_pool);
+        pthread_mutex_unlock(map->pool_lock);
+        return bucket;
+    }
+    return pool_alloc(&map->overflow_pool);
+}
+
+/**
+ * Check whether a bucket array allocation is mapped from the kernel for page
+ * placement instead of coming from the allocator. Depends only on the map's
+ * options and the size, so alloc_buckets() and free_buckets() always agree.
+ *
+ * @param map The hashmap
+ * @param size Bytes of the allocation (the array plus its alignment line)
+ * @return true if the allocation is made by map_bucket_pages()
+ */
+static bool buckets_mapped(const hashmap *map, size_t size)
+{
+#if defined(__linux__)
+    return (map->huge_pages || map->numa_mode) && size >= HUGE_PAGE_SIZE;
+#else
+    (void)map;
+    (void)size;
+    return false;
+#endif
+}
+
+#if defined(__linux__)
+/**
+ * Map anonymous memory on explicit huge pages from the hugetlbfs pool.
+ *
+ * @param size Bytes needed
+ * @param log2_page_size log2 of the huge page size (21 for 2 MB, 30 for 1 GB)
+ * @param length_out Receives the mapped length (size rounded up to the page size)
+ * @return Start of the mapping, or NULL if the pool has no room
+ */
+static char *map_hugetlb(size_t size, int log2_page_size, size_t *length_out)
+{
+    size_t page_size = (size_t)1 << log2_page_size;
+    size_t length = (size + page_size - 1) & ~(page_size - 1);
+    void *raw = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_PAGE_BITS(log2_page_size), -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        return NULL;
+    }
+    *length_out = length;
+    return raw;
+}
+
+/**
+ * Map anonymous memory starting on a 2 MB boundary, so transparent huge pages
+ * can back all of it: maps one huge page more than needed and unmaps the ends.
+ *
+ * @param size Bytes needed
+ * @param length_out Receives the mapped length (size rounded up to HUGE_PAGE_SIZE)
+ * @return Start of the mapping, or NULL on failure
+ */
+static char *map_aligned(size_t size, size_t *length_out)
+{
+    size_t length = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    char *raw = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        return NULL;
+    }
+    size_t head = (HUGE_PAGE_SIZE - (uintptr_t)raw % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+    if (head)
+    {
+        munmap(raw, head);
+    }
+    // head < HUGE_PAGE_SIZE, so there is always a tail to release
+    munmap(raw + head + length, HUGE_PAGE_SIZE - head);
+    *length_out = length;
+    return raw + head;
+}
+
+/**
+ * Apply the map's NUMA policy to a fresh mapping, before any of its pages are
+ * touched. Best effort: without NUMA support in the kernel, or for nodes the
+ * process may not use, the pages keep first-touch placement.
+ *
+ * @param map The hashmap
+ * @param raw Start of the mapping
+ * @param length Length of the mapping
+ */
+static void place_pages(const hashmap *map, char *raw, size_t length)
+{
+#if defined(SYS_mbind) && defined(SYS_get_mempolicy)
+    if (!map->numa_mode)
+    {
+        return;
+    }
+    unsigned long nodes = map->numa_nodes;
+    // One more than the bits in the mask: the kernel ignores the last bit
+    unsigned long max_node = 8 * sizeof(nodes) + 1;
+    if (!nodes)
+    {
+        int mode;
+        if (syscall(SYS_get_mempolicy, &mode, &nodes, max_node, NULL, NUMA_MPOL_F_MEMS_ALLOWED) != 0)
+        {
+            return;
+        }
+    }
+    syscall(SYS_mbind, raw, length, map->numa_mode, &nodes, max_node, 0);
+#else
+    (void)map;
+    (void)raw;
+    (void)length;
+#endif
+}
+#endif
+
+/**
+ * Map a bucket array allocation from the kernel per the map's page placement
+ * options: on 1 GB, then 2 MB pages from the hugetlbfs pool, else 2 MB aligned
+ * and advised for transparent huge pages, with the NUMA policy applied before
+ * the pages are first touched. The mapping is zero-filled; its length is kept
+ * in its first word (the array starts a cache line in).
+ *
+ * @param map The hashmap
+ * @param size Bytes of the allocation (the array plus its alignment line)
+ * @return Start of the mapping, or NULL on failure
+ */
+static char *map_bucket_pages(const hashmap *map, size_t size)
+{
+#if defined(__linux__)
+    if (size > SIZE_MAX / 2)
+    {
+        return NULL;
+    }
+    size_t length = 0;
+    char *raw = NULL;
+    if (map->huge_pages && size >= GIANT_PAGE_SIZE)
+    {
+        raw = map_hugetlb(size, 30, &length);
+    }
+    if (!raw && map->huge_pages)
+    {
+        raw = map_hugetlb(size, 21, &length);
+    }
+    if (!raw)
+    {
+        raw = map_aligned(size, &length);
+        if (!raw)
+        {
+            return NULL;
+        }
+#if defined(MADV_HUGEPAGE)
+        if (map->huge_pages)
+        {
+            // Without transparent huge pages enabled this is refused and the pages stay small
+            madvise(raw, length, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    place_pages(map, raw, length);
+    memcpy(raw, &length, sizeof(length));
+    return raw;
+#else
+    (void)map;
+    (void)size;
+    return NULL;
+#endif
+}
+
+/**
+ * Allocate an array of empty buckets, aligned to CACHE_LINE_SIZE.
+ * The memory is zero-filled, which makes every tophash EMPTY_REST and every
+ * overflow pointer NULL, so nothing is written to it here: with zero pages from
+ * the OS (calloc, mmap) a new array only becomes resident as entries move in.
+ * The allocation is over-sized by one cache line; the distance from the start of
+ * the allocation to the aligned array is kept in the byte just before the array.
+ * Large arrays of maps with page placement options are mapped by
+ * map_bucket_pages() instead of coming from the allocator.
+ *
+ * @param map The hashmap (used for the bucket layout)
+ * @param count Number of buckets to allocate
+ * @return Pointer to newly allocated bucket array, or NULL on allocation failure
+ */
+static char *alloc_buckets(const hashmap *map, size_t count)
+{
+    if (count > (SIZE_MAX - CACHE_LINE_SIZE) / map->bucket_size)
+    {
+        return NULL;
+    }
+    size_t size = count * map->bucket_size + CACHE_LINE_SIZE;
+    char *raw = buckets_mapped(map, size) ? map_bucket_pages(map, size) : (char *)mem_zalloc(&map->allocator, size);
+    if (!raw)
+    {
+        return NULL;
+    }
+    size_t shift = CACHE_LINE_SIZE - (uintptr_t)raw % CACHE_LINE_SIZE; // In [1, CACHE_LINE_SIZE]
+    char *buckets = raw + shift;
+    buckets[-1] = (char)(shift - 1);
+    return buckets;
+}
+
+/**
+ * Free a bucket array allocated by alloc_buckets(). No-op for NULL.
+ * Does not touch overflow chains.
+ *
+ * @param map The hashmap the array belongs to
+ * @param buckets Pointer to the bucket array
+ * @param count Number of buckets in the array
+ */
+static void free_buckets(const hashmap *map, char *buckets, size_t count)
+{
+    if (map->mapping && (uintptr_t)buckets - (uintptr_t)map->mapping < map->mapping_size)
+    {
+        // Part of a snapshot mapping, released by hashmap_destroy()
+        return;
+    }
+    if (buckets)
+    {
+        size_t size = count * map->bucket_size + CACHE_LINE_SIZE;
+        char *raw = buckets - ((unsigned char)buckets[-1] + 1);
+        if (buckets_mapped(map, size))
+        {
+            // Mapped arrays skip allocator.free, so let its owner drain readers here
+            if (map->unmap_wait)
+            {
+                map->unmap_wait(map->unmap_wait_ctx);
+            }
+            size_t length;
+            memcpy(&length, raw, sizeof(length));
+            munmap(raw, length);
+        }
+        else
+        {
+            mem_free(&map->allocator, raw, size);
+        }
+    }
+}
+
+/**
+ * Create a hashmap and allocate necessary memory.
+ * Initializes with INITIAL_BUCKET_COUNT buckets.
+ *
+ * @param key_size Size of keys in bytes (must be > 0)
+ * @param value_size Size of values in bytes (must be > 0)
+ * @param hash Hash function pointer, or NULL for a bundled hash picked by key_size
+ * @param equals Equality comparison function pointer, or NULL to compare keys bytewise
+ * @return Pointer to newly created hashmap, or NULL on failure
+ */
+hashmap *hashmap_create(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals)
+{
+    return hashmap_create_with_capacity(key_size, value_size, hash, equals, 0);
+}
+
+/**
+ * Create a hashmap sized to hold a number of entries without growing.
+ * The bucket count is the smallest power of 2 that keeps capacity entries
+ * within the load factor.
+ *
+ * @param key_size Size of keys in bytes (must be > 0)
+ * @param value_size Size of values in bytes (must be > 0)
+ * @param hash Hash function pointer, or NULL for a bundled hash picked by key_size
+ * @param equals Equality comparison function pointer, or NULL to compare keys bytewise
+ * @param capacity Expected number of entries
+ * @return Pointer to newly created hashmap, or NULL on failure
+ */
+hashmap *hashmap_create_with_capacity(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                                      size_t capacity)
+{
+    hashmap_options options = {0};
+    options.capacity = capacity;
+    return hashmap_create_ex(key_size, value_size, hash, equals, &options);
+}
+
+/**
+ * Create a hashmap with explicit options.
+ * All memory (the map structure, bucket arrays and overflow slabs) is obtained
+ * from options->allocator when one is given, otherwise from malloc/calloc/free.
+ * options->seeded_hash, when set, replaces hash and receives the map's seed.
+ *
+ * @param key_size Size of keys in bytes (must be > 0)
+ * @param value_size Size of values in bytes (must be > 0)
+ * @param hash Hash function pointer, or NULL for a bundled hash picked by key_size
+ * @param equals Equality comparison function pointer, or NULL to compare keys bytewise
+ * @param options Creation options, or NULL for defaults
+ * @return Pointer to newly created hashmap, or NULL on failure
+ */
+hashmap *hashmap_create_ex(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                           const hashmap_options *options)
+{
+    static const hashmap_options default_options = {0};
+    if (!options)
+    {
+        options = &default_options;
+    }
+    const hashmap_allocator *allocator = options->allocator ? options->allocator : &hashmap_default_allocator;
+    if (key_size == 0 || value_size == 0 || !allocator->alloc || !allocator->free)
+    {
+        return NULL;
+    }
+    size_t bucket_count = buckets_for_capacity(options->capacity);
+    if (bucket_count == 0)
+    {
+        return NULL;
+    }
+    // Initial allocation on the heap
+    hashmap *map = (hashmap *)mem_alloc(allocator, sizeof(hashmap));
+    if (!map)
+    {
+        return NULL;
+    }
+
+    map->key_size = key_size;
+    map->value_size = value_size;
+    map->hash = options->seeded_hash ? NULL : hash;
+    map->seeded_hash = options->seeded_hash;
+    if (!map->hash && !map->seeded_hash)
+    {
+        map->seeded_hash = default_hash(key_size);
+    }
+    map->equals = equals;
+    init_layout(map, options->flags);
+    map->bucket_count = bucket_count;
+    map->count = 0;
+    map->hash_seed = hashmap_random_seed(map);
+    map->old_seed = map->hash_seed;
+    map->reseed_enabled = !(options->flags & HASHMAP_NO_RESEED);
+    map->flood_pending = false;
+    map->reseed_bucket_count = 0;
+    map->allocator = *allocator;
+    map->huge_pages = (options->flags & HASHMAP_HUGE_PAGES) != 0;
+    map->numa_mode = (options->flags & HASHMAP_NUMA_INTERLEAVE) ? NUMA_MPOL_INTERLEAVE
+                     : options->numa_nodes                    ? NUMA_MPOL_BIND
+                                                              : 0;
+    map->numa_nodes = options->numa_nodes;
+    map->unmap_wait = NULL;
+    map->unmap_wait_ctx = NULL;
+
+    map->buckets = alloc_buckets(map, bucket_count);
+    if (!map->buckets)
+    {
+        mem_free(allocator, map, sizeof(hashmap));
+        return NULL;
+    }
+    map->old_buckets = NULL;
+    map->old_bucket_count = 0;
+    map->evacuated = 0;
+    map->evacuation_threads = options->evacuation_threads;
+    map->parallel_pending = false;
+    map->evacuation_foreground = false;
+    map->evacuation_pool = NULL;
+    map->job = NULL;
+    map->pool_lock = NULL;
+    map->mapping = NULL;
+    map->mapping_size = 0;
+    map->pool_retired = false;
+    map->shrink_percent = options->shrink_percent > 100 ? 100 : options->shrink_percent;
+    hashmap_stats_reset(map);
+    pool_init(&map->overflow_pool, &map->allocator, map->bucket_size,
+              (options->flags & HASHMAP_CACHE_ALIGN) ? CACHE_LINE_SIZE : sizeof(char *));
+    if (map->indirect_keys)
+    {
+        pool_init(&map->key_pool, &map->allocator, map->key_size, sizeof(char *));
+    }
+    if (map->indirect_values)
+    {
+        pool_init(&map->value_pool, &map->allocator, map->value_size, sizeof(char *));
+    }
+
+    return map;
+}
+
+/**
+ * Seeded hash of a key, as used for bucket selection.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key
+ * @return 64-bit hash
+ */
+uint64_t hashmap_key_hash(const hashmap *map, const void *key)
+{
+    return map_hash(map, key);
+}
+
+/**
+ * Hash of a key under any seed, as the map would compute it with that seed.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key
+ * @param seed Seed to hash with
+ * @return 64-bit hash
+ */
+uint64_t hashmap_key_hash_seeded(const hashmap *map, const void *key, uint64_t seed)
+{
+    return map_hash_seeded(map, key, seed);
+}
+
+/**
+ * Return the seed mixed into every key hash.
+ *
+ * @param map Pointer to the hashmap
+ * @return Hash seed
+ */
+uint64_t hashmap_seed(const hashmap *map)
+{
+    return map->hash_seed;
+}
+
+/**
+ * Replace the random hash seed, so that several maps hash keys identically
+ * (until one of them reseeds).
+ *
+ * @param map Pointer to the hashmap (must be empty)
+ * @param seed New seed
+ */
+void hashmap_set_seed(hashmap *map, uint64_t seed)
+{
+    assert(map->count == 0);
+    map->hash_seed = seed;
+    map->old_seed = seed;
+}
+
+/**
+ * Report whether a hash flood was seen since the last call while reseeding
+ * was off, so that the owner can rebuild the map with another seed.
+ *
+ * @param map Pointer to the hashmap
+ * @return true once per recorded flood
+ */
+bool hashmap_take_flood(hashmap *map)
+{
+    bool flooded = map->flood_pending;
+    map->flood_pending = false;
+    return flooded;
+}
+
+/**
+ * Set a callback to run before the map unmaps a bucket array it mapped itself,
+ * so that owners running lock-free readers can wait for them first.
+ *
+ * @param map Pointer to the hashmap
+ * @param wait Callback, or NULL for none
+ * @param ctx Argument passed to wait
+ */
+void hashmap_set_unmap_wait(hashmap *map, void (*wait)(void *ctx), void *ctx)
+{
+    map->unmap_wait = wait;
+    map->unmap_wait_ctx = ctx;
+}
+
+/**
+ * Have parallel evacuations complete within the mutation that starts them
+ * instead of running in the background.
+ *
+ * @param map Pointer to the hashmap
+ */
+void hashmap_set_foreground_evacuation(hashmap *map)
+{
+    map->evacuation_foreground = true;
+}
+
+/**
+ * Return the number of entries in the hashmap.
+ *
+ * @param map Pointer to the hashmap
+ * @return Number of entries (0 for NULL)
+ */
+size_t hashmap_size(const hashmap *map)
+{
+    return map ? map->count : 0;
+}
+
+/**
+ * Return all overflow buckets in a chain starting from the given bucket to the
+ * map's overflow pool. Does not free the bucket itself, only its overflow chain,
+ * and leaves the bucket's overflow pointer untouched.
+ * During a rebuild the old array's chains belong to the retired pool, which is
+ * freed whole, so nothing is done.
+ *
+ * @param map The hashmap owning the overflow pool
+ * @param bucket Pointer to the bucket whose overflow chain should be freed
+ */
+static void free_overflow_chain(hashmap *map, char *bucket)
+{
+    char *overflow = get_overflow(map, bucket);
+    if (!overflow || map->pool_retired)
+    {
+        return;
+    }
+    if (map->pool_lock)
+    {
+        pthread_mutex_lock(map->pool_lock);
+    }
+    while (overflow)
+    {
+        char *next = get_overflow(map, overflow);
+        pool_free(&map->overflow_pool, overflow);
+        overflow = next;
+    }
+    if (map->pool_lock)
+    {
+        pthread_mutex_unlock(map->pool_lock);
+    }
+}
+
+/**
+ * Return the overflow chains of every bucket in a bucket array to the pool.
+ * Does not free the bucket array itself.
+ *
+ * @param map The hashmap owning the overflow pool
+ * @param buckets Pointer to the bucket array
+ * @param count Number of buckets in the array
+ */
+static void free_overflow_chains(hashmap *map, char *buckets, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        char *bucket = get_bucket(map, buckets, i);
+        free_overflow_chain(map, bucket);
+    }
+}
+
+/**
+ * Size of an evacuation pool with the map's evacuation_threads workers.
+ *
+ * @param map The hashmap
+ * @return Bytes allocated for the pool
+ */
+static size_t evacuation_pool_size(const hashmap *map)
+{
+    return sizeof(struct evacuation_pool) + map->evacuation_threads * sizeof(struct evacuation_worker);
+}
+
+/**
+ * End the current parallel evacuation: close it to the workers, wait until
+ * none is still inside it and release its chunk states. Every chunk must be
+ * CHUNK_DONE.
+ *
+ * @param map The hashmap (with a job in progress)
+ */
+static void end_job(hashmap *map)
+{
+    struct evacuation_pool *pool = map->evacuation_pool;
+    pthread_mutex_lock(&pool->lock);
+    pool->active = false;
+    while (pool->busy)
+    {
+        pthread_cond_wait(&pool->changed, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    mem_free(&map->allocator, map->job->chunks, map->job->chunk_count * sizeof(atomic_uchar));
+    map->job = NULL;
+    map->pool_lock = NULL;
+}
+
+/**
+ * Stop and join the workers of the map's evacuation pool and free it. A job
+ * still in progress is abandoned: chunks nobody has claimed are marked done
+ * without being moved, and those being moved are waited for.
+ *
+ * @param map The hashmap (with a pool)
+ */
+static void evacuation_pool_destroy(hashmap *map)
+{
+    struct evacuation_pool *pool = map->evacuation_pool;
+    if (map->job)
+    {
+        for (size_t i = 0; i < map->job->chunk_count; i++)
+        {
+            unsigned char expected = CHUNK_PENDING;
+            atomic_compare_exchange_strong(&map->job->chunks[i], &expected, CHUNK_DONE);
+        }
+        end_job(map);
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < pool->worker_count; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&pool->changed);
+    pthread_mutex_destroy(&pool->lock);
+    mem_free(&map->allocator, pool, evacuation_pool_size(map));
+    map->evacuation_pool = NULL;
+}
+
+/**
+ * Destroy a hashmap and free all associated memory.
+ * Frees both bucket arrays, the overflow slabs, and the hashmap structure itself.
+ * Overflow chains are not walked: their buckets live in the slabs.
+ * Safe to call with NULL pointer (no-op).
+ *
+ * @param map Pointer to the hashmap to destroy
+ */
+void hashmap_destroy(hashmap *map)
+{
+    if (!map)
+    {
+        return;
+    }
+    if (map->evacuation_pool)
+    {
+        evacuation_pool_destroy(map);
+    }
+    free_buckets(map, map->buckets, map->bucket_count);
+    free_buckets(map, map->old_buckets, map->old_bucket_count);
+    pool_destroy(&map->overflow_pool);
+    if (map->pool_retired)
+    {
+        pool_destroy(&map->retired_pool);
+    }
+    if (map->indirect_keys)
+    {
+        pool_destroy(&map->key_pool);
+    }
+    if (map->indirect_values)
+    {
+        pool_destroy(&map->value_pool);
+    }
+    if (map->mapping)
+    {
+        munmap(map->mapping, map->mapping_size);
+    }
+    // Copy the allocator out: it lives inside the memory being freed
+    hashmap_allocator allocator = map->allocator;
+    mem_free(&allocator, map, sizeof(hashmap));
+}
+
+/**
+ * Check whether an old bucket has already been moved to the new bucket array.
+ *
+ * @param bucket Pointer to a bucket in old_buckets
+ * @return true if the bucket has been evacuated
+ */
+static inline bool is_evacuated(char *bucket)
+{
+    return get_tophash(bucket)[0] == EVACUATED;
+}
+
+/**
+ * Wait until the workers of a parallel evacuation in progress have settled
+ * every chunk (each of them visits them all), so that no entry moves while the
+ * caller walks the bucket arrays.
+ *
+ * @param map Pointer to the hashmap
+ */
+static void await_job(const hashmap *map)
+{
+    while (map->job && atomic_load(&map->job->settled) < map->job->chunk_count)
+    {
+        sched_yield();
+    }
+}
+
+/**
+ * Add the chains of a bucket array to the statistics. Old buckets that have
+ * already been evacuated are skipped.
+ *
+ * @param map Pointer to the hashmap
+ * @param buckets Bucket array
+ * @param count Number of buckets in the array
+ * @param out Statistics to update
+ */
+static void chain_stats(const hashmap *map, char *buckets, size_t count, hashmap_statistics *out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        char *bucket = get_bucket(map, buckets, i);
+        if (buckets == map->old_buckets && is_evacuated(bucket))
+        {
+            continue;
+        }
+        size_t length = 1;
+        for (char *overflow = get_overflow(map, bucket); overflow; overflow = get_overflow(map, overflow))
+        {
+            length++;
+        }
+        out->overflow_buckets += length - 1;
+        out->chain_lengths[(length < HASHMAP_STATS_MAX_CHAIN ? length : HASHMAP_STATS_MAX_CHAIN) - 1]++;
+        if (length > out->max_chain)
+        {
+            out->max_chain = length;
+        }
+    }
+}
+
+/**
+ * Collect the shape of the map (chain lengths, load, growth progress) and,
+ * in HASHMAP_STATS builds, the lookup counters.
+ *
+ * @param map Pointer to the hashmap
+ * @param out Receives the statistics
+ * @return true on success, false on NULL parameters
+ */
+bool hashmap_stats(const hashmap *map, hashmap_statistics *out)
+{
+    if (!map || !out)
+    {
+        return false;
+    }
+    memset(out, 0, sizeof(*out));
+    // Chains are only walked with no worker moving entries
+    await_job(map);
+    out->count = map->count;
+    out->bucket_count = map->bucket_count;
+    out->load_factor = (double)map->count / (double)map->bucket_count;
+    chain_stats(map, map->buckets, map->bucket_count, out);
+    if (map->old_buckets)
+    {
+        out->growing = true;
+        out->old_bucket_count = map->old_bucket_count;
+        out->evacuated = map->job ? atomic_load(&map->job->evacuated) : map->evacuated;
+        chain_stats(map, map->old_buckets, map->old_bucket_count, out);
+    }
+#if defined(HASHMAP_STATS)
+    out->lookups = atomic_load_explicit(&map->stats.lookups, memory_order_relaxed);
+    out->probed_buckets = atomic_load_explicit(&map->stats.probed_buckets, memory_order_relaxed);
+    out->max_probed_buckets = atomic_load_explicit(&map->stats.max_probed_buckets, memory_order_relaxed);
+    out->key_compares = atomic_load_explicit(&map->stats.key_compares, memory_order_relaxed);
+    out->false_positives = atomic_load_explicit(&map->stats.false_positives, memory_order_relaxed);
+#endif
+    return true;
+}
+
+/**
+ * Zero the lookup counters.
+ *
+ * @param map Pointer to the hashmap
+ */
+void hashmap_stats_reset(hashmap *map)
+{
+#if defined(HASHMAP_STATS)
+    if (map)
+    {
+        atomic_store_explicit(&map->stats.lookups, 0, memory_order_relaxed);
+        atomic_store_explicit(&map->stats.probed_buckets, 0, memory_order_relaxed);
+        atomic_store_explicit(&map->stats.max_probed_buckets, 0, memory_order_relaxed);
+        atomic_store_explicit(&map->stats.key_compares, 0, memory_order_relaxed);
+        atomic_store_explicit(&map->stats.false_positives, 0, memory_order_relaxed);
+    }
+#else
+    (void)map;
+#endif
+}
+
+/**
+ * Find a free slot for a new entry of a full chain in the head bucket of one of
+ * its neighbors (HASHMAP_NEIGHBORHOOD), and count it in the home bucket's spill
+ * counts. The caller fills the slot; a count left too high by a failed insert
+ * only costs lookups one extra bucket.
+ *
+ * @param map The hashmap
+ * @param idx Index of the entry's home bucket in map->buckets
+ * @param slot_out Receives the index of the free slot
+ * @return Neighbor holding the free slot, or NULL if all are full or the map does not spill
+ */
+static char *spill_slot(hashmap *map, size_t idx, int *slot_out)
+{
+    if (!map->spill_offset)
+    {
+        return NULL;
+    }
+    assert(map->bucket_count > NEIGHBOR_BUCKETS);
+    for (size_t distance = 1; distance <= NEIGHBOR_BUCKETS; distance++)
+    {
+        char *neighbor = get_bucket(map, map->buckets, neighbor_index(idx, distance, map->bucket_count));
+        slot_mask empty = match_empty(get_tophash(neighbor));
+        if (empty)
+        {
+            spill_counts(map, get_bucket(map, map->buckets, idx))[distance - 1]++;
+            *slot_out = mask_first(empty);
+            return neighbor;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Search the head buckets a home bucket spilled entries into (HASHMAP_NEIGHBORHOOD).
+ *
+ * @param map Pointer to the hashmap
+ * @param buckets Bucket array holding the home bucket
+ * @param bucket_count Number of buckets in the array
+ * @param idx Index of the key's home bucket
+ * @param hash Hash of the key (in the seed of the array)
+ * @param key Pointer to the key to search for
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @param moved Set to true if an old neighbor holding spilled entries has been
+ *              evacuated: the key may be in the new array then
+ * @param probed Incremented per neighbor scanned for the lookup counters, or
+ *               NULL for a search that is not a lookup
+ * @return Pointer to the value inside its bucket, or NULL if no neighbor holds the key
+ */
+static ALWAYS_INLINE char *spill_find_sized(const hashmap *map, char *buckets, size_t bucket_count, size_t idx,
+                                            uint64_t hash, const void *key, size_t key_size, bool *moved,
+                                            uint64_t *probed)
+{
+    const uint8_t *counts = spill_counts(map, get_bucket(map, buckets, idx));
+    for (size_t distance = 1; distance <= NEIGHBOR_BUCKETS; distance++)
+    {
+        if (!counts[distance - 1])
+        {
+            continue;
+        }
+        char *neighbor = get_bucket(map, buckets, neighbor_index(idx, distance, bucket_count));
+        if (is_evacuated(neighbor))
+        {
+            *moved = true;
+            continue;
+        }
+        if (probed)
+        {
+            (*probed)++;
+        }
+        int slot = bucket_match_sized(map, neighbor, hash, key, key_size, probed != NULL);
+        if (slot >= 0)
+        {
+            return value_data(map, neighbor, slot);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find the first free slot for a new entry of a bucket in the current array:
+ * in its chain, else in a neighbor (see spill_slot()), else in a newly
+ * allocated overflow bucket.
+ *
+ * @param map The hashmap
+ * @param idx Index of the entry's bucket in map->buckets
+ * @param slot_out Receives the index of the free slot
+ * @return Bucket holding the free slot, or NULL on allocation failure
+ */
+static char *chain_free_slot(hashmap *map, size_t idx, int *slot_out)
+{
+    char *bucket = get_bucket(map, map->buckets, idx);
+    char *last_bucket = bucket;
+    int slot = -1;
+    for (char *current_bucket = bucket; current_bucket && slot == -1;
+         current_bucket = get_overflow(map, current_bucket))
+    {
+        slot_mask empty = match_empty(get_tophash(current_bucket));
+        if (empty)
+        {
+            slot = mask_first(empty);
+        }
+        last_bucket = current_bucket;
+    }
+
+    if (slot == -1)
+    {
+        char *neighbor = spill_slot(map, idx, slot_out);
+        if (neighbor)
+        {
+            return neighbor;
+        }
+        char *overflow = alloc_bucket(map);
+        if (!overflow)
+        {
+            return NULL;
+        }
+        set_overflow(map, last_bucket, overflow);
+        last_bucket = overflow;
+        slot = 0;
+    }
+    *slot_out = slot;
+    return last_bucket;
+}
+
+/**
+ * Append an entry to the first free slot of a bucket's chain (or neighborhood)
+ * in the current array without checking for an existing key. Copies the raw
+ * slot contents, so in indirect mode the entry keeps its out-of-line objects
+ * (used to move entries between arrays).
+ *
+ * @param map The hashmap (used for the slot sizes)
+ * @param idx Index of the entry's bucket in map->buckets
+ * @param hash Hash of the entry (only the bits kept in the bucket are used)
+ * @param key_slot Pointer to the key slot contents to store
+ * @param value_slot Pointer to the value slot contents to store
+ * @return true on success, false on allocation failure
+ */
+static bool bucket_append(hashmap *map, size_t idx, uint64_t hash, const void *key_slot, const void *value_slot)
+{
+    int slot;
+    char *dest = chain_free_slot(map, idx, &slot);
+    if (!dest)
+    {
+        return false;
+    }
+    get_tophash(dest)[slot] = top_hash(hash);
+    set_fingerprint(map, dest, slot, hash);
+    memcpy(get_key(dest, map->key_stride, slot), key_slot, map->key_slot_size);
+    memcpy(get_value(map, dest, slot), value_slot, map->value_slot_size);
+    return true;
+}
+
+/**
+ * Store a new key in a free slot. In indirect mode the key and value objects
+ * are allocated first, and their pointers (and the fingerprint) written before
+ * the tophash so a concurrent reader never matches a slot without them.
+ *
+ * @param map The hashmap
+ * @param bucket Bucket holding the free slot
+ * @param slot Index of the free slot
+ * @param hash Hash of the key
+ * @param key Pointer to the key
+ * @param key_stride Bytes per key slot
+ * @param key_size Bytes to copy for an inline key
+ * @param indirect true if key slots hold pointers (map->indirect_keys)
+ * @return true on success, false on allocation failure (the slot stays free)
+ */
+static ALWAYS_INLINE bool store_key(hashmap *map, char *bucket, int slot, uint64_t hash, const void *key,
+                                    size_t key_stride, size_t key_size, bool indirect)
+{
+    char *key_dest = get_key(bucket, key_stride, slot);
+    if (indirect || map->indirect_values)
+    {
+        char *key_object = NULL;
+        if (indirect)
+        {
+            key_object = pool_alloc(&map->key_pool);
+            if (!key_object)
+            {
+                return false;
+            }
+        }
+        if (map->indirect_values)
+        {
+            char *value_object = pool_alloc(&map->value_pool);
+            if (!value_object)
+            {
+                if (key_object)
+                {
+                    pool_free(&map->key_pool, key_object);
+                }
+                return false;
+            }
+            memcpy(get_value(map, bucket, slot), &value_object, sizeof(value_object));
+        }
+        if (key_object)
+        {
+            memcpy(key_object, key, key_size);
+            memcpy(key_dest, &key_object, sizeof(key_object));
+        }
+        else
+        {
+            memcpy(key_dest, key, key_size);
+        }
+    }
+    else
+    {
+        memcpy(key_dest, key, key_size);
+    }
+    set_fingerprint(map, bucket, slot, hash);
+    get_tophash(bucket)[slot] = top_hash(hash);
+    return true;
+}
+
+/**
+ * Clear the slot holding a key in a bucket's chain or neighborhood in the
+ * current array. Used to undo a partially completed evacuation.
+ *
+ * @param map The hashmap
+ * @param idx Index of the key's bucket in map->buckets
+ * @param hash Hash of the key
+ * @param key Pointer to the key to remove
+ */
+static void bucket_unlink(hashmap *map, size_t idx, uint64_t hash, const void *key)
+{
+    char *bucket = get_bucket(map, map->buckets, idx);
+    for (char *current_bucket = bucket; current_bucket; current_bucket = get_overflow(map, current_bucket))
+    {
+        int slot = bucket_match_sized(map, current_bucket, hash, key, 0, false);
+        if (slot >= 0)
+        {
+            // EMPTY_ONE never breaks the EMPTY_REST invariant
+            get_tophash(current_bucket)[slot] = EMPTY_ONE;
+            return;
+        }
+    }
+    for (size_t distance = 1; map->spill_offset && distance <= NEIGHBOR_BUCKETS; distance++)
+    {
+        uint8_t *counts = spill_counts(map, bucket);
+        char *neighbor = get_bucket(map, map->buckets, neighbor_index(idx, distance, map->bucket_count));
+        int slot = counts[distance - 1] ? bucket_match_sized(map, neighbor, hash, key, 0, false) : -1;
+        if (slot >= 0)
+        {
+            get_tophash(neighbor)[slot] = EMPTY_ONE;
+            counts[distance - 1]--;
+            return;
+        }
+    }
+}
+
+/**
+ * Hash of an old_buckets entry, as far as placing it in a bucket array needs.
+ * With fingerprints, asked for in the seed they were stored with, and arrays of
+ * at most 2^32 buckets, it is rebuilt from the stored tophash and fingerprint
+ * (the only bits top_hash(), the fingerprint and bucket_index() read), so
+ * hash_fn is not called; otherwise the key is hashed.
+ *
+ * @param map The hashmap (must be growing)
+ * @param bucket Pointer to the old bucket
+ * @param index Index of the occupied slot (0-7)
+ * @param seed Seed to hash with: map->hash_seed to place the entry in the new
+ *             array, map->old_seed to find its home in the old one
+ * @return Hash of the entry's key under seed
+ */
+static inline uint64_t entry_hash(const hashmap *map, char *bucket, int index, uint64_t seed)
+{
+    if (map->fingerprints_offset && seed == map->old_seed &&
+        (uint64_t)map->bucket_count <= FINGERPRINT_ROUTE_LIMIT &&
+        (uint64_t)map->old_bucket_count <= FINGERPRINT_ROUTE_LIMIT)
+    {
+        uint32_t fingerprint;
+        memcpy(&fingerprint, bucket + map->fingerprints_offset + index * sizeof(uint32_t), sizeof(fingerprint));
+        return ((uint64_t)get_tophash(bucket)[index] << 56) | fingerprint;
+    }
+    return map_hash_seeded(map, key_data(bucket, map->key_stride, index, map->indirect_keys), seed);
+}
+
+/**
+ * Position in the sequence of entries evacuate() moves out of an old bucket:
+ * every entry of its chain, then (HASHMAP_NEIGHBORHOOD) the entries it spilled
+ * into neighbors that have not been evacuated yet. A neighbor evacuated first
+ * has already moved them along with its own entries.
+ */
+struct evacuation_cursor
+{
+    size_t old_idx;    // Old bucket being evacuated
+    size_t distance;   // 0 while in its chain, else the neighbor being scanned
+    char *bucket;      // Bucket being scanned, NULL once done
+    slot_mask pending; // Slots of bucket still to visit
+};
+
+/**
+ * Mask of the occupied slots of an old neighbor's head bucket whose home is a
+ * given old bucket.
+ *
+ * @param map The hashmap (must be growing)
+ * @param neighbor Pointer to the neighbor in old_buckets
+ * @param old_idx Index of the home bucket in old_buckets
+ * @return Mask of the slots spilled from old_idx
+ */
+static slot_mask spilled_slots(const hashmap *map, char *neighbor, size_t old_idx)
+{
+    slot_mask spilled = 0;
+    for (slot_mask full = match_full(get_tophash(neighbor)); full; full = mask_next(full))
+    {
+        uint64_t old_hash = entry_hash(map, neighbor, mask_first(full), map->old_seed);
+        if (bucket_index(old_hash, map->old_bucket_count) == old_idx)
+        {
+            spilled |= full & (~full + 1);
+        }
+    }
+    return spilled;
+}
+
+/**
+ * Start walking the entries to move out of an old bucket.
+ *
+ * @param map The hashmap (must be growing)
+ * @param cursor Cursor to initialize
+ * @param old_idx Index of the bucket in old_buckets
+ */
+static void cursor_init(const hashmap *map, struct evacuation_cursor *cursor, size_t old_idx)
+{
+    cursor->old_idx = old_idx;
+    cursor->distance = 0;
+    cursor->bucket = get_bucket(map, map->old_buckets, old_idx);
+    cursor->pending = match_full(get_tophash(cursor->bucket));
+}
+
+/**
+ * Advance to the next entry to move out of an old bucket.
+ *
+ * @param map The hashmap (must be growing)
+ * @param cursor Cursor from cursor_init()
+ * @param bucket_out Receives the bucket holding the entry
+ * @param slot_out Receives the slot of the entry
+ * @return false once every entry has been visited
+ */
+static bool cursor_next(const hashmap *map, struct evacuation_cursor *cursor, char **bucket_out, int *slot_out)
+{
+    while (!cursor->pending)
+    {
+        if (!cursor->bucket)
+        {
+            return false;
+        }
+        char *next = NULL;
+        if (cursor->distance == 0 && !has_empty_rest(get_tophash(cursor->bucket)))
+        {
+            next = get_overflow(map, cursor->bucket);
+        }
+        char *home = get_bucket(map, map->old_buckets, cursor->old_idx);
+        while (!next && map->spill_offset && cursor->distance < NEIGHBOR_BUCKETS)
+        {
+            cursor->distance++;
+            char *neighbor = get_bucket(map, map->old_buckets,
+                                        neighbor_index(cursor->old_idx, cursor->distance, map->old_bucket_count));
+            if (spill_counts(map, home)[cursor->distance - 1] && !is_evacuated(neighbor))
+            {
+                next = neighbor;
+            }
+        }
+        cursor->bucket = next;
+        if (next)
+        {
+            cursor->pending = cursor->distance ? spilled_slots(map, next, cursor->old_idx)
+                                               : match_full(get_tophash(next));
+        }
+    }
+    *bucket_out = cursor->bucket;
+    *slot_out = mask_first(cursor->pending);
+    cursor->pending = mask_next(cursor->pending);
+    return true;
+}
+
+/**
+ * Move every entry of one old bucket (and its overflow chain, and with
+ * HASHMAP_NEIGHBORHOOD the entries it spilled into its neighbors) into the new
+ * bucket array. Entries are rehashed (see entry_hash()), so this works for any
+ * new bucket_count. On allocation failure the entries already copied are
+ * removed again and the old bucket is left intact.
+ *
+ * @param map The hashmap (must be growing)
+ * @param old_idx Index of the bucket in old_buckets
+ * @return true if the bucket is evacuated, false on allocation failure
+ */
+static bool evacuate(hashmap *map, size_t old_idx)
+{
+    char *old_bucket = get_bucket(map, map->old_buckets, old_idx);
+    if (is_evacuated(old_bucket))
+    {
+        return true;
+    }
+
+    struct evacuation_cursor cursor;
+    char *bucket;
+    int i;
+    cursor_init(map, &cursor, old_idx);
+    while (cursor_next(map, &cursor, &bucket, &i))
+    {
+        char *key = get_key(bucket, map->key_stride, i);
+        char *value = get_value(map, bucket, i);
+        uint64_t hash = entry_hash(map, bucket, i, map->hash_seed);
+        // The tophash is recomputed rather than copied: after a reseed it changes
+        if (bucket_append(map, bucket_index(hash, map->bucket_count), hash, key, value))
+        {
+            continue;
+        }
+
+        // Roll back: drop the copies made so far, up to (not including) this slot
+        struct evacuation_cursor undo;
+        char *undo_bucket;
+        int j;
+        cursor_init(map, &undo, old_idx);
+        while (cursor_next(map, &undo, &undo_bucket, &j) && (undo_bucket != bucket || j != i))
+        {
+            uint64_t undo_hash = entry_hash(map, undo_bucket, j, map->hash_seed);
+            bucket_unlink(map, bucket_index(undo_hash, map->bucket_count), undo_hash,
+                          key_data(undo_bucket, map->key_stride, j, map->indirect_keys));
+        }
+        return false;
+    }
+
+    if (map->spill_offset)
+    {
+        // The spilled entries now live in the new array: free their old slots
+        cursor_init(map, &cursor, old_idx);
+        while (cursor_next(map, &cursor, &bucket, &i))
+        {
+            if (cursor.distance)
+            {
+                get_tophash(bucket)[i] = EMPTY_ONE;
+            }
+        }
+    }
+
+    free_overflow_chain(map, old_bucket);
+    set_overflow(map, old_bucket, NULL);
+    uint8_t *tophash = get_tophash(old_bucket);
+    tophash[0] = EVACUATED;
+    for (int i = 1; i < BUCKET_SIZE; i++)
+    {
+        tophash[i] = EMPTY_REST;
+    }
+    return true;
+}
+
+/**
+ * Free the old bucket array once every entry has left it.
+ *
+ * @param map The hashmap (growing, with every old bucket evacuated)
+ */
+static void release_old_buckets(hashmap *map)
+{
+    // Overflow chains were freed bucket by bucket during evacuation
+    free_buckets(map, map->old_buckets, map->old_bucket_count);
+    map->old_buckets = NULL;
+    map->old_bucket_count = 0;
+    map->evacuated = 0;
+    if (map->pool_retired)
+    {
+        // ...or, for a rebuild, are all in the retired pool
+        pool_destroy(&map->retired_pool);
+        map->pool_retired = false;
+    }
+}
+
+/**
+ * Evacuate the next old bucket at the evacuation cursor and free the old
+ * bucket array once every bucket has been moved.
+ * Buckets evacuated out of order by growth_work() are skipped, bounded by
+ * EVACUATE_SCAN_LIMIT steps per call.
+ *
+ * @param map The hashmap (must be growing)
+ * @return false if the bucket at the cursor could not be evacuated (allocation failure)
+ */
+static bool advance_evacuation(hashmap *map)
+{
+    if (map->evacuated < map->old_bucket_count && !evacuate(map, map->evacuated))
+    {
+        return false;
+    }
+
+    size_t limit = map->evacuated + EVACUATE_SCAN_LIMIT;
+    while (map->evacuated < map->old_bucket_count && map->evacuated < limit &&
+           is_evacuated(get_bucket(map, map->old_buckets, map->evacuated)))
+    {
+        map->evacuated++;
+    }
+
+    if (map->evacuated == map->old_bucket_count)
+    {
+        release_old_buckets(map);
+    }
+    return true;
+}
+
+/**
+ * Evacuate every old bucket of a chunk the caller claimed, then publish it as
+ * CHUNK_DONE. A bucket that fails for lack of memory stays in place and is
+ * moved by incremental evacuation once the job has ended.
+ *
+ * @param job The parallel evacuation
+ * @param chunk Index of the chunk (in CHUNK_BUSY, owned by the caller)
+ */
+static void evacuate_chunk(struct evacuation_job *job, size_t chunk)
+{
+    hashmap *map = job->map;
+    size_t start = chunk * PARALLEL_EVACUATION_CHUNK;
+    size_t end = start + PARALLEL_EVACUATION_CHUNK;
+    if (end > map->old_bucket_count)
+    {
+        end = map->old_bucket_count;
+    }
+    size_t moved = 0;
+    for (size_t i = start; i < end; i++)
+    {
+        moved += evacuate(map, i);
+    }
+    atomic_fetch_add(&job->evacuated, moved);
+    atomic_store_explicit(&job->chunks[chunk], CHUNK_DONE, memory_order_release);
+    atomic_fetch_add(&job->settled, 1);
+}
+
+/**
+ * Try to take a chunk nobody has claimed.
+ *
+ * @param job The parallel evacuation
+ * @param chunk Index of the chunk
+ * @return true if the caller now owns the chunk (CHUNK_BUSY) and must evacuate it
+ */
+static inline bool claim_chunk(struct evacuation_job *job, size_t chunk)
+{
+    unsigned char expected = CHUNK_PENDING;
+    return atomic_compare_exchange_strong(&job->chunks[chunk], &expected, CHUNK_BUSY);
+}
+
+/**
+ * Make sure no worker is moving a chunk before the caller touches its old
+ * buckets, or the new buckets they feed: evacuate it here if nobody has
+ * claimed it yet, otherwise wait for its owner to finish.
+ *
+ * @param job The parallel evacuation
+ * @param chunk Index of the chunk
+ */
+static void settle_chunk(struct evacuation_job *job, size_t chunk)
+{
+    if (atomic_load_explicit(&job->chunks[chunk], memory_order_acquire) == CHUNK_DONE)
+    {
+        return;
+    }
+    if (claim_chunk(job, chunk))
+    {
+        evacuate_chunk(job, chunk);
+        return;
+    }
+    while (atomic_load_explicit(&job->chunks[chunk], memory_order_acquire) != CHUNK_DONE)
+    {
+        sched_yield();
+    }
+}
+
+/**
+ * Settle the chunk holding a key's old bucket while a parallel evacuation is
+ * in progress (see settle_chunk()). Parallel evacuation only runs for
+ * doublings, so the old array follows the map's seed: old bucket i feeds new
+ * buckets congruent to i, and nothing else.
+ *
+ * @param map The hashmap (must be growing)
+ * @param old_hash old_array_hash() of the key
+ */
+static inline void settle_old_bucket(const hashmap *map, uint64_t old_hash)
+{
+    if (map->job)
+    {
+        settle_chunk(map->job, bucket_index(old_hash, map->old_bucket_count) / PARALLEL_EVACUATION_CHUNK);
+    }
+}
+
+/**
+ * Settle every chunk of a parallel evacuation in progress, so that the caller
+ * can walk both bucket arrays with no worker writing to them.
+ *
+ * @param map The hashmap
+ */
+static void settle_all(const hashmap *map)
+{
+    if (!map->job)
+    {
+        return;
+    }
+    for (size_t i = 0; i < map->job->chunk_count; i++)
+    {
+        settle_chunk(map->job, i);
+    }
+}
+
+/**
+ * A worker's share of a job: claim and evacuate chunks, starting in its own
+ * range of the old array and moving on into the others' (work stealing),
+ * until every chunk has been claimed.
+ *
+ * @param job The parallel evacuation
+ * @param index Worker index
+ * @param worker_count Workers in the pool
+ */
+static void run_job(struct evacuation_job *job, size_t index, size_t worker_count)
+{
+    size_t first = job->chunk_count * index / worker_count;
+    for (size_t i = 0; i < job->chunk_count && atomic_load(&job->settled) < job->chunk_count; i++)
+    {
+        size_t chunk = (first + i) % job->chunk_count;
+        if (claim_chunk(job, chunk))
+        {
+            evacuate_chunk(job, chunk);
+        }
+    }
+}
+
+/**
+ * Worker thread: sleep until a job is posted, take part in it, repeat until
+ * the pool shuts down.
+ *
+ * @param arg The struct evacuation_worker
+ * @return NULL
+ */
+static void *evacuation_worker_main(void *arg)
+{
+    struct evacuation_worker *worker = arg;
+    struct evacuation_pool *pool = worker->pool;
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->shutdown && (!pool->active || pool->generation == seen))
+        {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+        }
+        if (pool->shutdown)
+        {
+            break;
+        }
+        seen = pool->generation;
+        pool->busy++;
+        pthread_mutex_unlock(&pool->lock);
+        run_job(&pool->job, worker->index, pool->worker_count);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+        {
+            pthread_cond_broadcast(&pool->changed);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * Start the map's evacuation pool with evacuation_threads workers, or as many
+ * as could be created.
+ *
+ * @param map The hashmap
+ * @return The pool, or NULL if not even one worker could be started
+ */
+static struct evacuation_pool *evacuation_pool_create(hashmap *map)
+{
+    struct evacuation_pool *pool = mem_alloc(&map->allocator, evacuation_pool_size(map));
+    if (!pool)
+    {
+        return NULL;
+    }
+    if (pthread_mutex_init(&pool->lock, NULL) != 0)
+    {
+        mem_free(&map->allocator, pool, evacuation_pool_size(map));
+        return NULL;
+    }
+    if (pthread_cond_init(&pool->changed, NULL) != 0)
+    {
+        pthread_mutex_destroy(&pool->lock);
+        mem_free(&map->allocator, pool, evacuation_pool_size(map));
+        return NULL;
+    }
+    pool->active = false;
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->shutdown = false;
+    pool->worker_count = 0;
+    // Workers only read worker_count once a job is posted, after this loop
+    for (size_t i = 0; i < map->evacuation_threads; i++)
+    {
+        struct evacuation_worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        if (pthread_create(&worker->thread, NULL, evacuation_worker_main, worker) != 0)
+        {
+            break;
+        }
+        pool->worker_count++;
+    }
+    map->evacuation_pool = pool;
+    if (pool->worker_count == 0)
+    {
+        evacuation_pool_destroy(map);
+        return NULL;
+    }
+    return pool;
+}
+
+/**
+ * End a parallel evacuation once every chunk is settled, and free the old
+ * array if nothing was left behind for lack of memory. Leftovers are moved
+ * by incremental evacuation, which walks the old array from the start.
+ *
+ * @param map The hashmap (with a job in progress, every chunk CHUNK_DONE)
+ */
+static void complete_job(hashmap *map)
+{
+    bool all_moved = atomic_load(&map->job->evacuated) == map->old_bucket_count;
+    end_job(map);
+    if (all_moved)
+    {
+        release_old_buckets(map);
+    }
+}
+
+/**
+ * Hand the current growth to the map's evacuation pool: the workers move
+ * chunks of old buckets in the background while the caller carries on, and
+ * callers settle the chunks they touch before using them. Falls back to
+ * incremental evacuation if the pool or the chunk states cannot be set up.
+ * In foreground mode the evacuation is completed before returning.
+ *
+ * @param map The hashmap (must be growing, with nothing evacuated yet)
+ */
+static void start_job(hashmap *map)
+{
+    struct evacuation_pool *pool = map->evacuation_pool;
+    if (!pool)
+    {
+        pool = evacuation_pool_create(map);
+        if (!pool)
+        {
+            return;
+        }
+    }
+    struct evacuation_job *job = &pool->job;
+    job->map = map;
+    job->chunk_count = (map->old_bucket_count + PARALLEL_EVACUATION_CHUNK - 1) / PARALLEL_EVACUATION_CHUNK;
+    job->chunks = mem_alloc(&map->allocator, job->chunk_count * sizeof(atomic_uchar));
+    if (!job->chunks)
+    {
+        return;
+    }
+    for (size_t i = 0; i < job->chunk_count; i++)
+    {
+        atomic_init(&job->chunks[i], CHUNK_PENDING);
+    }
+    atomic_init(&job->settled, 0);
+    atomic_init(&job->evacuated, 0);
+
+    map->job = job;
+    map->pool_lock = &pool->lock;
+    pthread_mutex_lock(&pool->lock);
+    pool->active = true;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (map->evacuation_foreground)
+    {
+        settle_all(map);
+        complete_job(map);
+    }
+}
+
+/**
+ * Evacuate every remaining old bucket, completing an in-progress growth.
+ * A growth due for parallel evacuation is handed to the workers first, and the
+ * caller takes part in it (settle_all()).
+ *
+ * @param map The hashmap
+ * @return true once the map is no longer growing, false on allocation failure
+ */
+static bool finish_growth(hashmap *map)
+{
+    if (map->parallel_pending)
+    {
+        map->parallel_pending = false;
+        start_job(map);
+    }
+    if (map->job)
+    {
+        settle_all(map);
+        complete_job(map);
+    }
+    while (map->old_buckets)
+    {
+        if (!advance_evacuation(map))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Perform a bounded amount of growth work before a mutation:
+ * evacuate the old bucket the hash maps to (so the mutation only has to look
+ * at the new bucket array), then advance the evacuation cursor by one bucket.
+ * A growth marked for parallel evacuation is instead handed to the workers at
+ * the start of the first mutation after it began; while they run, the
+ * mutation only settles the chunk of its own old bucket, and the mutation
+ * that finds every chunk settled ends the job.
+ *
+ * @param map The hashmap (must be growing)
+ * @param hash old_array_hash() of the key about to be mutated
+ * @return false if the target bucket could not be evacuated (allocation failure)
+ */
+static bool growth_work(hashmap *map, uint64_t hash)
+{
+    if (map->parallel_pending)
+    {
+        map->parallel_pending = false;
+        start_job(map);
+        if (!map->old_buckets)
+        {
+            return true;
+        }
+    }
+    size_t old_idx = bucket_index(hash, map->old_bucket_count);
+    if (map->job)
+    {
+        settle_old_bucket(map, hash);
+        // Only does anything if the bucket was left behind for lack of memory
+        bool moved = evacuate(map, old_idx);
+        if (atomic_load(&map->job->settled) == map->job->chunk_count)
+        {
+            complete_job(map);
+        }
+        return moved;
+    }
+    if (!evacuate(map, old_idx))
+    {
+        return false;
+    }
+    // Out of memory at the cursor is not fatal: it is retried on a later mutation
+    advance_evacuation(map);
+    return true;
+}
+
+/**
+ * Start incremental growth: the current buckets become old_buckets and a new
+ * bucket array is allocated. Entries move over lazily via growth_work(), or,
+ * for large maps with evacuation_threads set, in the background by the
+ * evacuation pool from the next mutation on.
+ *
+ * @param map The hashmap (must not already be growing)
+ * @param new_count Number of buckets in the new array (power of 2)
+ * @return true on success, false on allocation failure (map unchanged)
+ */
+static bool start_growth(hashmap *map, size_t new_count)
+{
+    assert(!map->old_buckets);
+    char *buckets = alloc_buckets(map, new_count);
+    if (!buckets)
+    {
+        return false;
+    }
+    map->old_buckets = map->buckets;
+    map->old_bucket_count = map->bucket_count;
+    map->old_seed = map->hash_seed;
+    map->evacuated = 0;
+    map->buckets = buckets;
+    map->bucket_count = new_count;
+
+    // Evacuate at the next mutation rather than now: the insert that triggered
+    // growth still hands out a slot in the old array. Evacuating a bucket also
+    // clears slots in its neighbors, so spilling maps are never split between workers
+    map->parallel_pending = map->evacuation_threads > 1 && !map->spill_offset &&
+                            map->old_bucket_count >= PARALLEL_EVACUATION_MIN_BUCKETS &&
+                            new_count > map->old_bucket_count;
+    return true;
+}
+
+/**
+ * Make room for at least capacity entries without further growth.
+ * If the current bucket array is too small, growth to the required size starts
+ * immediately (finishing any growth already in progress first); entries are then
+ * moved incrementally as usual. An empty map simply swaps in the larger array.
+ *
+ * @param map Pointer to the hashmap
+ * @param capacity Number of entries the map should hold without growing
+ * @return true on success, false on allocation failure or NULL map
+ */
+bool hashmap_reserve(hashmap *map, size_t capacity)
+{
+    if (!map)
+    {
+        return false;
+    }
+    size_t bucket_count = buckets_for_capacity(capacity);
+    if (bucket_count == 0)
+    {
+        return false;
+    }
+    if (bucket_count <= map->bucket_count)
+    {
+        return true;
+    }
+    if (!finish_growth(map))
+    {
+        return false;
+    }
+
+    if (map->count == 0)
+    {
+        char *buckets = alloc_buckets(map, bucket_count);
+        if (!buckets)
+        {
+            return false;
+        }
+        free_overflow_chains(map, map->buckets, map->bucket_count);
+        free_buckets(map, map->buckets, map->bucket_count);
+        map->buckets = buckets;
+        map->bucket_count = bucket_count;
+        return true;
+    }
+    return start_growth(map, bucket_count);
+}
+
+/**
+ * Rehash every entry into a fresh bucket array with fresh overflow chains.
+ * The current overflow pool is retired first so the chains are rebuilt in a
+ * new pool, packed as short as the new array allows, and the old pool's slabs
+ * are freed in one go once the old array is evacuated. If evacuation runs out
+ * of memory part way, the rebuild simply continues incrementally.
+ *
+ * @param map Pointer to the hashmap
+ * @param new_count Number of buckets in the new array (power of 2)
+ * @return true if the rebuild completed, false on allocation failure
+ */
+static bool rebuild(hashmap *map, size_t new_count)
+{
+    if (!finish_growth(map))
+    {
+        return false;
+    }
+    map->retired_pool = map->overflow_pool;
+    pool_init(&map->overflow_pool, &map->allocator, map->retired_pool.object_size, map->retired_pool.align);
+    map->pool_retired = true;
+    if (!start_growth(map, new_count))
+    {
+        map->overflow_pool = map->retired_pool;
+        map->pool_retired = false;
+        return false;
+    }
+    return finish_growth(map);
+}
+
+/**
+ * Shrink the bucket array to the smallest size that holds the current entries
+ * within the load factor, and repack all overflow chains.
+ *
+ * @param map Pointer to the hashmap
+ * @return true on success, false on allocation failure or NULL map
+ */
+bool hashmap_shrink_to_fit(hashmap *map)
+{
+    if (!map || !finish_growth(map))
+    {
+        return false;
+    }
+    size_t bucket_count = buckets_for_capacity(map->count);
+    return bucket_count != 0 && rebuild(map, bucket_count);
+}
+
+/**
+ * Repack all overflow chains at the current bucket count, returning the memory
+ * of overflow buckets emptied by deletes to the allocator.
+ *
+ * @param map Pointer to the hashmap
+ * @return true on success, false on allocation failure or NULL map
+ */
+bool hashmap_compact(hashmap *map)
+{
+    if (!map)
+    {
+        return false;
+    }
+    return rebuild(map, map->bucket_count);
+}
+
+/**
+ * Check whether deletes have left the map below its auto-shrink threshold.
+ *
+ * @param map Pointer to the hashmap (shrink_percent must be non-zero)
+ * @return true if count is below shrink_percent percent of what the bucket array holds
+ */
+static bool under_shrink_threshold(const hashmap *map)
+{
+    size_t capacity = map->bucket_count * LOAD_FACTOR_NUMERATOR / LOAD_FACTOR_DENOMINATOR;
+    // capacity * shrink_percent / 100 without overflow
+    size_t threshold = capacity / 100 * map->shrink_percent + capacity % 100 * map->shrink_percent / 100;
+    return map->count < threshold;
+}
+
+/**
+ * Account for a newly inserted entry and start growth (doubling) once the load
+ * factor is exceeded. Slots returned before the call stay valid: they are only
+ * moved by later evacuation.
+ *
+ * @param map Pointer to the hashmap
+ */
+static void count_insert(hashmap *map)
+{
+    map->count++;
+
+    // Check if we need to grow (load factor check)
+    if (!map->old_buckets && over_load_factor(map->count, map->bucket_count))
+    {
+        // On allocation failure keep going with longer overflow chains
+        start_growth(map, map->bucket_count * 2);
+    }
+}
+
+/**
+ * Respond to a flooded chain: pick a new seed and move every entry to a
+ * same-size bucket array hashed with it, incrementally like growth (the old
+ * array is probed with the previous seed until it is evacuated). Keys that
+ * collide whatever the seed (a hash_fn ignoring them) stay together, so this
+ * is done at most once per table size. Skipped while the map is growing and
+ * on allocation failure. With reseeding off, the flood is only recorded for
+ * hashmap_take_flood().
+ *
+ * @param map Pointer to the hashmap
+ */
+static void reseed(hashmap *map)
+{
+    if (map->old_buckets || map->reseed_bucket_count == map->bucket_count)
+    {
+        return;
+    }
+    if (!map->reseed_enabled)
+    {
+        map->flood_pending = true;
+        map->reseed_bucket_count = map->bucket_count;
+        return;
+    }
+    // Folded with the old seed too, so two reseeds still differ when no random
+    // source could be read and the clock did not move
+    uint64_t seed = hashmap_hash_u64(&map->hash_seed, sizeof(map->hash_seed), hashmap_random_seed(map));
+    if (!start_growth(map, map->bucket_count))
+    {
+        return;
+    }
+    map->hash_seed = seed;
+    map->reseed_bucket_count = map->bucket_count;
+}
+
+/**
+ * Find the value slot for a key, claiming a new slot if the key is absent.
+ * A new slot gets the key and tophash but its value bytes are left as they are.
+ * May allocate overflow buckets if the target bucket is full (with
+ * HASHMAP_NEIGHBORHOOD, only once the neighbors are full too).
+ * While the map is growing, evacuates the key's old bucket plus one more first.
+ * Starts incremental growth (doubling) once the load factor is exceeded; the
+ * returned slot stays valid until the next mutation either way.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key
+ * @param hash Seeded hash of the key
+ * @param inserted Set to true if a new entry was created, false if the key existed
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return Pointer to the value slot, or NULL on allocation failure
+ */
+static ALWAYS_INLINE char *claim_slot_sized(hashmap *map, const void *key, uint64_t hash, bool *inserted,
+                                             size_t key_size)
+{
+    bool indirect = !key_size && map->indirect_keys;
+    size_t specialized = key_size;
+    size_t key_stride = key_size ? key_size : map->key_stride;
+    key_size = key_size ? key_size : map->key_size;
+    uint8_t top = top_hash(hash);
+    if (map->old_buckets && !growth_work(map, old_array_hash(map, key, hash)))
+    {
+        return NULL;
+    }
+    size_t idx = bucket_index(hash, map->bucket_count);
+
+    char *bucket = get_bucket(map, map->buckets, idx);
+    char *insert_bucket = bucket;
+    int insert_slot = -1;
+
+    char *current_bucket = bucket;
+    char *last_bucket = bucket;
+    size_t chain_length = 0;
+    while (current_bucket)
+    {
+        chain_length++;
+        uint8_t *tophash = get_tophash(current_bucket);
+
+        // Remember first empty slot we find, but keep searching for an existing key
+        slot_mask empty = match_empty(tophash);
+        if (empty && insert_slot == -1)
+        {
+            insert_bucket = current_bucket;
+            insert_slot = mask_first(empty);
+        }
+
+        // Check the slots whose tophash matches our key
+        for (slot_mask match = match_tophash(tophash, top); match; match = mask_next(match))
+        {
+            int i = mask_first(match);
+            if (!fingerprint_matches(map, current_bucket, i, hash))
+            {
+                continue;
+            }
+            char *existing_key = key_data(current_bucket, key_stride, i, indirect);
+            if (keys_equal(map, existing_key, key, key_size))
+            {
+                *inserted = false;
+                return value_data(map, current_bucket, i);
+            }
+        }
+        // Past an EMPTY_REST slot the key cannot exist, and insert_slot is already set
+        if (has_empty_rest(tophash))
+        {
+            break;
+        }
+        last_bucket = current_bucket;
+        current_bucket = get_overflow(map, current_bucket);
+    }
+
+    // Deletes may have freed home slots since the key spilled, so check the neighbors either way
+    if (map->spill_offset)
+    {
+        bool moved = false;
+        char *spilled = spill_find_sized(map, map->buckets, map->bucket_count, idx, hash, key, specialized, &moved, NULL);
+        if (spilled)
+        {
+            *inserted = false;
+            return spilled;
+        }
+    }
+
+    bool flooded = false;
+    if (insert_slot == -1 && map->spill_offset)
+    {
+        insert_bucket = spill_slot(map, idx, &insert_slot);
+    }
+    if (insert_slot == -1)
+    {
+        char *overflow = alloc_bucket(map);
+        if (!overflow)
+        {
+            return NULL;
+        }
+        set_overflow(map, last_bucket, overflow);
+        insert_bucket = overflow;
+        insert_slot = 0;
+        flooded = chain_length >= FLOOD_CHAIN_BUCKETS;
+    }
+    // A newly linked overflow bucket left empty on failure is harmless
+    if (!store_key(map, insert_bucket, insert_slot, hash, key, key_stride, key_size, indirect))
+    {
+        return NULL;
+    }
+
+    *inserted = true;
+    count_insert(map);
+    if (flooded)
+    {
+        reseed(map);
+    }
+    return value_data(map, insert_bucket, insert_slot);
+}
+
+/**
+ * Find or claim the value slot for a key (see claim_slot_sized()).
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key
+ * @param hash Seeded hash of the key
+ * @param inserted Set to true if a new entry was created, false if the key existed
+ * @return Pointer to the value slot, or NULL on allocation failure
+ */
+static char *claim_slot(hashmap *map, const void *key, uint64_t hash, bool *inserted)
+{
+    DISPATCH_KEY_SIZE(map, claim_slot_sized, map, key, hash, inserted);
+}
+
+/**
+ * Insert a key known to be absent, skipping the search for an existing entry.
+ * Performs the same growth work and load factor check as claim_slot().
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key (must not be in the map)
+ * @param value Pointer to the value
+ * @param hash Seeded hash of the key
+ * @return true on success, false on allocation failure
+ */
+static bool insert_unique(hashmap *map, const void *key, const void *value, uint64_t hash)
+{
+    if (map->old_buckets && !growth_work(map, old_array_hash(map, key, hash)))
+    {
+        return false;
+    }
+    int slot;
+    char *bucket = chain_free_slot(map, bucket_index(hash, map->bucket_count), &slot);
+    if (!bucket || !store_key(map, bucket, slot, hash, key, map->key_stride, map->key_size,
+                              map->indirect_keys))
+    {
+        return false;
+    }
+    memcpy(value_data(map, bucket, slot), value, map->value_size);
+    count_insert(map);
+    return true;
+}
+
+/**
+ * Insert or update a key-value pair in the hashmap.
+ * If key exists, its value is updated. Otherwise, a new entry is created.
+ * May allocate overflow buckets if the target bucket is full.
+ * While the map is growing, evacuates the key's old bucket plus one more first.
+ * Starts incremental growth (doubling) once the load factor is exceeded.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to insert
+ * @param value Pointer to the value to associate with the key
+ * @return true on success, false on failure (NULL parameters or allocation failure)
+ */
+bool hashmap_put(hashmap *map, const void *key, const void *value)
 {
     if (!map || !key || !value)
     {
         return false;
     }
+    return hashmap_put_hashed(map, key, value, map_hash(map, key));
+}
+
+/**
+ * Insert or update a key-value pair whose hash the caller already computed
+ * with hashmap_key_hash().
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key
+ * @param value Pointer to the value
+ * @param hash hashmap_key_hash(map, key)
+ * @return true on success, false on allocation failure
+ */
+bool hashmap_put_hashed(hashmap *map, const void *key, const void *value, uint64_t hash)
+{
+    bool inserted;
+    char *value_dest = claim_slot(map, key, hash, &inserted);
+    if (!value_dest)
+    {
+        return false;
+    }
+    memcpy(value_dest, value, map->value_size);
+    return true;
+}
+
+/**
+ * Find or claim the value slot for a key whose hash the caller already computed
+ * with hashmap_key_hash(). A newly claimed slot is left uninitialized.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key
+ * @param hash hashmap_key_hash(map, key)
+ * @param inserted Set to true if the key was inserted, false if it existed
+ * @return Pointer to the value slot, or NULL on allocation failure
+ */
+void *hashmap_claim_hashed(hashmap *map, const void *key, uint64_t hash, bool *inserted)
+{
+    return claim_slot(map, key, hash, inserted);
+}
+
+/**
+ * Return a writable pointer to the value slot for a key, inserting the key if absent.
+ * A newly inserted value slot is zero-filled. Lets read-modify-write updates run
+ * with a single probe and no value copies.
+ * The pointer is invalidated by the next put, delete or other mutation of the map.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to look up or insert
+ * @param inserted Optional; set to true if the key was inserted, false if it existed
+ * @return Pointer to the value slot, or NULL on failure (NULL parameters or allocation failure)
+ */
+void *hashmap_get_or_insert_slot(hashmap *map, const void *key, bool *inserted)
+{
+    if (!map || !key)
+    {
+        return NULL;
+    }
+
+    bool was_inserted;
+    char *value_slot = claim_slot(map, key, map_hash(map, key), &was_inserted);
+    if (value_slot && was_inserted)
+    {
+        memset(value_slot, 0, map->value_size);
+    }
+    if (inserted)
+    {
+        *inserted = was_inserted;
+    }
+    return value_slot;
+}
+
+/**
+ * Select the bucket chain holding a key: the new bucket, or the old one while it
+ * has not been evacuated yet (with workers evacuating, once its chunk is settled).
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key
+ * @param hash Seeded hash of the key; replaced by old_array_hash() if the old
+ *             bucket is selected, so the caller searches it with the right tophash
+ * @return Pointer to the head bucket of the chain to search
+ */
+static inline char *lookup_bucket(const hashmap *map, const void *key, uint64_t *hash)
+{
+    char *bucket = get_bucket(map, map->buckets, bucket_index(*hash, map->bucket_count));
+    if (map->old_buckets)
+    {
+        uint64_t old_hash = old_array_hash(map, key, *hash);
+        settle_old_bucket(map, old_hash);
+        char *old_bucket = get_bucket(map, map->old_buckets, bucket_index(old_hash, map->old_bucket_count));
+        if (!is_evacuated(old_bucket))
+        {
+            bucket = old_bucket;
+            *hash = old_hash;
+        }
+    }
+    return bucket;
+}
+
+/**
+ * Count one lookup that scanned a number of buckets.
+ *
+ * @param map Pointer to the hashmap
+ * @param probed Buckets scanned by the lookup
+ */
+static inline void record_lookup(const hashmap *map, uint64_t probed)
+{
+#if defined(HASHMAP_STATS)
+    hashmap *counted = (hashmap *)map;
+    STAT_ADD(map, lookups, 1);
+    STAT_ADD(map, probed_buckets, probed);
+    uint64_t max = atomic_load_explicit(&counted->stats.max_probed_buckets, memory_order_relaxed);
+    while (probed > max && !atomic_compare_exchange_weak_explicit(&counted->stats.max_probed_buckets, &max, probed,
+                                                                  memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+#else
+    (void)map;
+    (void)probed;
+#endif
+}
+
+/**
+ * Search a bucket chain for a key.
+ *
+ * @param map Pointer to the hashmap
+ * @param bucket Pointer to the head bucket of the chain
+ * @param hash Hash of the key (in the seed of the chain's bucket array)
+ * @param key Pointer to the key to search for
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @param probed Incremented per bucket scanned, for record_lookup()
+ * @return Pointer to the value inside its bucket, or NULL if the key is absent
+ */
+static ALWAYS_INLINE char *chain_find_sized(const hashmap *map, char *bucket, uint64_t hash, const void *key,
+                                            size_t key_size, uint64_t *probed)
+{
+    for (char *current_bucket = bucket; current_bucket; current_bucket = get_overflow(map, current_bucket))
+    {
+        (*probed)++;
+        int slot = bucket_match_sized(map, current_bucket, hash, key, key_size, true);
+        if (slot >= 0)
+        {
+            return value_data(map, current_bucket, slot);
+        }
+        if (has_empty_rest(get_tophash(current_bucket)))
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find the stored value for a key in a pair of bucket arrays: the old bucket
+ * while it has not been evacuated, else the new one, each with the neighbors it
+ * spilled into. A key spilled into an old neighbor that was evacuated first has
+ * moved to the new array, which is searched then too.
+ *
+ * @param map Pointer to the hashmap
+ * @param buckets Current bucket array
+ * @param bucket_count Number of buckets in it
+ * @param old_buckets Array being evacuated, or NULL
+ * @param old_bucket_count Number of buckets in it
+ * @param key Pointer to the key to search for
+ * @param hash Seeded hash of the key
+ * @param old_hash old_array_hash() of the key (only used with old_buckets)
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return Pointer to the value inside its bucket, or NULL if the key is absent
+ */
+static ALWAYS_INLINE char *arrays_find_sized(const hashmap *map, char *buckets, size_t bucket_count,
+                                             char *old_buckets, size_t old_bucket_count, const void *key,
+                                             uint64_t hash, uint64_t old_hash, size_t key_size)
+{
+    bool moved = false;
+    uint64_t probed = 0;
+    char *value = NULL;
+    if (old_buckets)
+    {
+        size_t old_idx = bucket_index(old_hash, old_bucket_count);
+        char *old_bucket = get_bucket(map, old_buckets, old_idx);
+        if (!is_evacuated(old_bucket))
+        {
+            value = chain_find_sized(map, old_bucket, old_hash, key, key_size, &probed);
+            if (!value && map->spill_offset)
+            {
+                value = spill_find_sized(map, old_buckets, old_bucket_count, old_idx, old_hash, key, key_size,
+                                         &moved, &probed);
+            }
+            if (value || !moved)
+            {
+                record_lookup(map, probed);
+                return value;
+            }
+        }
+    }
+    size_t idx = bucket_index(hash, bucket_count);
+    value = chain_find_sized(map, get_bucket(map, buckets, idx), hash, key, key_size, &probed);
+    if (!value && map->spill_offset)
+    {
+        value = spill_find_sized(map, buckets, bucket_count, idx, hash, key, key_size, &moved, &probed);
+    }
+    record_lookup(map, probed);
+    return value;
+}
+
+/**
+ * Find the stored value for a key.
+ * While the map is growing, searches the old bucket if it has not been evacuated yet
+ * (with workers evacuating, once its chunk is settled).
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to search for
+ * @param hash Seeded hash of the key
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return Pointer to the value inside its bucket, or NULL if the key is absent
+ */
+static ALWAYS_INLINE char *find_value_sized(const hashmap *map, const void *key, uint64_t hash, size_t key_size)
+{
+    uint64_t old_hash = hash;
+    if (map->old_buckets)
+    {
+        old_hash = old_array_hash(map, key, hash);
+        settle_old_bucket(map, old_hash);
+    }
+    return arrays_find_sized(map, map->buckets, map->bucket_count, map->old_buckets, map->old_bucket_count, key,
+                             hash, old_hash, key_size);
+}
+
+/**
+ * Find the stored value for a key (see find_value_sized()).
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to search for
+ * @param hash Seeded hash of the key
+ * @return Pointer to the value inside its bucket, or NULL if the key is absent
+ */
+static char *find_value(const hashmap *map, const void *key, uint64_t hash)
+{
+    DISPATCH_KEY_SIZE(map, find_value_sized, map, key, hash);
+}
+
+/**
+ * Snapshot the fields that locate the bucket arrays. Each field is read exactly
+ * once (volatile), so a reader racing with a writer works on one consistent copy
+ * once its seqlock check confirms no write overlapped the snapshot.
+ *
+ * @param map Pointer to the hashmap
+ * @param view Receives the bucket arrays and their sizes
+ */
+void hashmap_load_view(const hashmap *map, hashmap_view *view)
+{
+    view->buckets = *(char *const volatile *)&map->buckets;
+    view->bucket_count = *(const volatile size_t *)&map->bucket_count;
+    view->old_buckets = *(char *const volatile *)&map->old_buckets;
+    view->old_bucket_count = *(const volatile size_t *)&map->old_bucket_count;
+    view->hash_seed = *(const volatile uint64_t *)&map->hash_seed;
+    view->old_seed = *(const volatile uint64_t *)&map->old_seed;
+}
+
+/**
+ * Find the stored value for a key in a snapshot of the bucket arrays
+ * (see arrays_find_sized()).
+ *
+ * @param map Pointer to the hashmap
+ * @param view Snapshot from hashmap_load_view()
+ * @param key Pointer to the key to search for
+ * @param hash Hash of the key under seed
+ * @param seed Seed hash was computed with
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return Pointer to the value inside its bucket, or NULL if the key is absent
+ */
+static ALWAYS_INLINE char *view_find_sized(const hashmap *map, const hashmap_view *view, const void *key,
+                                           uint64_t hash, uint64_t seed, size_t key_size)
+{
+    // The caller's hash is reused for whichever array still follows its seed;
+    // a map that reseeded is asked for the others
+    uint64_t new_hash = view->hash_seed == seed ? hash : map_hash_seeded(map, key, view->hash_seed);
+    uint64_t old_hash = view->old_seed == seed ? hash : map_hash_seeded(map, key, view->old_seed);
+    return arrays_find_sized(map, view->buckets, view->bucket_count, view->old_buckets, view->old_bucket_count, key,
+                             new_hash, old_hash, key_size);
+}
+
+/**
+ * Find the stored value for a key in a snapshot (see view_find_sized()).
+ *
+ * @param map Pointer to the hashmap
+ * @param view Snapshot from hashmap_load_view()
+ * @param key Pointer to the key to search for
+ * @param hash Hash of the key under seed
+ * @param seed Seed hash was computed with
+ * @return Pointer to the value inside its bucket, or NULL if the key is absent
+ */
+static char *view_find(const hashmap *map, const hashmap_view *view, const void *key, uint64_t hash,
+                       uint64_t seed)
+{
+    DISPATCH_KEY_SIZE(map, view_find_sized, map, view, key, hash, seed);
+}
+
+/**
+ * Look a key up through a snapshot of the bucket arrays.
+ * The result is only meaningful if no write overlapped the call; the caller
+ * checks that and retries. The snapshot's arrays must still be allocated.
+ *
+ * @param map Pointer to the hashmap
+ * @param view Snapshot from hashmap_load_view()
+ * @param key Pointer to the key to search for
+ * @param hash hashmap_key_hash_seeded(map, key, seed)
+ * @param seed Seed hash was computed with
+ * @param out_value Pointer to memory where the value will be copied if found
+ * @return true if key was found and value copied to out_value, false otherwise
+ */
+bool hashmap_view_get(const hashmap *map, const hashmap_view *view, const void *key, uint64_t hash,
+                      uint64_t seed, void *out_value)
+{
+    char *stored_value = view_find(map, view, key, hash, seed);
+    if (!stored_value)
+    {
+        return false;
+    }
+    memcpy(out_value, stored_value, map->value_size);
+    return true;
+}
+
+/**
+ * Prefetch the cache lines a lookup in a bucket will touch first:
+ * the tophash/first keys and the first values.
+ *
+ * @param map Pointer to the hashmap
+ * @param bucket Pointer to the bucket
+ */
+static inline void prefetch_bucket(const hashmap *map, const char *bucket)
+{
+    PREFETCH(bucket);
+    PREFETCH(bucket + map->values_offset);
+}
+
+/**
+ * Look up a batch of keys in three passes over a window of BATCH_WINDOW keys:
+ * hash every key and prefetch its bucket(s), then pick each chain and prefetch
+ * the first overflow bucket, then resolve the lookups. The cache misses of the
+ * whole window overlap instead of being taken one after another.
+ *
+ * @param map Pointer to the hashmap
+ * @param keys Array of n keys, key_size bytes each
+ * @param n Number of keys
+ * @param values_out Array of n values, filled for every key found
+ * @param found_out Optional array of n flags, set to whether each key was found
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return Number of keys found
+ */
+static ALWAYS_INLINE size_t get_batch_sized(const hashmap *map, const char *keys, size_t n, char *values_out,
+                                            bool *found_out, size_t key_size)
+{
+    uint64_t hashes[BATCH_WINDOW];
+    uint64_t probe_hashes[BATCH_WINDOW];
+    char *buckets[BATCH_WINDOW];
+    size_t found = 0;
+
+    for (size_t base = 0; base < n; base += BATCH_WINDOW)
+    {
+        size_t window = n - base < BATCH_WINDOW ? n - base : BATCH_WINDOW;
+        const char *window_keys = keys + base * map->key_size;
+
+        for (size_t i = 0; i < window; i++)
+        {
+            hashes[i] = map_hash(map, window_keys + i * map->key_size);
+            prefetch_bucket(map, get_bucket(map, map->buckets, bucket_index(hashes[i], map->bucket_count)));
+            if (map->old_buckets)
+            {
+                prefetch_bucket(map, get_bucket(map, map->old_buckets, bucket_index(hashes[i], map->old_bucket_count)));
+            }
+        }
+
+        for (size_t i = 0; i < window; i++)
+        {
+            probe_hashes[i] = hashes[i];
+            buckets[i] = lookup_bucket(map, window_keys + i * map->key_size, &probe_hashes[i]);
+            char *overflow = get_overflow(map, buckets[i]);
+            if (overflow)
+            {
+                PREFETCH(overflow);
+            }
+        }
+
+        for (size_t i = 0; i < window; i++)
+        {
+            const char *key = window_keys + i * map->key_size;
+            char *stored_value;
+            if (map->spill_offset)
+            {
+                // Maps that spill also search neighbors, which the full lookup handles
+                stored_value = find_value_sized(map, key, hashes[i], key_size);
+            }
+            else
+            {
+                uint64_t probed = 0;
+                stored_value = chain_find_sized(map, buckets[i], probe_hashes[i], key, key_size, &probed);
+                record_lookup(map, probed);
+            }
+            if (stored_value)
+            {
+                memcpy(values_out + (base + i) * map->value_size, stored_value, map->value_size);
+                found++;
+            }
+            if (found_out)
+            {
+                found_out[base + i] = stored_value != NULL;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * Retrieve the values for a batch of keys, overlapping their memory latency.
+ * Equivalent to calling hashmap_get() for each key, but hashes every key and
+ * prefetches its bucket before resolving any of them.
+ *
+ * @param map Pointer to the hashmap
+ * @param keys Array of n keys stored contiguously (key_size bytes each)
+ * @param n Number of keys
+ * @param values_out Array of n values (value_size bytes each); entries for missing keys are left untouched
+ * @param found_out Optional array of n flags, set to whether each key was found (may be NULL)
+ * @return Number of keys found (0 on NULL parameters)
+ */
+size_t hashmap_get_batch(const hashmap *map, const void *keys, size_t n, void *values_out, bool *found_out)
+{
+    if (!map || !keys || !values_out)
+    {
+        return 0;
+    }
+    DISPATCH_KEY_SIZE(map, get_batch_sized, map, (const char *)keys, n, (char *)values_out, found_out);
+}
+
+/**
+ * Start a staged lookup: hash the key, pick its chain like lookup_bucket() and
+ * prefetch the head bucket.
+ *
+ * @param lookup Lookup state to initialize
+ * @param map Pointer to the hashmap, or NULL
+ * @param key Pointer to the key, or NULL
+ */
+void hashmap_lookup_begin(hashmap_lookup *lookup, const hashmap *map, const void *key)
+{
+    if (!lookup)
+    {
+        return;
+    }
+    lookup->map = map;
+    lookup->key = key;
+    lookup->bucket = NULL;
+    lookup->value = NULL;
+    lookup->probed = 0;
+    if (!map || !key)
+    {
+        // Settled already, as not found
+        return;
+    }
+    lookup->hash = map_hash(map, key);
+    lookup->probe_hash = lookup->hash;
+    char *bucket = lookup_bucket(map, key, &lookup->probe_hash);
+    prefetch_bucket(map, bucket);
+    lookup->bucket = bucket;
+}
+
+/**
+ * Scan the bucket a staged lookup prefetched last. A match or the end of the
+ * chain settles the lookup, otherwise the next overflow bucket is prefetched.
+ * Maps that spill into neighbors (HASHMAP_NEIGHBORHOOD) resolve a key missing
+ * from its chain with a full, unstaged lookup, which also covers entries
+ * moved by growth from a neighbor.
+ *
+ * @param lookup Unsettled lookup
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return true once the lookup is settled
+ */
+static ALWAYS_INLINE bool lookup_resume_sized(hashmap_lookup *lookup, size_t key_size)
+{
+    const hashmap *map = lookup->map;
+    char *bucket = lookup->bucket;
+    lookup->probed++;
+    int slot = bucket_match_sized(map, bucket, lookup->probe_hash, lookup->key, key_size, true);
+    if (slot >= 0)
+    {
+        lookup->value = value_data(map, bucket, slot);
+        lookup->bucket = NULL;
+        if (map->indirect_values)
+        {
+            // The value lives out of line: start loading it before finish copies it
+            PREFETCH(lookup->value);
+        }
+        record_lookup(map, lookup->probed);
+        return true;
+    }
+    char *next = has_empty_rest(get_tophash(bucket)) ? NULL : get_overflow(map, bucket);
+    if (next)
+    {
+        prefetch_bucket(map, next);
+        lookup->bucket = next;
+        return false;
+    }
+    lookup->bucket = NULL;
+    if (map->spill_offset)
+    {
+        lookup->value = find_value_sized(map, lookup->key, lookup->hash, key_size);
+        return true;
+    }
+    record_lookup(map, lookup->probed);
+    return true;
+}
+
+/**
+ * Run the next stage of a staged lookup (see lookup_resume_sized()).
+ *
+ * @param lookup Lookup from hashmap_lookup_begin()
+ * @return true once the lookup is settled, false if another call is needed
+ */
+bool hashmap_lookup_resume(hashmap_lookup *lookup)
+{
+    if (!lookup || !lookup->bucket)
+    {
+        return true;
+    }
+    DISPATCH_KEY_SIZE(lookup->map, lookup_resume_sized, lookup);
+}
+
+/**
+ * Complete a staged lookup, running any stages still left.
+ *
+ * @param lookup Lookup from hashmap_lookup_begin()
+ * @param value_out Optional; receives a copy of the value if the key was found
+ * @return Pointer to the stored value, or NULL if not found
+ */
+void *hashmap_lookup_finish(hashmap_lookup *lookup, void *value_out)
+{
+    if (!lookup)
+    {
+        return NULL;
+    }
+    while (!hashmap_lookup_resume(lookup))
+    {
+    }
+    if (lookup->value && value_out)
+    {
+        memcpy(value_out, lookup->value, lookup->map->value_size);
+    }
+    return lookup->value;
+}
+
+/**
+ * Insert a batch of key-value pairs in windows of BATCH_WINDOW entries: hash the
+ * window and prefetch its buckets, then insert each entry. An insert that
+ * reseeds the map makes the rest of the window be hashed again.
+ *
+ * @param map Pointer to the hashmap
+ * @param keys Array of n keys
+ * @param values Array of n values
+ * @param n Number of entries
+ * @param unique Keys are known to be distinct and absent from the map
+ * @param key_size Constant key size when specialized, 0 to use map->key_size
+ * @return Number of entries stored before an allocation failure (n on success)
+ */
+static ALWAYS_INLINE size_t put_batch_sized(hashmap *map, const char *keys, const char *values, size_t n,
+                                            bool unique, size_t key_size)
+{
+    uint64_t hashes[BATCH_WINDOW];
+
+    for (size_t base = 0; base < n; base += BATCH_WINDOW)
+    {
+        size_t window = n - base < BATCH_WINDOW ? n - base : BATCH_WINDOW;
+        const char *window_keys = keys + base * map->key_size;
+        const char *window_values = values + base * map->value_size;
+        uint64_t seed = map->hash_seed;
+
+        for (size_t i = 0; i < window; i++)
+        {
+            hashes[i] = map_hash(map, window_keys + i * map->key_size);
+            prefetch_bucket(map, get_bucket(map, map->buckets, bucket_index(hashes[i], map->bucket_count)));
+        }
+
+        for (size_t i = 0; i < window; i++)
+        {
+            if (map->hash_seed != seed)
+            {
+                // An earlier insert reseeded the map: the remaining hashes are stale
+                seed = map->hash_seed;
+                for (size_t j = i; j < window; j++)
+                {
+                    hashes[j] = map_hash(map, window_keys + j * map->key_size);
+                }
+            }
+            const char *key = window_keys + i * map->key_size;
+            const char *value = window_values + i * map->value_size;
+            if (unique)
+            {
+                if (!insert_unique(map, key, value, hashes[i]))
+                {
+                    return base + i;
+                }
+                continue;
+            }
+            bool inserted;
+            char *value_dest = claim_slot_sized(map, key, hashes[i], &inserted, key_size);
+            if (!value_dest)
+            {
+                return base + i;
+            }
+            memcpy(value_dest, value, map->value_size);
+        }
+    }
+    return n;
+}
+
+/**
+ * Insert or update a batch of key-value pairs.
+ * Reserves room for n more entries up front, so the table is resized at most
+ * once, then inserts with each window's buckets prefetched. With
+ * HASHMAP_BATCH_UNIQUE the duplicate-key search is skipped entirely; the caller
+ * guarantees the keys are distinct and not already in the map.
+ *
+ * @param map Pointer to the hashmap
+ * @param keys Array of n keys stored contiguously (key_size bytes each)
+ * @param values Array of n values stored contiguously (value_size bytes each)
+ * @param n Number of entries
+ * @param flags 0 or HASHMAP_BATCH_UNIQUE
+ * @return Number of entries stored; less than n only on allocation failure (0 on NULL parameters)
+ */
+size_t hashmap_put_batch(hashmap *map, const void *keys, const void *values, size_t n, unsigned flags)
+{
+    if (!map || !keys || !values)
+    {
+        return 0;
+    }
+    // A failed reservation only means the map grows step by step instead
+    if (n <= SIZE_MAX - map->count)
+    {
+        hashmap_reserve(map, map->count + n);
+    }
+    bool unique = (flags & HASHMAP_BATCH_UNIQUE) != 0;
+    DISPATCH_KEY_SIZE(map, put_batch_sized, map, (const char *)keys, (const char *)values, n, unique);
+}
+
+/**
+ * Create a hashmap sized for n entries and fill it from arrays of keys and values.
+ * options->capacity is raised to n if smaller.
+ *
+ * @param key_size Size of keys in bytes (must be > 0)
+ * @param value_size Size of values in bytes (must be > 0)
+ * @param hash Hash function pointer, or NULL for a bundled hash picked by key_size
+ * @param equals Equality comparison function pointer, or NULL to compare keys bytewise
+ * @param options Creation options, or NULL for defaults
+ * @param keys Array of n keys stored contiguously
+ * @param values Array of n values stored contiguously
+ * @param n Number of entries
+ * @param flags 0 or HASHMAP_BATCH_UNIQUE (keys are distinct)
+ * @return Pointer to the filled hashmap, or NULL on failure
+ */
+hashmap *hashmap_build(size_t key_size, size_t value_size, hash_fn hash, equals_fn equals,
+                       const hashmap_options *options, const void *keys, const void *values, size_t n,
+                       unsigned flags)
+{
+    if (n > 0 && (!keys || !values))
+    {
+        return NULL;
+    }
+    hashmap_options sized = {0};
+    if (options)
+    {
+        sized = *options;
+    }
+    if (sized.capacity < n)
+    {
+        sized.capacity = n;
+    }
+    hashmap *map = hashmap_create_ex(key_size, value_size, hash, equals, &sized);
+    if (!map)
+    {
+        return NULL;
+    }
+    if (n > 0 && hashmap_put_batch(map, keys, values, n, flags) != n)
+    {
+        hashmap_destroy(map);
+        return NULL;
+    }
+    return map;
+}
+
+/**
+ * Retrieve the value associated with a key from the hashmap.
+ * Searches the appropriate bucket and its overflow chain for the key.
+ * While the map is growing, searches the old bucket if it has not been evacuated yet.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to search for
+ * @param out_value Pointer to memory where the value will be copied if found
+ * @return true if key was found and value copied to out_value, false otherwise
+ */
+bool hashmap_get(const hashmap *map, const void *key, void *out_value)
+{
+    if (!map || !key || !out_value)
+    {
+        return false;
+    }
+
+    return hashmap_get_hashed(map, key, map_hash(map, key), out_value);
+}
+
+/**
+ * Retrieve the value for a key whose hash the caller already computed with
+ * hashmap_key_hash().
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to search for
+ * @param hash hashmap_key_hash(map, key)
+ * @param out_value Pointer to memory where the value will be copied if found
+ * @return true if key was found and value copied to out_value, false otherwise
+ */
+bool hashmap_get_hashed(const hashmap *map, const void *key, uint64_t hash, void *out_value)
+{
+    char *stored_value = find_value(map, key, hash);
+    if (!stored_value)
+    {
+        return false;
+    }
+    memcpy(out_value, stored_value, map->value_size);
+    return true;
+}
+
+/**
+ * Return a pointer to the value stored for a key, without copying it.
+ * The value may be modified in place through the pointer.
+ * The pointer is invalidated by the next put, delete or other mutation of the map.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to search for
+ * @return Pointer to the stored value, or NULL if the key is absent or parameters are NULL
+ */
+void *hashmap_get_ptr(const hashmap *map, const void *key)
+{
+    if (!map || !key)
+    {
+        return NULL;
+    }
+    return find_value(map, key, map_hash(map, key));
+}
+
+/**
+ * Free an occupied slot, keeping the EMPTY_REST invariant of its chain.
+ * The slot becomes EMPTY_ONE; if nothing occupied follows it, that slot and the
+ * run of EMPTY_ONE slots before it are turned into EMPTY_REST (walking back
+ * across overflow buckets as needed) so later probes stop as early as possible.
+ *
+ * @param map Pointer to the hashmap
+ * @param head Pointer to the head bucket of the chain holding the slot
+ * @param bucket Bucket of the chain holding the slot
+ * @param slot Index of the slot within bucket
+ */
+static void remove_slot(hashmap *map, char *head, char *bucket, int slot)
+{
+    uint8_t *tophash = get_tophash(bucket);
+    tophash[slot] = EMPTY_ONE;
+    if (map->indirect_keys)
+    {
+        pool_free(&map->key_pool, key_data(bucket, map->key_stride, slot, true));
+    }
+    if (map->indirect_values)
+    {
+        pool_free(&map->value_pool, value_data(map, bucket, slot));
+    }
+
+    // Is anything occupied after this slot?
+    if (slot == BUCKET_SIZE - 1)
+    {
+        char *next = get_overflow(map, bucket);
+        if (next && get_tophash(next)[0] != EMPTY_REST)
+        {
+            return;
+        }
+    }
+    else if (tophash[slot + 1] != EMPTY_REST)
+    {
+        return;
+    }
+
+    // Convert the trailing run of EMPTY_ONE slots to EMPTY_REST
+    for (;;)
+    {
+        tophash[slot] = EMPTY_REST;
+        if (slot == 0)
+        {
+            if (bucket == head)
+            {
+                break;
+            }
+            // Find the previous bucket in the chain
+            char *previous = head;
+            while (get_overflow(map, previous) != bucket)
+            {
+                previous = get_overflow(map, previous);
+            }
+            bucket = previous;
+            tophash = get_tophash(bucket);
+            slot = BUCKET_SIZE - 1;
+        }
+        else
+        {
+            slot--;
+        }
+        if (tophash[slot] != EMPTY_ONE)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Remove a key from a bucket chain (see remove_slot()).
+ *
+ * @param map Pointer to the hashmap
+ * @param head Pointer to the head bucket of the chain
+ * @param hash Hash of the key (in the seed of the chain's bucket array)
+ * @param key Pointer to the key to remove
+ * @return true if the key was found and removed
+ */
+static bool chain_remove(hashmap *map, char *head, uint64_t hash, const void *key)
+{
+    for (char *bucket = head; bucket; bucket = get_overflow(map, bucket))
+    {
+        int slot = bucket_match_sized(map, bucket, hash, key, 0, false);
+        if (slot >= 0)
+        {
+            remove_slot(map, head, bucket, slot);
+            return true;
+        }
+        if (has_empty_rest(get_tophash(bucket)))
+        {
+            break;
+        }
+    }
+    return false;
+}
+
+/**
+ * Remove a key from the neighbors its home bucket spilled into (HASHMAP_NEIGHBORHOOD).
+ *
+ * @param map Pointer to the hashmap
+ * @param buckets Bucket array holding the home bucket
+ * @param bucket_count Number of buckets in the array
+ * @param idx Index of the key's home bucket
+ * @param hash Hash of the key (in the seed of the array)
+ * @param key Pointer to the key to remove
+ * @param moved Set to true if a neighbor holding spilled entries has been evacuated
+ * @return true if the key was found and removed
+ */
+static bool spill_remove(hashmap *map, char *buckets, size_t bucket_count, size_t idx, uint64_t hash,
+                         const void *key, bool *moved)
+{
+    uint8_t *counts = spill_counts(map, get_bucket(map, buckets, idx));
+    for (size_t distance = 1; distance <= NEIGHBOR_BUCKETS; distance++)
+    {
+        if (!counts[distance - 1])
+        {
+            continue;
+        }
+        char *neighbor = get_bucket(map, buckets, neighbor_index(idx, distance, bucket_count));
+        if (is_evacuated(neighbor))
+        {
+            *moved = true;
+            continue;
+        }
+        int slot = bucket_match_sized(map, neighbor, hash, key, 0, false);
+        if (slot >= 0)
+        {
+            remove_slot(map, neighbor, neighbor, slot);
+            counts[distance - 1]--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Remove a key from its home chain in a bucket array, then from the neighbors
+ * the home bucket spilled into.
+ *
+ * @param map Pointer to the hashmap
+ * @param buckets Bucket array to search
+ * @param bucket_count Number of buckets in the array
+ * @param hash Hash of the key (in the seed of the array)
+ * @param key Pointer to the key to remove
+ * @param moved Set to true if a neighbor holding spilled entries has been evacuated
+ * @return true if the key was found and removed
+ */
+static bool array_remove(hashmap *map, char *buckets, size_t bucket_count, uint64_t hash, const void *key,
+                         bool *moved)
+{
+    size_t idx = bucket_index(hash, bucket_count);
+    if (chain_remove(map, get_bucket(map, buckets, idx), hash, key))
+    {
+        return true;
+    }
+    return map->spill_offset && spill_remove(map, buckets, bucket_count, idx, hash, key, moved);
+}
+
+/**
+ * Remove a key-value pair from the hashmap.
+ * Frees the slot (marking it EMPTY_ONE/EMPTY_REST) but does not free overflow
+ * buckets (to maintain chain integrity); hashmap_compact() and
+ * hashmap_shrink_to_fit() reclaim them. With shrink_percent set, a delete that
+ * leaves the map below the threshold starts an incremental shrink.
+ * While the map is growing, evacuates the key's old bucket plus one more first;
+ * if that fails for lack of memory the key is removed from the old bucket instead.
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to remove
+ * @return true if key was found and removed, false if key not found or NULL parameters
+ */
+bool hashmap_delete(hashmap *map, const void *key)
+{
+    if (!map || !key)
+    {
+        return false;
+    }
+    return hashmap_delete_hashed(map, key, map_hash(map, key));
+}
 
-    uint64_t hash = map->hash(key, map->key_size);
-    uint8_t top = top_hash(hash);
-    size_t idx = bucket_index(hash, map->bucket_count);
+/**
+ * Remove a key whose hash the caller already computed with hashmap_key_hash().
+ *
+ * @param map Pointer to the hashmap
+ * @param key Pointer to the key to remove
+ * @param hash hashmap_key_hash(map, key)
+ * @return true if key was found and removed, false otherwise
+ */
+bool hashmap_delete_hashed(hashmap *map, const void *key, uint64_t hash)
+{
+    bool moved = false;
+    bool removed = false;
+    bool searched = false;
+    if (map->old_buckets)
+    {
+        uint64_t old_hash = old_array_hash(map, key, hash);
+        if (!growth_work(map, old_hash) &&
+            !is_evacuated(get_bucket(map, map->old_buckets, bucket_index(old_hash, map->old_bucket_count))))
+        {
+            removed = array_remove(map, map->old_buckets, map->old_bucket_count, old_hash, key, &moved);
+            searched = true;
+        }
+    }
+    // A key spilled into an old neighbor that was evacuated first lives in the new array
+    if (!searched || (!removed && moved))
+    {
+        removed = array_remove(map, map->buckets, map->bucket_count, hash, key, &moved);
+    }
+    if (!removed)
+    {
+        return false;
+    }
+    map->count--;
 
-    char *bucket = get_bucket(map->buckets, map->key_size, map->value_size, idx);
-    char *insert_bucket = bucket;
-    int insert_slot = -1;
+    if (map->shrink_percent && !map->old_buckets && map->bucket_count > INITIAL_BUCKET_COUNT &&
+        under_shrink_threshold(map))
+    {
+        // Size for twice the remaining entries so re-inserts do not grow right away;
+        // the move is incremental, like growth. On allocation failure keep the array
+        size_t bucket_count = buckets_for_capacity(map->count * 2);
+        if (bucket_count != 0 && bucket_count < map->bucket_count)
+        {
+            start_growth(map, bucket_count);
+        }
+    }
+    return true;
+}
 
-    char *current_bucket = bucket;
-    char *last_bucket = bucket;
-    while (current_bucket)
+/**
+ * Start iterating over a hashmap.
+ * Old buckets that are not evacuated yet are visited before the new bucket
+ * array; the two sets of entries are disjoint, so no entry is seen twice.
+ *
+ * @param iter Iterator to initialize
+ * @param map The hashmap (NULL yields an empty iteration)
+ */
+void hashmap_iter_init(hashmap_iter *iter, const hashmap *map)
+{
+    if (!iter)
     {
-        uint8_t *tophash = get_tophash(current_bucket);
-        for (int i = 0; i < BUCKET_SIZE; i++)
+        return;
+    }
+    iter->map = map;
+    iter->bucket = NULL;
+    iter->index = 0;
+    iter->full = 0;
+    iter->old = map && map->old_buckets;
+    if (iter->old)
+    {
+        // Both arrays are walked, so no worker may still be moving entries
+        settle_all(map);
+    }
+}
+
+/**
+ * Advance to the next occupied slot.
+ * Walks each bucket array linearly, following overflow chains, and uses the
+ * occupied-slot mask of each bucket so empty slots cost nothing.
+ *
+ * @param iter Iterator from hashmap_iter_init()
+ * @param key_out Optional; set to the stored key
+ * @param value_out Optional; set to the stored value
+ * @return true if an entry was produced, false when the iteration is done
+ */
+bool hashmap_iter_next(hashmap_iter *iter, const void **key_out, void **value_out)
+{
+    if (!iter || !iter->map)
+    {
+        return false;
+    }
+    const hashmap *map = iter->map;
+
+    while (!iter->full)
+    {
+        char *bucket = iter->bucket ? get_overflow(map, iter->bucket) : NULL;
+        while (!bucket)
         {
-            // Remember first empty slot we find
-            if (tophash[i] == EMPTY)
+            char *buckets = iter->old ? map->old_buckets : map->buckets;
+            size_t bucket_count = iter->old ? map->old_bucket_count : map->bucket_count;
+            if (iter->index == bucket_count)
             {
-                if (insert_slot == -1)
+                if (!iter->old)
                 {
-                    insert_bucket = current_bucket;
-                    insert_slot = i;
+                    // Done; further calls keep returning false
+                    iter->map = NULL;
+                    return false;
                 }
-                // Continue searching for existing key
+                iter->old = false;
+                iter->index = 0;
                 continue;
             }
-
-            // Check if this slot matches our key
-            if (tophash[i] == top)
+            bucket = get_bucket(map, buckets, iter->index++);
+            // Entries of an evacuated old bucket are reached through the new array
+            if (iter->old && is_evacuated(bucket))
             {
-                char *existing_key = get_key(current_bucket, map->key_size, i);
-                if (map->equals(existing_key, key, map->key_size))
-                {
-                    // Found existing key - update value
-                    char *existing_value = get_value(current_bucket, map->key_size, map->value_size, i);
-                    memcpy(existing_value, value, map->value_size);
-                    return true;
-                }
+                bucket = NULL;
             }
         }
-        last_bucket = current_bucket;
-        current_bucket = get_overflow(current_bucket, map->key_size, map->value_size);
+        iter->bucket = bucket;
+        iter->full = match_full(get_tophash(bucket));
     }
 
-    if (insert_slot == -1)
+    int i = mask_first(iter->full);
+    iter->full = mask_next(iter->full);
+    if (key_out)
     {
-        char *overflow = alloc_bucket(map->key_size, map->value_size);
-        if (!overflow)
-        {
-            return false;
-        }
-        set_overflow(last_bucket, overflow, map->key_size, map->value_size);
-        insert_bucket = overflow;
-        insert_slot = 0;
+        *key_out = key_data(iter->bucket, map->key_stride, i, map->indirect_keys);
     }
-    uint8_t *tophash = get_tophash(insert_bucket);
-    tophash[insert_slot] = top;
-
-    char *key_dest = get_key(insert_bucket, map->key_size, insert_slot);
-    memcpy(key_dest, key, map->key_size);
-
-    char *value_dest = get_value(insert_bucket, map->key_size, map->value_size, insert_slot);
-    memcpy(value_dest, value, map->value_size);
+    if (value_out)
+    {
+        *value_out = value_data(map, iter->bucket, i);
+    }
+    return true;
+}
 
-    map->count++;
+/**
+ * Header at the start of a snapshot file. The bucket array starts at
+ * data_offset (a multiple of CACHE_LINE_SIZE), followed by overflow_count
+ * overflow buckets; overflow links are self-relative, so they need no fixup.
+ */
+struct snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t key_size;
+    uint64_t value_size;
+    uint64_t layout_flags;
+    uint64_t bucket_size;
+    uint64_t bucket_count;
+    uint64_t overflow_count;
+    uint64_t count;
+    uint64_t hash_seed;
+    uint64_t data_offset;
+};
 
-    // Check if we need to grow (load factor check)
-    if (map->count * LOAD_FACTOR_DENOMINATOR >
-        map->bucket_count * BUCKET_SIZE * LOAD_FACTOR_NUMERATOR)
+/**
+ * Write a whole buffer to a file descriptor, retrying short writes.
+ *
+ * @param fd Destination file descriptor
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @return true on success, false on a write error
+ */
+static bool write_all(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+    while (size > 0)
     {
-        // TODO: Implement growth/rehashing
+        ssize_t written = write(fd, p, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        size -= (size_t)written;
     }
     return true;
 }
 
 /**
- * Retrieve the value associated with a key from the hashmap.
- * Searches the appropriate bucket and its overflow chain for the key.
+ * Write a snapshot of the map to a file descriptor, at its current position.
+ * Finishes any growth in progress first so a single bucket array is written.
+ * Overflow buckets are compacted into one area after the bucket array, chain
+ * by chain, and every link is rewritten relative to the bucket's position in
+ * the file. Buckets are staged SNAPSHOT_WRITE_BUCKETS at a time.
  *
  * @param map Pointer to the hashmap
- * @param key Pointer to the key to search for
- * @param out_value Pointer to memory where the value will be copied if found
- * @return true if key was found and value copied to out_value, false otherwise
+ * @param fd File descriptor open for writing
+ * @return true on success, false on NULL map, allocation failure or write error
  */
-bool hashmap_get(const hashmap *map, const void *key, void *out_value)
+bool hashmap_save(hashmap *map, int fd)
 {
-    if (!map || !key || !out_value)
+    // Out-of-line keys and values are not part of the bucket array
+    if (!map || fd < 0 || map->indirect_keys || map->indirect_values || !finish_growth(map))
     {
         return false;
     }
 
-    uint64_t hash = map->hash(key, map->key_size);
-    uint8_t top = top_hash(hash);
-    size_t idx = bucket_index(hash, map->bucket_count);
+    uint64_t overflow_count = 0;
+    for (size_t i = 0; i < map->bucket_count; i++)
+    {
+        char *bucket = get_bucket(map, map->buckets, i);
+        for (char *overflow = get_overflow(map, bucket); overflow; overflow = get_overflow(map, overflow))
+        {
+            overflow_count++;
+        }
+    }
 
-    char *bucket = get_bucket(map->buckets, map->key_size, map->value_size, idx);
-    char *current_bucket = bucket;
+    struct snapshot_header header = {0};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.key_size = map->key_size;
+    header.value_size = map->value_size;
+    header.layout_flags = map->layout_flags;
+    header.bucket_size = map->bucket_size;
+    header.bucket_count = map->bucket_count;
+    header.overflow_count = overflow_count;
+    header.count = map->count;
+    header.hash_seed = map->hash_seed;
+    header.data_offset = (sizeof(header) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
 
-    while (current_bucket)
+    char padding[CACHE_LINE_SIZE] = {0};
+    if (!write_all(fd, &header, sizeof(header)) ||
+        !write_all(fd, padding, header.data_offset - sizeof(header)))
     {
-        uint8_t *tophash = get_tophash(current_bucket);
-        for (int i = 0; i < BUCKET_SIZE; i++)
+        return false;
+    }
+
+    size_t stage_size = SNAPSHOT_WRITE_BUCKETS * map->bucket_size;
+    char *stage = mem_alloc(&map->allocator, stage_size);
+    if (!stage)
+    {
+        return false;
+    }
+    bool ok = true;
+    size_t staged = 0;
+    uint64_t overflow_area = header.data_offset + header.bucket_count * map->bucket_size;
+
+    // Pass 1: the bucket array; each chain's overflow buckets get consecutive slots
+    uint64_t next_overflow = 0;
+    for (size_t i = 0; ok && i < map->bucket_count; i++)
+    {
+        char *bucket = get_bucket(map, map->buckets, i);
+        char *copy = stage + staged * map->bucket_size;
+        memcpy(copy, bucket, map->bucket_size);
+        intptr_t link = 0;
+        if (get_overflow(map, bucket))
         {
-            if (tophash[i] == EMPTY)
+            uint64_t position = header.data_offset + i * map->bucket_size;
+            link = (intptr_t)(overflow_area + next_overflow * map->bucket_size - position);
+            for (char *overflow = get_overflow(map, bucket); overflow; overflow = get_overflow(map, overflow))
             {
-                continue;
+                next_overflow++;
             }
-            if (tophash[i] == top)
+        }
+        set_overflow_offset(map, copy, link);
+        if (++staged == SNAPSHOT_WRITE_BUCKETS)
+        {
+            ok = write_all(fd, stage, staged * map->bucket_size);
+            staged = 0;
+        }
+    }
+
+    // Pass 2: the overflow area, in the same chain order, each linking to the next slot
+    for (size_t i = 0; ok && i < map->bucket_count; i++)
+    {
+        char *bucket = get_bucket(map, map->buckets, i);
+        for (char *overflow = get_overflow(map, bucket); ok && overflow; overflow = get_overflow(map, overflow))
+        {
+            char *copy = stage + staged * map->bucket_size;
+            memcpy(copy, overflow, map->bucket_size);
+            set_overflow_offset(map, copy, get_overflow(map, overflow) ? (intptr_t)map->bucket_size : 0);
+            if (++staged == SNAPSHOT_WRITE_BUCKETS)
             {
-                char *stored_key = get_key(current_bucket, map->key_size, i);
-                if (map->equals(stored_key, key, map->key_size))
-                {
-                    char *stored_value = get_value(current_bucket, map->key_size, map->value_size, i);
-                    memcpy(out_value, stored_value, map->value_size);
-                    return true;
-                }
+                ok = write_all(fd, stage, staged * map->bucket_size);
+                staged = 0;
             }
         }
-        current_bucket = get_overflow(current_bucket, map->key_size, map->value_size);
     }
-    return false;
+    if (ok && staged > 0)
+    {
+        ok = write_all(fd, stage, staged * map->bucket_size);
+    }
+    mem_free(&map->allocator, stage, stage_size);
+    return ok;
 }
 
 /**
- * Remove a key-value pair from the hashmap.
- * Marks the slot as EMPTY but does not free overflow buckets (to maintain chain integrity).
+ * Check a snapshot header against the size of the file holding it.
  *
- * @param map Pointer to the hashmap
- * @param key Pointer to the key to remove
- * @return true if key was found and removed, false if key not found or NULL parameters
+ * @param header Header read from the start of the file
+ * @param file_size Size of the file in bytes
+ * @return true if the header describes a complete snapshot of this format
  */
-bool hashmap_delete(hashmap *map, const void *key)
+static bool snapshot_header_valid(const struct snapshot_header *header, size_t file_size)
 {
-    if (!map || !key)
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header->version != SNAPSHOT_VERSION || header->byte_order != SNAPSHOT_BYTE_ORDER)
+    {
+        return false;
+    }
+    if (header->key_size == 0 || header->value_size == 0 || header->bucket_size == 0 ||
+        header->bucket_count == 0 || (header->bucket_count & (header->bucket_count - 1)) != 0 ||
+        header->data_offset < sizeof(*header) || header->data_offset % CACHE_LINE_SIZE != 0 ||
+        header->data_offset > file_size || (header->layout_flags & ~(uint64_t)LAYOUT_FLAGS) != 0)
+    {
+        return false;
+    }
+    // hashmap_save() refuses maps with out-of-line keys or values, whose pointers would be meaningless
+    if (header->layout_flags & (HASHMAP_INDIRECT_KEYS | HASHMAP_INDIRECT_VALUES))
     {
         return false;
     }
+    uint64_t buckets = header->bucket_count + header->overflow_count;
+    return buckets >= header->bucket_count && buckets <= (file_size - header->data_offset) / header->bucket_size;
+}
 
-    uint64_t hash = map->hash(key, map->key_size);
-    uint8_t top = top_hash(hash);
-    size_t idx = bucket_index(hash, map->bucket_count);
-    char *bucket = get_bucket(map->buckets, map->key_size, map->value_size, idx);
-    char *current_bucket = bucket;
-}
\ No newline at end of file
+/**
+ * Check the buckets of a mapped snapshot before the map uses them: every
+ * overflow link must point forward to a whole bucket of the overflow area (so
+ * chains stay inside the mapping and end), no bucket may carry the EVACUATED
+ * marker, and the occupied slots must add up to the recorded count. Only the
+ * tophashes and link of each bucket are read.
+ *
+ * @param map Map created with the snapshot's layout
+ * @param header Header accepted by snapshot_header_valid()
+ * @param data Start of the bucket array in the mapping
+ * @return true if the buckets are consistent
+ */
+static bool snapshot_buckets_valid(const hashmap *map, const struct snapshot_header *header, char *data)
+{
+    uint64_t total = header->bucket_count + header->overflow_count;
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < total; i++)
+    {
+        char *bucket = data + i * map->bucket_size;
+        const uint8_t *tophash = get_tophash(bucket);
+        if (tophash[0] == EVACUATED)
+        {
+            return false;
+        }
+        for (int slot = 0; slot < BUCKET_SIZE; slot++)
+        {
+            count += tophash[slot] >= MIN_TOP_HASH;
+        }
+        intptr_t link;
+        memcpy(&link, bucket + map->overflow_offset, sizeof(link));
+        if (link == 0)
+        {
+            continue;
+        }
+        if (link < 0 || (uint64_t)link % map->bucket_size != 0)
+        {
+            return false;
+        }
+        uint64_t step = (uint64_t)link / map->bucket_size;
+        if (step >= total - i || i + step < header->bucket_count)
+        {
+            return false;
+        }
+    }
+    return count == header->count;
+}
+
+/**
+ * Open a snapshot written by hashmap_save() by mapping it into memory.
+ * The file is mapped private (copy-on-write): nothing is copied up front and
+ * later mutations only ever touch private copies of the pages they modify; the
+ * file itself is never changed. Every bucket's tophashes and overflow link are
+ * checked once (see snapshot_buckets_valid()), so a truncated or corrupt file
+ * is rejected instead of sending lookups outside the mapping.
+ * Buckets added by growth come from the allocator as usual; the mapping is
+ * released by hashmap_destroy().
+ *
+ * @param path Path of the snapshot file
+ * @param hash Hash function the map was created with (NULL for the bundled hash)
+ * @param equals Equality function the map was created with, or NULL
+ * @param options Options for the opened map (capacity and layout flags are taken from the file), or NULL
+ * @return Pointer to the hashmap, or NULL if the file cannot be mapped or is not a valid snapshot
+ */
+hashmap *hashmap_open_mmap(const char *path, hash_fn hash, equals_fn equals, const hashmap_options *options)
+{
+    if (!path)
+    {
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct snapshot_header) ||
+        (uint64_t)st.st_size > SIZE_MAX)
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    char *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    struct snapshot_header header;
+    memcpy(&header, mapping, sizeof(header));
+    if (!snapshot_header_valid(&header, size))
+    {
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    hashmap_options opened = {0};
+    if (options)
+    {
+        opened = *options;
+    }
+    opened.capacity = 0;
+    opened.flags = (opened.flags & ~LAYOUT_FLAGS) | (unsigned)header.layout_flags;
+    hashmap *map = hashmap_create_ex(header.key_size, header.value_size, hash, equals, &opened);
+    // A damaged key or value size could also pick out-of-line storage by itself
+    if (!map || map->bucket_size != header.bucket_size || map->indirect_keys || map->indirect_values ||
+        !snapshot_buckets_valid(map, &header, mapping + header.data_offset))
+    {
+        hashmap_destroy(map);
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    free_buckets(map, map->buckets, map->bucket_count);
+    map->buckets = mapping + header.data_offset;
+    map->bucket_count = header.bucket_count;
+    map->count = header.count;
+    map->hash_seed = header.hash_seed;
+    map->old_seed = header.hash_seed;
+    map->mapping = mapping;
+    map->mapping_size = size;
+    return map;
+}
@@ -0,0 +1,137 @@
+#ifndef HASHMAP_INTERNAL_H
+#define HASHMAP_INTERNAL_H
+
+#include "hashmap.h"
+
+/*
+ * Entry points for code layered on top of hashmap inside the library
+ * (e.g. concurrent_hashmap). They skip the NULL checks of the public API and
+ * take the key's hash precomputed, so a wrapper that needs the hash itself
+ * does not hash the key twice.
+ */
+
+/**
+ * Allocator used when hashmap_options.allocator is NULL: malloc, free and
+ * calloc (large zero-filled blocks come from the OS as untouched pages)
+ */
+extern const hashmap_allocator hashmap_default_allocator;
+
+/**
+ * Seeded hash of a key, as used for bucket selection
+ *
+ * @param map The hashmap
+ * @param key Pointer to key data
+ * @return 64-bit hash
+ */
+uint64_t hashmap_key_hash(const hashmap *map, const void *key);
+
+/**
+ * hashmap_key_hash with an explicit seed instead of the map's
+ *
+ * @param map The hashmap
+ * @param key Pointer to key data
+ * @param seed Seed to hash with
+ * @return 64-bit hash
+ */
+uint64_t hashmap_key_hash_seeded(const hashmap *map, const void *key, uint64_t seed);
+
+/**
+ * The map's hash seed
+ *
+ * @param map The hashmap
+ * @return Seed mixed into every key hash
+ */
+uint64_t hashmap_seed(const hashmap *map);
+
+/**
+ * Replace the map's random hash seed so several maps hash keys identically
+ * A map that reseeds afterwards leaves the shared seed; hashmap_seed tells.
+ *
+ * @param map The hashmap (must be empty)
+ * @param seed New seed
+ */
+void hashmap_set_seed(hashmap *map, uint64_t seed);
+
+/**
+ * Whether the map, created with HASHMAP_NO_RESEED, has seen a hash flood since
+ * the last call (at most once per table size, like a reseed)
+ *
+ * @param map The hashmap
+ * @return true if the owner should rebuild the map with a new seed
+ */
+bool hashmap_take_flood(hashmap *map);
+
+/**
+ * Have the map call wait(ctx) before unmapping a bucket array it mapped for
+ * HASHMAP_HUGE_PAGES or NUMA placement. Such arrays bypass allocator.free, so
+ * an allocator that defers frees for optimistic readers never sees them.
+ *
+ * @param map The hashmap
+ * @param wait Callback, or NULL for none
+ * @param ctx Argument passed to wait
+ */
+void hashmap_set_unmap_wait(hashmap *map, void (*wait)(void *ctx), void *ctx);
+
+/**
+ * Run parallel evacuation (hashmap_options.evacuation_threads) to completion
+ * inside the mutation that starts it, rather than in the background. Needed
+ * for maps read through hashmap_view: such readers cannot coordinate with
+ * the workers, only detect the writer.
+ *
+ * @param map The hashmap
+ */
+void hashmap_set_foreground_evacuation(hashmap *map);
+
+/**
+ * hashmap_put with a precomputed hashmap_key_hash
+ */
+bool hashmap_put_hashed(hashmap *map, const void *key, const void *value, uint64_t hash);
+
+/**
+ * Value slot for a key with a precomputed hashmap_key_hash, inserting the key
+ * if absent (the new slot is left uninitialized, *inserted set to true)
+ */
+void *hashmap_claim_hashed(hashmap *map, const void *key, uint64_t hash, bool *inserted);
+
+/**
+ * hashmap_get with a precomputed hashmap_key_hash
+ */
+bool hashmap_get_hashed(const hashmap *map, const void *key, uint64_t hash, void *value_out);
+
+/**
+ * hashmap_delete with a precomputed hashmap_key_hash
+ */
+bool hashmap_delete_hashed(hashmap *map, const void *key, uint64_t hash);
+
+/**
+ * Bucket array fields copied out of a map for an optimistic (lock-free) reader
+ */
+typedef struct hashmap_view
+{
+    char *buckets;
+    size_t bucket_count;
+    char *old_buckets;
+    size_t old_bucket_count;
+    uint64_t hash_seed;
+    uint64_t old_seed;
+} hashmap_view;
+
+/**
+ * Snapshot the bucket arrays and seeds of a map that a writer may be modifying
+ * (the map must use hashmap_set_foreground_evacuation).
+ *
+ * @param map The hashmap
+ * @param view Receives the snapshot
+ */
+void hashmap_load_view(const hashmap *map, hashmap_view *view);
+
+/**
+ * hashmap_get_hashed through a snapshot, with the key hashed under seed (the
+ * key is hashed again for arrays laid out by another seed); the result is only
+ * valid if no write overlapped the snapshot and the lookup, and the
+ * snapshot's arrays must not have been freed
+ */
+bool hashmap_view_get(const hashmap *map, const hashmap_view *view, const void *key, uint64_t hash,
+                      uint64_t seed, void *value_out);
+
+#endif
@@ -0,0 +1,510 @@
+#include "string_hashmap.h"
+#include "hashmap_internal.h"
+#include <stdint.h>
+#include <string.h>
+
+// Keys up to this length are stored inline in the bucket
+#define INLINE_KEY_MAX 15
+
+// Byte of the key payload holding the inline length, or LONG_KEY_TAG
+#define TAG_BYTE 15
+#define LONG_KEY_TAG 0xFF
+
+// Offsets of the arena pointer and the 32-bit length of a long key in the payload
+#define LONG_DATA_OFFSET 0
+#define LONG_LENGTH_OFFSET 8
+
+// Bytes per arena chunk; longer keys get a chunk of their own
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/**
+ * Key as stored in the underlying hashmap (24 bytes): the full seeded hash,
+ * then either the key bytes inline (payload[0..14], length in payload[15]) or
+ * a pointer to the arena copy and its length (payload[15] == LONG_KEY_TAG).
+ * Unused inline bytes are zero, so inline keys compare with one memcmp.
+ */
+struct string_key
+{
+    uint64_t hash;
+    unsigned char payload[16];
+};
+
+/**
+ * Block of key bytes. Keys are bump-allocated from the newest chunk and only
+ * released as a whole, when the arena is compacted or the map destroyed.
+ */
+struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct string_hashmap
+{
+    hashmap *map;
+    size_t value_size;
+    hashmap_options options; // Options the underlying map is (re)built with
+    bool reseed_enabled;     // Rebuild with a new seed on hash floods (no HASHMAP_NO_RESEED)
+    hashmap_allocator allocator;
+    struct arena_chunk *chunks; // Newest first; allocation happens in the head
+    size_t arena_used;          // Bytes handed out to long keys
+    size_t arena_garbage;       // Bytes of long keys deleted since
+};
+
+/**
+ * Hash callback for the underlying map: every key carries its own hash, so
+ * moving entries during growth never touches the key bytes.
+ *
+ * @param key Pointer to a struct string_key
+ * @param key_size Unused
+ * @param seed Unused (the stored hash was computed with the map's seed)
+ * @return The stored hash
+ */
+static uint64_t string_key_hash(const void *key, size_t key_size, uint64_t seed)
+{
+    (void)key_size;
+    (void)seed;
+    uint64_t hash;
+    memcpy(&hash, key, sizeof(hash));
+    return hash;
+}
+
+/**
+ * Get the arena pointer and length of a long key.
+ *
+ * @param key The stored key (payload[TAG_BYTE] == LONG_KEY_TAG)
+ * @param length_out Receives the key length
+ * @return Pointer to the key bytes
+ */
+static inline const char *long_key_data(const struct string_key *key, uint32_t *length_out)
+{
+    const char *data;
+    memcpy(&data, key->payload + LONG_DATA_OFFSET, sizeof(data));
+    memcpy(length_out, key->payload + LONG_LENGTH_OFFSET, sizeof(*length_out));
+    return data;
+}
+
+/**
+ * Hash a key record's bytes (inline or in the arena), ignoring its stored hash.
+ *
+ * @param key The key record
+ * @param seed Seed to hash with
+ * @return hashmap_hash_bytes() of the key bytes
+ */
+static uint64_t key_bytes_hash(const struct string_key *key, uint64_t seed)
+{
+    if (key->payload[TAG_BYTE] != LONG_KEY_TAG)
+    {
+        return hashmap_hash_bytes(key->payload, key->payload[TAG_BYTE], seed);
+    }
+    uint32_t length;
+    const char *data = long_key_data(key, &length);
+    return hashmap_hash_bytes(data, length, seed);
+}
+
+/**
+ * Equality callback for the underlying map. The full hashes are compared
+ * first, so the key bytes are only read on a (near certain) match.
+ *
+ * @param a First struct string_key
+ * @param b Second struct string_key
+ * @param key_size Unused
+ * @return true if both keys hold the same bytes
+ */
+static bool string_key_equals(const void *a, const void *b, size_t key_size)
+{
+    (void)key_size;
+    const struct string_key *x = a;
+    const struct string_key *y = b;
+    if (x->hash != y->hash || x->payload[TAG_BYTE] != y->payload[TAG_BYTE])
+    {
+        return false;
+    }
+    if (x->payload[TAG_BYTE] != LONG_KEY_TAG)
+    {
+        return memcmp(x->payload, y->payload, INLINE_KEY_MAX) == 0;
+    }
+    uint32_t x_length, y_length;
+    const char *x_data = long_key_data(x, &x_length);
+    const char *y_data = long_key_data(y, &y_length);
+    return x_length == y_length && (x_data == y_data || memcmp(x_data, y_data, x_length) == 0);
+}
+
+/**
+ * Build the stored form of a key, pointing long keys at the caller's bytes.
+ *
+ * @param map The string hashmap
+ * @param out Receives the key record
+ * @param key Pointer to the key bytes
+ * @param key_len Key length in bytes
+ * @return false if the key is too long to store
+ */
+static bool make_key(const string_hashmap *map, struct string_key *out, const void *key, size_t key_len)
+{
+    if (key_len > UINT32_MAX || (key_len && !key))
+    {
+        return false;
+    }
+    memset(out->payload, 0, sizeof(out->payload));
+    if (key_len <= INLINE_KEY_MAX)
+    {
+        if (key_len)
+        {
+            memcpy(out->payload, key, key_len);
+        }
+        out->payload[TAG_BYTE] = (unsigned char)key_len;
+    }
+    else
+    {
+        uint32_t length = (uint32_t)key_len;
+        memcpy(out->payload + LONG_DATA_OFFSET, &key, sizeof(key));
+        memcpy(out->payload + LONG_LENGTH_OFFSET, &length, sizeof(length));
+        out->payload[TAG_BYTE] = LONG_KEY_TAG;
+    }
+    out->hash = key_bytes_hash(out, hashmap_seed(map->map));
+    return true;
+}
+
+/**
+ * Allocate a chunk able to hold at least size bytes.
+ *
+ * @param map The string hashmap (for the allocator)
+ * @param size Minimum capacity in bytes
+ * @return New empty chunk, or NULL on allocation failure
+ */
+static struct arena_chunk *chunk_create(string_hashmap *map, size_t size)
+{
+    if (size < ARENA_CHUNK_SIZE)
+    {
+        size = ARENA_CHUNK_SIZE;
+    }
+    struct arena_chunk *chunk = map->allocator.alloc(map->allocator.ctx, sizeof(struct arena_chunk) + size);
+    if (!chunk)
+    {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+/**
+ * Free a list of chunks.
+ *
+ * @param map The string hashmap (for the allocator)
+ * @param chunk Head of the list
+ */
+static void chunks_free(string_hashmap *map, struct arena_chunk *chunk)
+{
+    while (chunk)
+    {
+        struct arena_chunk *next = chunk->next;
+        map->allocator.free(map->allocator.ctx, chunk, sizeof(struct arena_chunk) + chunk->size);
+        chunk = next;
+    }
+}
+
+/**
+ * Copy a long key into the arena.
+ *
+ * @param map The string hashmap
+ * @param key Pointer to the key bytes
+ * @param key_len Key length in bytes
+ * @return Pointer to the copy, or NULL on allocation failure
+ */
+static char *arena_copy(string_hashmap *map, const void *key, size_t key_len)
+{
+    struct arena_chunk *chunk = map->chunks;
+    if (!chunk || chunk->size - chunk->used < key_len)
+    {
+        chunk = chunk_create(map, key_len);
+        if (!chunk)
+        {
+            return NULL;
+        }
+        chunk->next = map->chunks;
+        map->chunks = chunk;
+    }
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, key, key_len);
+    chunk->used += key_len;
+    map->arena_used += key_len;
+    return copy;
+}
+
+/**
+ * Give back the most recent arena_copy() (the key turned out to be present).
+ *
+ * @param map The string hashmap
+ * @param key_len Length passed to arena_copy()
+ */
+static void arena_unwind(string_hashmap *map, size_t key_len)
+{
+    map->chunks->used -= key_len;
+    map->arena_used -= key_len;
+}
+
+/**
+ * Copy every live long key into one new chunk and release the old chunks once
+ * deleted keys make up most of the arena. Left as is if the chunk cannot be
+ * allocated.
+ *
+ * @param map The string hashmap
+ */
+static void arena_compact(string_hashmap *map)
+{
+    size_t live = map->arena_used - map->arena_garbage;
+    if (map->arena_garbage < ARENA_CHUNK_SIZE || map->arena_garbage < live)
+    {
+        return;
+    }
+    struct arena_chunk *chunk = chunk_create(map, live);
+    if (!chunk)
+    {
+        return;
+    }
+
+    hashmap_iter iter;
+    const void *stored;
+    hashmap_iter_init(&iter, map->map);
+    while (hashmap_iter_next(&iter, &stored, NULL))
+    {
+        // The key record is map-owned; only the arena pointer changes, never
+        // the hash or the bytes it compares equal by
+        struct string_key *key = (struct string_key *)stored;
+        if (key->payload[TAG_BYTE] != LONG_KEY_TAG)
+        {
+            continue;
+        }
+        uint32_t length;
+        const char *data = long_key_data(key, &length);
+        char *copy = chunk->data + chunk->used;
+        memcpy(copy, data, length);
+        chunk->used += length;
+        memcpy(key->payload + LONG_DATA_OFFSET, &copy, sizeof(copy));
+    }
+
+    chunks_free(map, map->chunks);
+    map->chunks = chunk;
+    map->arena_used = chunk->used;
+    map->arena_garbage = 0;
+}
+
+/**
+ * Respond to a hash flood in the underlying map: build a replacement with a
+ * new seed, storing every key with its hash recomputed from the key bytes.
+ * Long keys keep their arena copies. Left as is on allocation failure.
+ *
+ * @param map The string hashmap
+ */
+static void string_reseed(string_hashmap *map)
+{
+    hashmap_options options = map->options;
+    options.capacity = hashmap_size(map->map);
+    hashmap *rebuilt =
+        hashmap_create_ex(sizeof(struct string_key), map->value_size, NULL, string_key_equals, &options);
+    if (!rebuilt)
+    {
+        return;
+    }
+    uint64_t seed = hashmap_seed(rebuilt);
+
+    hashmap_iter iter;
+    const void *stored;
+    void *value;
+    hashmap_iter_init(&iter, map->map);
+    while (hashmap_iter_next(&iter, &stored, &value))
+    {
+        struct string_key key;
+        memcpy(&key, stored, sizeof(key));
+        key.hash = key_bytes_hash(&key, seed);
+        if (!hashmap_put_hashed(rebuilt, &key, value, key.hash))
+        {
+            hashmap_destroy(rebuilt);
+            return;
+        }
+    }
+    hashmap_destroy(map->map);
+    map->map = rebuilt;
+}
+
+/**
+ * Create a new string hashmap with default options.
+ *
+ * @param value_size Size of values in bytes
+ * @return New map or NULL on failure
+ */
+string_hashmap *string_hashmap_create(size_t value_size)
+{
+    return string_hashmap_create_ex(value_size, NULL);
+}
+
+/**
+ * Create a new string hashmap over a hashmap of 24-byte key records.
+ *
+ * @param value_size Size of values in bytes
+ * @param options Creation options, or NULL for defaults
+ * @return New map or NULL on failure
+ */
+string_hashmap *string_hashmap_create_ex(size_t value_size, const hashmap_options *options)
+{
+    hashmap_options core_options = {0};
+    if (options)
+    {
+        core_options = *options;
+    }
+    core_options.seeded_hash = string_key_hash;
+    // The underlying map cannot rehash stored hashes itself, so a flood is
+    // reported to string_reseed() instead
+    bool reseed_enabled = !(core_options.flags & HASHMAP_NO_RESEED);
+    core_options.flags |= HASHMAP_NO_RESEED;
+
+    hashmap_allocator allocator = hashmap_default_allocator;
+    if (core_options.allocator)
+    {
+        allocator = *core_options.allocator;
+    }
+
+    string_hashmap *map = allocator.alloc(allocator.ctx, sizeof(string_hashmap));
+    if (!map)
+    {
+        return NULL;
+    }
+    map->value_size = value_size;
+    map->reseed_enabled = reseed_enabled;
+    map->allocator = allocator;
+    map->chunks = NULL;
+    map->arena_used = 0;
+    map->arena_garbage = 0;
+    core_options.allocator = &map->allocator;
+    map->options = core_options;
+    map->map = hashmap_create_ex(sizeof(struct string_key), value_size, NULL, string_key_equals, &core_options);
+    if (!map->map)
+    {
+        allocator.free(allocator.ctx, map, sizeof(string_hashmap));
+        return NULL;
+    }
+    return map;
+}
+
+/**
+ * Insert or update a key-value pair. A new long key is copied into the arena
+ * before the probe; if the key turns out to exist the copy is given back.
+ *
+ * @param map The string hashmap
+ * @param key Pointer to the key bytes
+ * @param key_len Key length in bytes
+ * @param value Pointer to value data
+ * @return true on success, false on failure
+ */
+bool string_hashmap_put(string_hashmap *map, const void *key, size_t key_len, const void *value)
+{
+    struct string_key stored;
+    if (!map || !value || !make_key(map, &stored, key, key_len))
+    {
+        return false;
+    }
+    if (key_len > INLINE_KEY_MAX)
+    {
+        char *copy = arena_copy(map, key, key_len);
+        if (!copy)
+        {
+            return false;
+        }
+        memcpy(stored.payload + LONG_DATA_OFFSET, &copy, sizeof(copy));
+    }
+
+    bool inserted = false;
+    void *value_dest = hashmap_claim_hashed(map->map, &stored, stored.hash, &inserted);
+    if (key_len > INLINE_KEY_MAX && !inserted)
+    {
+        arena_unwind(map, key_len);
+    }
+    if (!value_dest)
+    {
+        return false;
+    }
+    memcpy(value_dest, value, map->value_size);
+    if (inserted && map->reseed_enabled && hashmap_take_flood(map->map))
+    {
+        string_reseed(map);
+    }
+    return true;
+}
+
+/**
+ * Retrieve a value by key.
+ *
+ * @param map The string hashmap
+ * @param key Pointer to the key bytes
+ * @param key_len Key length in bytes
+ * @param value_out Pointer to store retrieved value (if found)
+ * @return true if key found, false otherwise
+ */
+bool string_hashmap_get(const string_hashmap *map, const void *key, size_t key_len, void *value_out)
+{
+    struct string_key probe;
+    if (!map || !value_out || !make_key(map, &probe, key, key_len))
+    {
+        return false;
+    }
+    return hashmap_get_hashed(map->map, &probe, probe.hash, value_out);
+}
+
+/**
+ * Remove a key-value pair. The bytes of a long key stay in the arena until
+ * enough of it is garbage to be worth compacting.
+ *
+ * @param map The string hashmap
+ * @param key Pointer to the key bytes
+ * @param key_len Key length in bytes
+ * @return true if the key was found and removed, false otherwise
+ */
+bool string_hashmap_delete(string_hashmap *map, const void *key, size_t key_len)
+{
+    struct string_key probe;
+    if (!map || !make_key(map, &probe, key, key_len))
+    {
+        return false;
+    }
+    if (!hashmap_delete_hashed(map->map, &probe, probe.hash))
+    {
+        return false;
+    }
+    if (key_len > INLINE_KEY_MAX)
+    {
+        map->arena_garbage += key_len;
+        arena_compact(map);
+    }
+    return true;
+}
+
+/**
+ * Return the number of entries.
+ *
+ * @param map The string hashmap
+ * @return Number of entries (0 for NULL)
+ */
+size_t string_hashmap_size(const string_hashmap *map)
+{
+    return map ? hashmap_size(map->map) : 0;
+}
+
+/**
+ * Destroy the map, its arena and the underlying hashmap.
+ *
+ * @param map Map to destroy
+ */
+void string_hashmap_destroy(string_hashmap *map)
+{
+    if (!map)
+    {
+        return;
+    }
+    hashmap_destroy(map->map);
+    chunks_free(map, map->chunks);
+    map->allocator.free(map->allocator.ctx, map, sizeof(string_hashmap));
+}
@@ -0,0 +1,199 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "concurrent_hashmap.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Report a failed condition and fail the current test
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                 \
+            return false;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// Keys that stay in the map while writers churn others, and the churned range
+#define STABLE_KEYS 10000
+#define CHURN_KEYS 50000
+
+// Churned range large enough for shard bucket arrays of several MB, which
+// HASHMAP_HUGE_PAGES maps directly instead of taking from the allocator
+#define MAPPED_CHURN_KEYS 600000
+
+// Threads reading the stable keys during the churn test, and how many
+// lookups each makes before pausing so a writer waiting on a shard's rwlock
+// (which prefers readers) gets it
+#define READER_THREADS 4
+#define READS_PER_PAUSE 64
+
+/**
+ * State shared by the churn test's threads
+ */
+struct churn
+{
+    concurrent_hashmap *map;
+    atomic_bool done;
+    atomic_size_t errors;
+};
+
+/**
+ * Hash that sends keys below 1600 to 8 values (a flood), others spread out.
+ *
+ * @param key Pointer to a uint64_t key
+ * @param key_size Unused
+ * @return Hash value
+ */
+static uint64_t flood_hash(const void *key, size_t key_size)
+{
+    (void)key_size;
+    uint64_t k;
+    memcpy(&k, key, sizeof(k));
+    return k < 1600 ? k % 8 : k * 0x9E3779B97F4A7C15ull;
+}
+
+/**
+ * Put and get back every key of a flooded map with few shards. The flooded
+ * shards reseed, after which their keys must still be found in them.
+ *
+ * @param flags Creation flags
+ * @return true on success
+ */
+static bool test_flood(unsigned flags)
+{
+    hashmap_options options = {0};
+    options.flags = flags;
+    concurrent_hashmap *map = concurrent_hashmap_create_ex(8, 8, flood_hash, NULL, &options, 2);
+    CHECK(map);
+    for (uint64_t i = 0; i < 2600; i++)
+    {
+        CHECK(concurrent_hashmap_put(map, &i, &i));
+    }
+    CHECK(concurrent_hashmap_size(map) == 2600);
+    for (uint64_t i = 0; i < 2600; i++)
+    {
+        uint64_t value = 0;
+        CHECK(concurrent_hashmap_get(map, &i, &value));
+        CHECK(value == i);
+    }
+    for (uint64_t i = 0; i < 2600; i += 2)
+    {
+        CHECK(concurrent_hashmap_delete(map, &i));
+    }
+    for (uint64_t i = 0; i < 2600; i++)
+    {
+        uint64_t value = 0;
+        CHECK(concurrent_hashmap_get(map, &i, &value) == (i % 2 == 1));
+    }
+    concurrent_hashmap_destroy(map);
+    return true;
+}
+
+/**
+ * Reader thread: look up stable keys until the writer is done, counting any
+ * that are missing or have the wrong value.
+ *
+ * @param arg struct churn
+ * @return NULL
+ */
+static void *churn_reader(void *arg)
+{
+    struct churn *churn = arg;
+    uint64_t key = 0;
+    struct timespec pause = {0, 20000};
+    for (size_t reads = 1; !atomic_load(&churn->done); reads++)
+    {
+        if (reads % READS_PER_PAUSE == 0)
+        {
+            nanosleep(&pause, NULL);
+        }
+        key = (key + 7919) % STABLE_KEYS;
+        uint64_t value = 0;
+        if (!concurrent_hashmap_get(churn->map, &key, &value) || value != key * 3)
+        {
+            atomic_fetch_add(&churn->errors, 1);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Check that readers always see the stable keys while a writer inserts and
+ * deletes many others, growing every shard several times over.
+ *
+ * @param flags Creation flags
+ * @param hash Hash function, or NULL for the bundled one
+ * @param churn_keys Number of keys inserted and deleted again
+ * @param shard_count Number of shards
+ * @param evacuation_threads Evacuation workers per shard, 0 for none
+ * @return true on success
+ */
+static bool test_churn(unsigned flags, hash_fn hash, uint64_t churn_keys, size_t shard_count,
+                       unsigned evacuation_threads)
+{
+    hashmap_options options = {0};
+    options.flags = flags;
+    options.evacuation_threads = evacuation_threads;
+    struct churn churn;
+    churn.map = concurrent_hashmap_create_ex(8, 8, hash, NULL, &options, shard_count);
+    CHECK(churn.map);
+    atomic_init(&churn.done, false);
+    atomic_init(&churn.errors, 0);
+    for (uint64_t i = 0; i < STABLE_KEYS; i++)
+    {
+        uint64_t value = i * 3;
+        CHECK(concurrent_hashmap_put(churn.map, &i, &value));
+    }
+    pthread_t readers[READER_THREADS];
+    for (int i = 0; i < READER_THREADS; i++)
+    {
+        CHECK(pthread_create(&readers[i], NULL, churn_reader, &churn) == 0);
+    }
+    bool ok = true;
+    for (uint64_t i = STABLE_KEYS; i < STABLE_KEYS + churn_keys; i++)
+    {
+        ok &= concurrent_hashmap_put(churn.map, &i, &i);
+    }
+    for (uint64_t i = STABLE_KEYS; i < STABLE_KEYS + churn_keys; i++)
+    {
+        ok &= concurrent_hashmap_delete(churn.map, &i);
+    }
+    atomic_store(&churn.done, true);
+    for (int i = 0; i < READER_THREADS; i++)
+    {
+        pthread_join(readers[i], NULL);
+    }
+    CHECK(ok);
+    CHECK(atomic_load(&churn.errors) == 0);
+    CHECK(concurrent_hashmap_size(churn.map) == STABLE_KEYS);
+    concurrent_hashmap_destroy(churn.map);
+    return true;
+}
+
+int main(void)
+{
+    int failed = 0;
+    failed += !test_flood(0);
+    failed += !test_flood(CONCURRENT_HASHMAP_LOCK_FREE_READS);
+    failed += !test_churn(0, NULL, CHURN_KEYS, 4, 0);
+    failed += !test_churn(CONCURRENT_HASHMAP_LOCK_FREE_READS, NULL, CHURN_KEYS, 4, 0);
+    // Flooded shards reseed while lock-free readers look their keys up
+    failed += !test_churn(CONCURRENT_HASHMAP_LOCK_FREE_READS, flood_hash, CHURN_KEYS, 4, 0);
+    failed += !test_churn(CONCURRENT_HASHMAP_LOCK_FREE_READS | HASHMAP_HUGE_PAGES, NULL, MAPPED_CHURN_KEYS, 4, 0);
+    // One shard, so its workers evacuate the bucket arrays the readers look
+    // into, in the background with locked readers and inside writes without
+    failed += !test_churn(0, NULL, MAPPED_CHURN_KEYS, 1, 4);
+    failed += !test_churn(CONCURRENT_HASHMAP_LOCK_FREE_READS, NULL, MAPPED_CHURN_KEYS, 1, 4);
+    if (failed)
+    {
+        fprintf(stderr, "%d test(s) failed\n", failed);
+        return 1;
+    }
+    printf("concurrent_hashmap: all tests passed\n");
+    return 0;
+}
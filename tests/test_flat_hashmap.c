@@ -0,0 +1,224 @@
+#include "flat_hashmap.h"
+#include <stdio.h>
+#include <string.h>
+
+// Report a failed condition and fail the current test
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                 \
+            return false;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// Key range and operation count of the differential test
+#define DIFF_KEYS 4096
+#define DIFF_OPS 200000
+
+// Largest key size tested
+#define MAX_KEY_SIZE 24
+
+// Entries inserted by the batch test
+#define BATCH_KEYS 3000
+
+/**
+ * Advance a xorshift64 generator.
+ *
+ * @param state Generator state (nonzero)
+ * @return Next pseudo-random number
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Encode key number i as key_size bytes, distinct for every i.
+ *
+ * @param key Receives the key bytes
+ * @param key_size Key size (4 to MAX_KEY_SIZE)
+ * @param i Key number
+ */
+static void make_key(unsigned char *key, size_t key_size, uint64_t i)
+{
+    memset(key, 0xa5, key_size);
+    uint32_t low = (uint32_t)i;
+    memcpy(key + key_size - sizeof(low), &low, sizeof(low));
+}
+
+/**
+ * Check a flat hashmap against a reference array after random puts, deletes
+ * and lookups, then compare iteration with the array of present keys.
+ *
+ * @param key_size Key size in bytes
+ * @param reserve Capacity to reserve up front (0 to grow step by step)
+ * @return true on success
+ */
+static bool test_differential(size_t key_size, size_t reserve)
+{
+    static bool present[DIFF_KEYS];
+    static uint64_t expected[DIFF_KEYS];
+    memset(present, 0, sizeof(present));
+    flat_hashmap *map = flat_hashmap_create(key_size, 8, NULL, NULL);
+    CHECK(map);
+    CHECK(flat_hashmap_reserve(map, reserve));
+    uint64_t state = 0x2545F4914F6CDD1Dull;
+    size_t count = 0;
+    unsigned char key[MAX_KEY_SIZE];
+    for (size_t op = 0; op < DIFF_OPS; op++)
+    {
+        uint64_t roll = next_random(&state);
+        uint64_t i = (roll >> 8) % DIFF_KEYS;
+        make_key(key, key_size, i);
+        unsigned kind = (unsigned)(roll % 100);
+        if (kind < 45)
+        {
+            CHECK(flat_hashmap_put(map, key, &roll));
+            count += !present[i];
+            present[i] = true;
+            expected[i] = roll;
+        }
+        else if (kind < 70)
+        {
+            CHECK(flat_hashmap_delete(map, key) == present[i]);
+            count -= present[i];
+            present[i] = false;
+        }
+        else
+        {
+            uint64_t value = 0;
+            CHECK(flat_hashmap_get(map, key, &value) == present[i]);
+            CHECK(!present[i] || value == expected[i]);
+            uint64_t *stored = flat_hashmap_get_ptr(map, key);
+            CHECK((stored != NULL) == present[i]);
+            CHECK(!stored || *stored == expected[i]);
+        }
+        CHECK(flat_hashmap_size(map) == count);
+    }
+
+    flat_hashmap_iter iter;
+    flat_hashmap_iter_init(&iter, map);
+    const void *key_ptr;
+    void *value_ptr;
+    size_t seen = 0;
+    while (flat_hashmap_iter_next(&iter, &key_ptr, &value_ptr))
+    {
+        uint32_t low;
+        uint64_t value;
+        memcpy(&low, (const unsigned char *)key_ptr + key_size - sizeof(low), sizeof(low));
+        memcpy(&value, value_ptr, sizeof(value));
+        CHECK(low < DIFF_KEYS && present[low] && value == expected[low]);
+        seen++;
+    }
+    CHECK(seen == count);
+    flat_hashmap_destroy(map);
+    return true;
+}
+
+/**
+ * Fill a map with put_batch (unique, then updating with duplicates inside the
+ * batch), read it back with get_batch, count keys through
+ * get_or_insert_slot, and check the statistics after deletes.
+ *
+ * @param key_size Key size in bytes
+ * @return true on success
+ */
+static bool test_batch(size_t key_size)
+{
+    static unsigned char keys[2 * BATCH_KEYS * MAX_KEY_SIZE];
+    static uint64_t values[2 * BATCH_KEYS];
+    static bool found[2 * BATCH_KEYS];
+    flat_hashmap *map = flat_hashmap_create(key_size, 8, NULL, NULL);
+    CHECK(map);
+    for (uint64_t i = 0; i < BATCH_KEYS; i++)
+    {
+        make_key(keys + i * key_size, key_size, i);
+        values[i] = i;
+    }
+    CHECK(flat_hashmap_put_batch(map, keys, values, BATCH_KEYS, HASHMAP_BATCH_UNIQUE) == BATCH_KEYS);
+    CHECK(flat_hashmap_size(map) == BATCH_KEYS);
+
+    // Every even key twice: the later value wins
+    size_t n = 0;
+    for (uint64_t i = 0; i < BATCH_KEYS; i += 2, n += 2)
+    {
+        make_key(keys + n * key_size, key_size, i);
+        make_key(keys + (n + 1) * key_size, key_size, i);
+        values[n] = 0;
+        values[n + 1] = i * 3;
+    }
+    CHECK(flat_hashmap_put_batch(map, keys, values, n, 0) == n);
+    CHECK(flat_hashmap_size(map) == BATCH_KEYS);
+
+    // Present keys interleaved with absent ones
+    for (uint64_t i = 0; i < 2 * BATCH_KEYS; i++)
+    {
+        make_key(keys + i * key_size, key_size, i % 2 ? BATCH_KEYS + i : i / 2);
+        values[i] = UINT64_MAX;
+    }
+    CHECK(flat_hashmap_get_batch(map, keys, 2 * BATCH_KEYS, values, found) == BATCH_KEYS);
+    for (uint64_t i = 0; i < 2 * BATCH_KEYS; i++)
+    {
+        uint64_t key = i / 2;
+        CHECK(found[i] == (i % 2 == 0));
+        CHECK(values[i] == (i % 2 ? UINT64_MAX : key % 2 ? key : key * 3));
+    }
+
+    // Count hits per key in place: half the keys are new and start at zero
+    for (uint64_t i = 0; i < 2 * BATCH_KEYS; i++)
+    {
+        unsigned char key[MAX_KEY_SIZE];
+        make_key(key, key_size, BATCH_KEYS + i % BATCH_KEYS);
+        bool inserted = false;
+        uint64_t *slot = flat_hashmap_get_or_insert_slot(map, key, &inserted);
+        CHECK(slot && inserted == (i < BATCH_KEYS));
+        CHECK(*slot == (i < BATCH_KEYS ? 0 : 1));
+        (*slot)++;
+    }
+    CHECK(flat_hashmap_size(map) == 2 * BATCH_KEYS);
+
+    for (uint64_t i = 0; i < BATCH_KEYS; i++)
+    {
+        unsigned char key[MAX_KEY_SIZE];
+        make_key(key, key_size, i);
+        CHECK(flat_hashmap_delete(map, key));
+    }
+    flat_hashmap_statistics stats;
+    CHECK(!flat_hashmap_stats(NULL, &stats));
+    CHECK(flat_hashmap_stats(map, &stats));
+    CHECK(stats.count == BATCH_KEYS);
+    CHECK(stats.capacity >= stats.count + stats.tombstones + stats.growth_left);
+    size_t probed = 0;
+    for (size_t i = 0; i < FLAT_HASHMAP_STATS_MAX_PROBE; i++)
+    {
+        probed += stats.probe_lengths[i];
+    }
+    CHECK(probed == BATCH_KEYS);
+    CHECK(stats.max_probe >= 1);
+    CHECK(stats.load_factor > 0.0 && stats.load_factor <= 0.875);
+    flat_hashmap_destroy(map);
+    return true;
+}
+
+int main(void)
+{
+    int failed = 0;
+    failed += !test_differential(4, 0);
+    failed += !test_differential(8, 0);
+    failed += !test_differential(8, DIFF_KEYS);
+    failed += !test_differential(MAX_KEY_SIZE, 0);
+    failed += !test_batch(8);
+    failed += !test_batch(MAX_KEY_SIZE);
+    if (failed)
+    {
+        fprintf(stderr, "%d test(s) failed\n", failed);
+        return 1;
+    }
+    printf("flat_hashmap: all tests passed\n");
+    return 0;
+}
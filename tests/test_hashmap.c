@@ -0,0 +1,380 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "hashmap.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Report a failed condition and fail the current test
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                 \
+            return false;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// Keys used by the flood tests
+#define FLOOD_KEYS 200
+
+// Key range and operation count of the differential tests
+#define DIFF_KEYS 4096
+#define DIFF_OPS 200000
+
+// Entries inserted by the parallel evacuation test: enough for a 64K-bucket
+// array to double, which is when worker threads take over
+#define EVACUATION_KEYS 600000
+
+/**
+ * Hash that sends every key to the same value, so inserts flood one chain and
+ * make the map reseed.
+ *
+ * @param key Unused
+ * @param key_size Unused
+ * @return Always the same hash
+ */
+static uint64_t constant_hash(const void *key, size_t key_size)
+{
+    (void)key;
+    (void)key_size;
+    return 42;
+}
+
+/**
+ * Advance a xorshift64 generator.
+ *
+ * @param state Generator state (nonzero)
+ * @return Next pseudo-random number
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Check that a map holds exactly the keys 0..n-1, each mapped to key * 3.
+ *
+ * @param map The hashmap
+ * @param n Number of keys
+ * @return true if every key is found with its value
+ */
+static bool holds_keys(const hashmap *map, uint64_t n)
+{
+    CHECK(hashmap_size(map) == n);
+    for (uint64_t i = 0; i < n; i++)
+    {
+        uint64_t value = 0;
+        CHECK(hashmap_get(map, &i, &value));
+        CHECK(value == i * 3);
+    }
+    return true;
+}
+
+/**
+ * Flood a map through hashmap_put, then read every key back.
+ *
+ * @return true on success
+ */
+static bool test_flood_put(void)
+{
+    hashmap *map = hashmap_create(8, 8, constant_hash, NULL);
+    CHECK(map);
+    for (uint64_t i = 0; i < FLOOD_KEYS; i++)
+    {
+        uint64_t value = i * 3;
+        CHECK(hashmap_put(map, &i, &value));
+    }
+    CHECK(holds_keys(map, FLOOD_KEYS));
+    hashmap_destroy(map);
+    return true;
+}
+
+/**
+ * Flood a map through hashmap_put_batch and hashmap_build, where a reseed in
+ * the middle of a window must not leave later entries under the old seed.
+ *
+ * @param flags 0 or HASHMAP_BATCH_UNIQUE
+ * @return true on success
+ */
+static bool test_flood_batch(unsigned flags)
+{
+    uint64_t keys[FLOOD_KEYS];
+    uint64_t values[FLOOD_KEYS];
+    for (uint64_t i = 0; i < FLOOD_KEYS; i++)
+    {
+        keys[i] = i;
+        values[i] = i * 3;
+    }
+    hashmap *map = hashmap_create(8, 8, constant_hash, NULL);
+    CHECK(map);
+    CHECK(hashmap_put_batch(map, keys, values, FLOOD_KEYS, flags) == FLOOD_KEYS);
+    CHECK(holds_keys(map, FLOOD_KEYS));
+    hashmap_destroy(map);
+
+    map = hashmap_build(8, 8, constant_hash, NULL, NULL, keys, values, FLOOD_KEYS, flags);
+    CHECK(map);
+    CHECK(holds_keys(map, FLOOD_KEYS));
+    hashmap_destroy(map);
+    return true;
+}
+
+/**
+ * Check a hashmap against a reference array after random puts, deletes and
+ * lookups, comparing hashmap_get, hashmap_get_ptr, the staged lookup and
+ * iteration with the array of present keys.
+ *
+ * @param flags Creation flags
+ * @return true on success
+ */
+static bool test_differential(unsigned flags)
+{
+    static bool present[DIFF_KEYS];
+    static uint64_t expected[DIFF_KEYS];
+    memset(present, 0, sizeof(present));
+    hashmap_options options = {0};
+    options.flags = flags;
+    options.shrink_percent = 25;
+    hashmap *map = hashmap_create_ex(8, 8, NULL, NULL, &options);
+    CHECK(map);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    size_t count = 0;
+    for (size_t op = 0; op < DIFF_OPS; op++)
+    {
+        uint64_t roll = next_random(&state);
+        uint64_t key = (roll >> 8) % DIFF_KEYS;
+        // Phases of mostly puts and mostly deletes grow and shrink the map
+        unsigned put_percent = (op / (DIFF_OPS / 8)) % 2 == 0 ? 60 : 25;
+        unsigned kind = (unsigned)(roll % 100);
+        if (kind < put_percent)
+        {
+            uint64_t value = roll;
+            CHECK(hashmap_put(map, &key, &value));
+            count += !present[key];
+            present[key] = true;
+            expected[key] = value;
+        }
+        else if (kind < 70)
+        {
+            CHECK(hashmap_delete(map, &key) == present[key]);
+            count -= present[key];
+            present[key] = false;
+        }
+        else
+        {
+            uint64_t value = 0;
+            CHECK(hashmap_get(map, &key, &value) == present[key]);
+            CHECK(!present[key] || value == expected[key]);
+            uint64_t *stored = hashmap_get_ptr(map, &key);
+            CHECK((stored != NULL) == present[key]);
+            CHECK(!stored || *stored == expected[key]);
+            hashmap_lookup lookup;
+            hashmap_lookup_begin(&lookup, map, &key);
+            CHECK(hashmap_lookup_finish(&lookup, NULL) == (void *)stored);
+        }
+        CHECK(hashmap_size(map) == count);
+    }
+
+    hashmap_iter iter;
+    hashmap_iter_init(&iter, map);
+    const void *key_ptr;
+    void *value_ptr;
+    size_t seen = 0;
+    while (hashmap_iter_next(&iter, &key_ptr, &value_ptr))
+    {
+        uint64_t key;
+        uint64_t value;
+        memcpy(&key, key_ptr, sizeof(key));
+        memcpy(&value, value_ptr, sizeof(value));
+        CHECK(key < DIFF_KEYS && present[key] && value == expected[key]);
+        seen++;
+    }
+    CHECK(seen == count);
+    hashmap_destroy(map);
+    return true;
+}
+
+/**
+ * Fill a map created with evacuation worker threads through
+ * hashmap_get_or_insert_slot, writing each value through the returned slot.
+ * The slot handed out by the insert that starts growth must stay valid until
+ * the next mutation, and lookups, batch lookups, deletes and iteration must
+ * see every entry while the workers move them in the background.
+ *
+ * @return true on success
+ */
+static bool test_parallel_evacuation(void)
+{
+    hashmap_options options = {0};
+    options.evacuation_threads = 4;
+    hashmap *map = hashmap_create_ex(8, 8, NULL, NULL, &options);
+    CHECK(map);
+    bool iterated = false;
+    for (uint64_t i = 0; i < EVACUATION_KEYS; i++)
+    {
+        bool inserted = false;
+        uint64_t *slot = hashmap_get_or_insert_slot(map, &i, &inserted);
+        CHECK(slot && inserted && *slot == 0);
+        *slot = i * 3;
+        if (i % 61 == 0)
+        {
+            // Keys spread over the old array, most in ranges no worker reached yet
+            uint64_t keys[4] = {i / 2, i / 3, i / 5, i};
+            uint64_t values[4] = {0};
+            CHECK(hashmap_get_batch(map, keys, 4, values, NULL) == 4);
+            for (int k = 0; k < 4; k++)
+            {
+                CHECK(values[k] == keys[k] * 3);
+            }
+            uint64_t key = i / 7;
+            uint64_t value = key * 3;
+            CHECK(hashmap_delete(map, &key));
+            CHECK(hashmap_put(map, &key, &value));
+        }
+        hashmap_statistics stats;
+        if (!iterated && i % 1024 == 0 && hashmap_stats(map, &stats) && stats.growing &&
+            stats.old_bucket_count >= 65536)
+        {
+            CHECK(stats.count == i + 1);
+            hashmap_iter iter;
+            hashmap_iter_init(&iter, map);
+            size_t seen = 0;
+            while (hashmap_iter_next(&iter, NULL, NULL))
+            {
+                seen++;
+            }
+            CHECK(seen == i + 1);
+            iterated = true;
+        }
+    }
+    CHECK(iterated);
+    CHECK(holds_keys(map, EVACUATION_KEYS));
+    for (uint64_t i = 0; i < EVACUATION_KEYS; i += 2)
+    {
+        CHECK(hashmap_delete(map, &i));
+    }
+    for (uint64_t i = 0; i < EVACUATION_KEYS; i++)
+    {
+        uint64_t value = 0;
+        CHECK(hashmap_get(map, &i, &value) == (i % 2 == 1));
+        CHECK(i % 2 == 0 || value == i * 3);
+    }
+    hashmap_destroy(map);
+    return true;
+}
+
+/**
+ * Write a whole buffer to a new file.
+ *
+ * @param path File to create or replace
+ * @param data Bytes to write
+ * @param size Number of bytes
+ * @return true on success
+ */
+static bool write_file(const char *path, const char *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    CHECK(file);
+    bool ok = fwrite(data, 1, size, file) == size;
+    CHECK(fclose(file) == 0 && ok);
+    return true;
+}
+
+/**
+ * Save a map, reopen it with hashmap_open_mmap, check every key, then check
+ * that truncated or corrupted copies are either rejected or stay readable
+ * without leaving the mapping (run under AddressSanitizer).
+ *
+ * @param flags Layout flags of the saved map
+ * @return true on success
+ */
+static bool test_snapshot(unsigned flags)
+{
+    char path[] = "/tmp/ads_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    hashmap_options options = {0};
+    options.flags = flags;
+    hashmap *map = hashmap_create_ex(8, 8, constant_hash, NULL, &options);
+    CHECK(map);
+    // A constant hash makes long overflow chains, so the file has links to check
+    for (uint64_t i = 0; i < FLOOD_KEYS; i++)
+    {
+        uint64_t value = i * 3;
+        CHECK(hashmap_put(map, &i, &value));
+    }
+    CHECK(hashmap_save(map, fd));
+    hashmap_destroy(map);
+    off_t end = lseek(fd, 0, SEEK_END);
+    CHECK(end > 0);
+    size_t size = (size_t)end;
+    char *saved = malloc(size);
+    CHECK(saved && pread(fd, saved, size, 0) == (ssize_t)size);
+    close(fd);
+
+    map = hashmap_open_mmap(path, constant_hash, NULL, NULL);
+    CHECK(map);
+    CHECK(holds_keys(map, FLOOD_KEYS));
+    uint64_t key = FLOOD_KEYS;
+    uint64_t value = key * 3;
+    CHECK(hashmap_put(map, &key, &value));
+    CHECK(holds_keys(map, FLOOD_KEYS + 1));
+    hashmap_destroy(map);
+
+    // Truncated files must be rejected
+    for (size_t cut = 1; cut < size; cut += size / 16 + 1)
+    {
+        CHECK(write_file(path, saved, size - cut));
+        map = hashmap_open_mmap(path, constant_hash, NULL, NULL);
+        CHECK(!map);
+    }
+
+    // Clobber each word of the file in turn: whatever opens must stay in bounds
+    char *copy = malloc(size);
+    CHECK(copy);
+    for (size_t at = 0; at + sizeof(uint64_t) <= size; at += sizeof(uint64_t))
+    {
+        memcpy(copy, saved, size);
+        memset(copy + at, 0x7f, sizeof(uint64_t));
+        CHECK(write_file(path, copy, size));
+        map = hashmap_open_mmap(path, constant_hash, NULL, NULL);
+        for (uint64_t i = 0; map && i < FLOOD_KEYS; i++)
+        {
+            hashmap_get(map, &i, &value);
+        }
+        hashmap_destroy(map);
+    }
+    free(copy);
+    free(saved);
+    unlink(path);
+    return true;
+}
+
+int main(void)
+{
+    int failed = 0;
+    failed += !test_flood_put();
+    failed += !test_flood_batch(0);
+    failed += !test_flood_batch(HASHMAP_BATCH_UNIQUE);
+    failed += !test_snapshot(0);
+    failed += !test_snapshot(HASHMAP_FINGERPRINTS | HASHMAP_NEIGHBORHOOD);
+    failed += !test_differential(0);
+    failed += !test_differential(HASHMAP_FINGERPRINTS);
+    failed += !test_differential(HASHMAP_NEIGHBORHOOD);
+    failed += !test_differential(HASHMAP_INDIRECT_KEYS | HASHMAP_INDIRECT_VALUES);
+    failed += !test_differential(HASHMAP_PAD_SLOTS | HASHMAP_CACHE_ALIGN | HASHMAP_NO_RESEED);
+    failed += !test_parallel_evacuation();
+    if (failed)
+    {
+        fprintf(stderr, "%d test(s) failed\n", failed);
+        return 1;
+    }
+    printf("hashmap: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Default instantiation: 8-byte keys and values
+#define ADS_NAME u64_map
+#define ADS_KEY_T uint64_t
+#define ADS_VALUE_T uint64_t
+#include "hashmap_impl.h"
+
+/**
+ * Struct key for the second instantiation; equality ignores the padding
+ */
+struct point
+{
+    uint32_t x;
+    uint16_t y;
+};
+
+// Second instantiation: every optional parameter set, and a weak hash so
+// chains overflow
+#define ADS_NAME point_map
+#define ADS_KEY_T struct point
+#define ADS_VALUE_T uint64_t
+#define ADS_HASH(key) ((uint64_t)((key)->x % 64))
+#define ADS_EQUAL(a, b) ((a)->x == (b)->x && (a)->y == (b)->y)
+#define ADS_BUCKET_SIZE 16
+#define ADS_INITIAL_BUCKETS 2
+#define ADS_LOAD_NUMERATOR 4
+#define ADS_LOAD_DENOMINATOR 1
+#include "hashmap_impl.h"
+
+// Report a failed condition and fail the current test
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                 \
+            return false;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// Key range and operation count of the differential tests
+#define DIFF_KEYS 4096
+#define DIFF_OPS 200000
+
+/**
+ * Advance a xorshift64 generator.
+ *
+ * @param state Generator state (nonzero)
+ * @return Next pseudo-random number
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Check the default instantiation against a reference array after random
+ * puts, deletes and lookups, then compare iteration with it.
+ *
+ * @param capacity Capacity passed to create
+ * @return true on success
+ */
+static bool test_u64_differential(size_t capacity)
+{
+    static bool present[DIFF_KEYS];
+    static uint64_t expected[DIFF_KEYS];
+    memset(present, 0, sizeof(present));
+    u64_map *map = u64_map_create(capacity);
+    CHECK(map);
+    uint64_t state = 0xDA942042E4DD58B5ull;
+    size_t count = 0;
+    for (size_t op = 0; op < DIFF_OPS; op++)
+    {
+        uint64_t roll = next_random(&state);
+        uint64_t key = (roll >> 8) % DIFF_KEYS;
+        unsigned kind = (unsigned)(roll % 100);
+        if (kind < 45)
+        {
+            CHECK(u64_map_put(map, key, roll));
+            count += !present[key];
+            present[key] = true;
+            expected[key] = roll;
+        }
+        else if (kind < 70)
+        {
+            CHECK(u64_map_delete(map, key) == present[key]);
+            count -= present[key];
+            present[key] = false;
+        }
+        else
+        {
+            uint64_t value = 0;
+            CHECK(u64_map_get(map, key, &value) == present[key]);
+            CHECK(!present[key] || value == expected[key]);
+            uint64_t *stored = u64_map_get_ptr(map, key);
+            CHECK((stored != NULL) == present[key]);
+            CHECK(!stored || *stored == expected[key]);
+        }
+        CHECK(u64_map_size(map) == count);
+    }
+
+    u64_map_iter iter;
+    u64_map_iter_init(&iter, map);
+    const uint64_t *key;
+    uint64_t *value;
+    size_t seen = 0;
+    while (u64_map_iter_next(&iter, &key, &value))
+    {
+        CHECK(*key < DIFF_KEYS && present[*key] && *value == expected[*key]);
+        seen++;
+    }
+    CHECK(seen == count);
+    u64_map_destroy(map);
+    return true;
+}
+
+/**
+ * Check the fully parameterized instantiation against a reference array.
+ *
+ * @return true on success
+ */
+static bool test_point_differential(void)
+{
+    static bool present[DIFF_KEYS];
+    static uint64_t expected[DIFF_KEYS];
+    point_map *map = point_map_create(0);
+    CHECK(map);
+    CHECK(point_map_reserve(map, 100));
+    uint64_t state = 0x5851F42D4C957F2Dull;
+    size_t count = 0;
+    for (size_t op = 0; op < DIFF_OPS; op++)
+    {
+        uint64_t roll = next_random(&state);
+        uint64_t i = (roll >> 8) % DIFF_KEYS;
+        struct point key;
+        memset(&key, 0xff, sizeof(key));
+        key.x = (uint32_t)(i / 8);
+        key.y = (uint16_t)(i % 8);
+        unsigned kind = (unsigned)(roll % 100);
+        if (kind < 45)
+        {
+            CHECK(point_map_put(map, key, roll));
+            count += !present[i];
+            present[i] = true;
+            expected[i] = roll;
+        }
+        else if (kind < 70)
+        {
+            CHECK(point_map_delete(map, key) == present[i]);
+            count -= present[i];
+            present[i] = false;
+        }
+        else
+        {
+            uint64_t value = 0;
+            CHECK(point_map_get(map, key, &value) == present[i]);
+            CHECK(!present[i] || value == expected[i]);
+        }
+        CHECK(point_map_size(map) == count);
+    }
+    point_map_destroy(map);
+    return true;
+}
+
+int main(void)
+{
+    int failed = 0;
+    failed += !test_u64_differential(0);
+    failed += !test_u64_differential(DIFF_KEYS);
+    failed += !test_point_differential();
+    if (failed)
+    {
+        fprintf(stderr, "%d test(s) failed\n", failed);
+        return 1;
+    }
+    printf("hashmap_impl: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include "string_hashmap.h"
+#include <stdio.h>
+#include <string.h>
+
+// Report a failed condition and fail the current test
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                 \
+            return false;                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// Key range and operation count of the differential test
+#define DIFF_KEYS 4096
+#define DIFF_OPS 200000
+
+// Room for the longest generated key
+#define MAX_KEY_LEN 64
+
+/**
+ * Advance a xorshift64 generator.
+ *
+ * @param state Generator state (nonzero)
+ * @return Next pseudo-random number
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Spell key number i: key 0 is the empty string, and every third key is long
+ * enough to live in the arena instead of inline.
+ *
+ * @param key Receives the key bytes (MAX_KEY_LEN bytes of room)
+ * @param i Key number
+ * @return Key length
+ */
+static size_t make_key(char *key, uint64_t i)
+{
+    if (i == 0)
+    {
+        return 0;
+    }
+    const char *format = i % 3 == 0 ? "a rather long string key number %llu" : "k%llu";
+    return (size_t)snprintf(key, MAX_KEY_LEN, format, (unsigned long long)i);
+}
+
+/**
+ * Check a string hashmap against a reference array after random puts,
+ * deletes and lookups.
+ *
+ * @return true on success
+ */
+static bool test_differential(void)
+{
+    static bool present[DIFF_KEYS];
+    static uint64_t expected[DIFF_KEYS];
+    string_hashmap *map = string_hashmap_create(8);
+    CHECK(map);
+    uint64_t state = 0x853C49E6748FEA9Bull;
+    size_t count = 0;
+    char key[MAX_KEY_LEN];
+    for (size_t op = 0; op < DIFF_OPS; op++)
+    {
+        uint64_t roll = next_random(&state);
+        uint64_t i = (roll >> 8) % DIFF_KEYS;
+        size_t key_len = make_key(key, i);
+        unsigned kind = (unsigned)(roll % 100);
+        if (kind < 45)
+        {
+            CHECK(string_hashmap_put(map, key, key_len, &roll));
+            count += !present[i];
+            present[i] = true;
+            expected[i] = roll;
+        }
+        else if (kind < 70)
+        {
+            CHECK(string_hashmap_delete(map, key, key_len) == present[i]);
+            count -= present[i];
+            present[i] = false;
+        }
+        else
+        {
+            uint64_t value = 0;
+            CHECK(string_hashmap_get(map, key, key_len, &value) == present[i]);
+            CHECK(!present[i] || value == expected[i]);
+        }
+        CHECK(string_hashmap_size(map) == count);
+    }
+    string_hashmap_destroy(map);
+    return true;
+}
+
+/**
+ * Check that keys sharing a prefix, or the same bytes at another length, are
+ * kept apart, both inline and in the arena.
+ *
+ * @return true on success
+ */
+static bool test_prefixes(void)
+{
+    static const char text[] = "a prefix shared by the short and the long keys";
+    string_hashmap *map = string_hashmap_create(8);
+    CHECK(map);
+    for (uint64_t len = 0; len < sizeof(text); len++)
+    {
+        CHECK(string_hashmap_put(map, text, len, &len));
+    }
+    CHECK(string_hashmap_size(map) == sizeof(text));
+    for (uint64_t len = 0; len < sizeof(text); len++)
+    {
+        uint64_t value = 0;
+        CHECK(string_hashmap_get(map, text, len, &value));
+        CHECK(value == len);
+    }
+    uint64_t value = 0;
+    CHECK(string_hashmap_delete(map, text, 15));
+    CHECK(!string_hashmap_get(map, text, 15, &value));
+    CHECK(string_hashmap_get(map, text, 14, &value) && value == 14);
+    CHECK(string_hashmap_get(map, text, 16, &value) && value == 16);
+    string_hashmap_destroy(map);
+    return true;
+}
+
+int main(void)
+{
+    int failed = 0;
+    failed += !test_differential();
+    failed += !test_prefixes();
+    if (failed)
+    {
+        fprintf(stderr, "%d test(s) failed\n", failed);
+        return 1;
+    }
+    printf("string_hashmap: all tests passed\n");
+    return 0;
+}